@@ -31,6 +31,12 @@ else
     echo "Error loading functions: $SINGULARITY_libexecdir/singularity/functions"
     exit 1
 fi
+if [ -f "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions" ]; then
+    . "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions"
+else
+    echo "Error loading functions: $SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions"
+    exit 1
+fi
 
 if [ -z "${SINGULARITY_ROOTFS:-}" ]; then
     message ERROR "Singularity root file system not defined\n"
@@ -79,10 +85,22 @@ fi
 
 REQUIRES=`echo "${INCLUDE:-}" | sed -e 's/\s/,/g'`
 
+# debootstrap checks the debs it finds in --cache-dir against the archive
+CACHE_OPT=""
+if eval "$DEBOOTSTRAP_PATH --help" 2>/dev/null | grep -q -- "--cache-dir"; then
+    if singularity_pkgcache_open "debootstrap" "$MIRRORURL $ARCH"; then
+        CACHE_OPT="--cache-dir='$SINGULARITY_PKGCACHE_PATH'"
+    fi
+elif [ -n "${SINGULARITY_PKGCACHE:-}" ]; then
+    message WARNING "debootstrap does not support --cache-dir, not using the package cache\n"
+fi
+
 # The excludes save 25M or so with jessie.  (Excluding udev avoids
 # systemd, for instance.)  There are a few more we could exclude
 # to save a few MB.  I see 182M cleaned with this, v. 241M with
 # the default debootstrap.
-if ! eval "$DEBOOTSTRAP_PATH --variant=minbase --exclude=openssl,udev,debconf-i18n,e2fsprogs --include=apt,$REQUIRES --arch=$ARCH '$OSVERSION' '$SINGULARITY_ROOTFS' '$MIRRORURL'"; then
+if ! eval "$DEBOOTSTRAP_PATH --variant=minbase --exclude=openssl,udev,debconf-i18n,e2fsprogs --include=apt,$REQUIRES --arch=$ARCH $CACHE_OPT '$OSVERSION' '$SINGULARITY_ROOTFS' '$MIRRORURL'"; then
     ABORT 255
 fi
+
+singularity_pkgcache_close
@@ -87,16 +87,16 @@ if [ $? -eq 127 ]; then
     OLD_EXTRACTION="TRUE"
 fi
 
-for i in `cat "$SINGULARITY_CONTENTS"`; do
-    name=`basename "$i"`
-    message 1 "Exploding layer: $name\n"
-    # Code 127 if docker-extract is missing, or missing dynamic libs
-    if [ ! -z "${OLD_EXTRACTION:-}" ]; then
+if [ ! -z "${OLD_EXTRACTION:-}" ]; then
+    for i in `cat "$SINGULARITY_CONTENTS"`; do
+        name=`basename "$i"`
+        message 1 "Exploding layer: $name\n"
         zcat "$i" | (cd "$SINGULARITY_ROOTFS"; tar --exclude=dev/* -xf -) || exit $?
-    else
-        $SINGULARITY_libexecdir/singularity/bin/docker-extract "$i" || exit $?
-    fi
-done
+    done
+else
+    # All layers in one call, so they are extracted concurrently
+    $SINGULARITY_libexecdir/singularity/bin/docker-extract `cat "$SINGULARITY_CONTENTS"` || exit $?
+fi
 
 rm -f "$SINGULARITY_CONTENTS"
 
@@ -31,6 +31,12 @@ else
     echo "Error loading functions: $SINGULARITY_libexecdir/singularity/functions"
     exit 1
 fi
+if [ -f "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions" ]; then
+    . "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions"
+else
+    echo "Error loading functions: $SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions"
+    exit 1
+fi
 
 if [ -z "${SINGULARITY_ROOTFS:-}" ]; then
     message ERROR "Singularity root file system not defined\n"
@@ -119,7 +125,12 @@ if [ -n "${http_proxy:-}" ]; then
     echo "proxy=$http_proxy" >> "$SINGULARITY_ROOTFS/$YUM_CONF"
 fi
 echo 'cachedir=/var/cache/yum-bootstrap' >> "$SINGULARITY_ROOTFS/$YUM_CONF"
-echo "keepcache=0" >> "$SINGULARITY_ROOTFS/$YUM_CONF"
+if singularity_pkgcache_open "yum" "$MIRROR $MIRROR_META $MIRROR_UPDATES $MIRROR_UPDATES_META $OSVERSION `uname -m`" && \
+        singularity_pkgcache_mount "/var/cache/yum-bootstrap"; then
+    echo "keepcache=1" >> "$SINGULARITY_ROOTFS/$YUM_CONF"
+else
+    echo "keepcache=0" >> "$SINGULARITY_ROOTFS/$YUM_CONF"
+fi
 echo "debuglevel=2" >> "$SINGULARITY_ROOTFS/$YUM_CONF"
 echo "logfile=/var/log/yum.log" >> "$SINGULARITY_ROOTFS/$YUM_CONF"
 echo "syslog_device=/dev/null" >> "$SINGULARITY_ROOTFS/$YUM_CONF"
@@ -219,6 +230,8 @@ if [ -f "/etc/yum.conf" ]; then
     fi
 fi
 
+singularity_pkgcache_close
+
 if ! eval "rm -rf $SINGULARITY_ROOTFS/var/cache/yum-bootstrap"; then
     message WARNING "Failed cleaning Bootstrap packages\n"
 fi
@@ -31,6 +31,12 @@ else
     echo "Error loading functions: $SINGULARITY_libexecdir/singularity/functions"
     exit 1
 fi
+if [ -f "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions" ]; then
+    . "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions"
+else
+    echo "Error loading functions: $SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions"
+    exit 1
+fi
 
 if [ -z "${SINGULARITY_ROOTFS:-}" ]; then
     message ERROR "Singularity root file system not defined\n"
@@ -114,8 +120,14 @@ echo "[main]" >> "$SINGULARITY_ROOTFS/$ZYPP_CONF"
 echo 'cachedir=/var/cache/zypp-bootstrap' >> "$SINGULARITY_ROOTFS/$ZYPP_CONF"
 echo "" >> "$SINGULARITY_ROOTFS/$ZYPP_CONF"
 
+ZYPP_KEEP=""
+if singularity_pkgcache_open "zypper" "$MIRROR $OSVERSION `uname -m`" && \
+        singularity_pkgcache_mount "/var/cache/zypp-bootstrap"; then
+    ZYPP_KEEP="--keep-packages"
+fi
+
 # Import zypper repos
-$INSTALL_CMD --root $SINGULARITY_ROOTFS ar $MIRROR repo-oss
+$INSTALL_CMD --root $SINGULARITY_ROOTFS ar $ZYPP_KEEP $MIRROR repo-oss
 $INSTALL_CMD --root $SINGULARITY_ROOTFS --gpg-auto-import-keys refresh
 
 # Do the install!
@@ -124,6 +136,8 @@ if ! eval "$INSTALL_CMD -c $SINGULARITY_ROOTFS/$ZYPP_CONF --root $SINGULARITY_RO
     ABORT 255
 fi
 
+singularity_pkgcache_close
+
 if ! eval "rm -rf $SINGULARITY_ROOTFS/var/cache/zypp-bootstrap"; then
     message WARNING "Failed cleaning Bootstrap packages\n"
 fi
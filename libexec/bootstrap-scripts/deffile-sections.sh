@@ -94,7 +94,9 @@ ADD_LABEL=$SINGULARITY_libexecdir/singularity/python/helpers/json/add.py
 
 
 ### SETUP
-if [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "setup" ]; then
+if singularity_snapshot_covers "setup"; then
+    message 1 "Using build snapshot for setup section\n"
+elif [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "setup" ]; then
     if singularity_section_exists "setup" "$SINGULARITY_BUILDDEF"; then
         ARGS=`singularity_section_args "setup" "$SINGULARITY_BUILDDEF"`
         singularity_section_get "setup" "$SINGULARITY_BUILDDEF" | /bin/sh -e -x $ARGS || ABORT 255
@@ -104,13 +106,16 @@ if [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "s
         message ERROR "Could not locate /bin/sh inside the container\n"
         exit 255
     fi
+    singularity_snapshot_save "setup"
 else
     message 2 "Skipping setup section\n"
 fi
 
 
 ### FILES
-if [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "files" ]; then
+if singularity_snapshot_covers "files"; then
+    message 1 "Using build snapshot for files section\n"
+elif [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "files" ]; then
     if singularity_section_exists "files" "$SINGULARITY_BUILDDEF"; then
         message 1 "Adding files to container\n"
 
@@ -127,13 +132,16 @@ if [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "f
             fi
         done
     fi
+    singularity_snapshot_save "files"
 else
     message 2 "Skipping files section\n"
 fi
 
 
 ### ENVIRONMENT
-if [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "environment" ]; then
+if singularity_snapshot_covers "post"; then
+    message 1 "Using build snapshot for environment section\n"
+elif [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "environment" ]; then
     if singularity_section_exists "environment" "$SINGULARITY_BUILDDEF"; then
         message 1 "Adding environment to container\n"
 
@@ -145,13 +153,16 @@ fi
 
 
 ### RUN POST
-if [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "post" ]; then
+if singularity_snapshot_covers "post"; then
+    message 1 "Using build snapshot for post section\n"
+elif [ -z "${SINGULARITY_BUILDSECTION:-}" -o "${SINGULARITY_BUILDSECTION:-}" == "post" ]; then
     if singularity_section_exists "post" "$SINGULARITY_BUILDDEF"; then
         message 1 "Running post scriptlet\n"
         
         ARGS=`singularity_section_args "post" "$SINGULARITY_BUILDDEF"`
         singularity_section_get "post" "$SINGULARITY_BUILDDEF" | chroot "$SINGULARITY_ROOTFS" /bin/sh -e -x $ARGS || ABORT 255
     fi
+    singularity_snapshot_save "post"
 else
     message 2 "Skipping post section\n"
 fi
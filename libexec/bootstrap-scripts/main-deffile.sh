@@ -31,6 +31,12 @@ else
     echo "Error loading functions: $SINGULARITY_libexecdir/singularity/functions"
     exit 1
 fi
+if [ -f "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions" ]; then
+    . "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions"
+else
+    echo "Error loading functions: $SINGULARITY_libexecdir/singularity/bootstrap-scripts/functions"
+    exit 1
+fi
 
 if [ -z "${SINGULARITY_ROOTFS:-}" ]; then
     message ERROR "Singularity root file system not defined\n"
@@ -41,11 +47,21 @@ fi
 eval_abort "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/pre.sh"
 eval_abort "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/environment.sh"
 
+# Snapshots of the build stages are only used for new builds of the whole recipe
+if [ -n "${SINGULARITY_BUILDCACHE:-}" -a -z "${SINGULARITY_DISABLE_CACHE:-}" -a -z "${SINGULARITY_BUILDSECTION:-}" \
+     -a -z "${SINGULARITY_BUILDNOBASE:-}" -a -n "${BOOTSTRAP:-}" -a ! -f "${SINGULARITY_ROOTFS}/.coredone" ]; then
+    SINGULARITY_SNAPSHOT=1
+    export SINGULARITY_SNAPSHOT
+    singularity_snapshot_keys "$SINGULARITY_BUILDDEF"
+    singularity_snapshot_restore
+fi
+
 if [ -n "${BOOTSTRAP:-}" -a -z "${SINGULARITY_BUILDNOBASE:-}" ]; then
     if [ -x "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/deffile-driver-$BOOTSTRAP.sh" ]; then
         if [ ! -f "${SINGULARITY_ROOTFS}/.coredone" ]; then
             eval_abort "$SINGULARITY_libexecdir/singularity/bootstrap-scripts/deffile-driver-$BOOTSTRAP.sh"
             touch "${SINGULARITY_ROOTFS}/.coredone"
+            singularity_snapshot_save base
         fi
     else
         message ERROR "'Bootstrap' type not supported: $BOOTSTRAP\n"
@@ -7,54 +7,98 @@
 
 NAME=`echo "$SINGULARITY_IMAGE" | sed -e 's@^docker://@@'`
 
-if [ -z "${SINGULARITY_LOCALCACHEDIR:-}" ]; then
-    SINGULARITY_LOCALCACHEDIR="${TMPDIR:-/tmp}"
-fi
+# Converted images are cached as squashfs images named by the manifest
+# digest, so repeated runs of the same image skip the download and the
+# extraction
+SINGULARITY_RUNTIME_IMAGE=""
+if [ -z "${SINGULARITY_WRITABLE:-}" ] && singularity_which mksquashfs >/dev/null 2>&1; then
+    if ! SINGULARITY_CONTENTS=`mktemp ${TMPDIR:-/tmp}/.singularity-layerfile.XXXXXX`; then
+        message ERROR "Failed to create temporary file\n"
+        ABORT 255
+    fi
+    SINGULARITY_CONTAINER="$SINGULARITY_IMAGE"
+    export SINGULARITY_CONTAINER SINGULARITY_CONTENTS
 
-if ! SINGULARITY_TMPDIR=`mktemp -d $SINGULARITY_LOCALCACHEDIR/.singularity-runtime.XXXXXXXX`; then
-    message ERROR "Failed to create temporary directory\n"
-    ABORT 255
+    eval_abort "$SINGULARITY_libexecdir/singularity/python/runtime.py"
+    SINGULARITY_RUNTIME_IMAGE=`cat "$SINGULARITY_CONTENTS"`
+    rm -f "$SINGULARITY_CONTENTS"
 fi
 
-SINGULARITY_ROOTFS="$SINGULARITY_TMPDIR/$NAME"
-if ! mkdir -p "$SINGULARITY_ROOTFS"; then
-    message ERROR "Failed to create named SINGULARITY_ROOTFS=$SINGULARITY_ROOTFS\n"
-    ABORT 255
-fi
+if [ -n "$SINGULARITY_RUNTIME_IMAGE" -a -f "$SINGULARITY_RUNTIME_IMAGE" ]; then
+    message 2 "Using cached image: $SINGULARITY_RUNTIME_IMAGE\n"
+    SINGULARITY_CONTAINER="$SINGULARITY_IMAGE"
+    SINGULARITY_IMAGE="$SINGULARITY_RUNTIME_IMAGE"
+    export SINGULARITY_IMAGE SINGULARITY_CONTAINER
+else
+    if [ -z "${SINGULARITY_LOCALCACHEDIR:-}" ]; then
+        SINGULARITY_LOCALCACHEDIR="${TMPDIR:-/tmp}"
+    fi
 
-SINGULARITY_CONTAINER="$SINGULARITY_IMAGE"
-SINGULARITY_IMAGE="$SINGULARITY_ROOTFS"
-SINGULARITY_CLEANUPDIR="$SINGULARITY_TMPDIR"
-if ! SINGULARITY_CONTENTS=`mktemp ${TMPDIR:-/tmp}/.singularity-layers.XXXXXXXX`; then
-    message ERROR "Failed to create temporary directory\n"
-    ABORT 255
-fi
+    if ! SINGULARITY_TMPDIR=`mktemp -d $SINGULARITY_LOCALCACHEDIR/.singularity-runtime.XXXXXXXX`; then
+        message ERROR "Failed to create temporary directory\n"
+        ABORT 255
+    fi
 
-export SINGULARITY_ROOTFS SINGULARITY_IMAGE SINGULARITY_CONTAINER SINGULARITY_CONTENTS SINGULARITY_CLEANUPDIR
+    SINGULARITY_ROOTFS="$SINGULARITY_TMPDIR/$NAME"
+    if ! mkdir -p "$SINGULARITY_ROOTFS"; then
+        message ERROR "Failed to create named SINGULARITY_ROOTFS=$SINGULARITY_ROOTFS\n"
+        ABORT 255
+    fi
 
-eval_abort "$SINGULARITY_libexecdir/singularity/python/import.py"
+    SINGULARITY_CONTAINER="$SINGULARITY_IMAGE"
+    SINGULARITY_IMAGE="$SINGULARITY_ROOTFS"
+    SINGULARITY_CLEANUPDIR="$SINGULARITY_TMPDIR"
+    if ! SINGULARITY_CONTENTS=`mktemp ${TMPDIR:-/tmp}/.singularity-layers.XXXXXXXX`; then
+        message ERROR "Failed to create temporary directory\n"
+        ABORT 255
+    fi
 
-message 1 "Creating container runtime...\n"
-message 2 "Importing: base Singularity environment\n"
-zcat $SINGULARITY_libexecdir/singularity/bootstrap-scripts/environment.tar | (cd $SINGULARITY_ROOTFS; tar -xf -) || exit $?
+    export SINGULARITY_ROOTFS SINGULARITY_IMAGE SINGULARITY_CONTAINER SINGULARITY_CONTENTS SINGULARITY_CLEANUPDIR
 
-# Try to run docker-extract
-$SINGULARITY_libexecdir/singularity/bin/docker-extract >/dev/null 2>/dev/null
-# Code 127 if docker-extract is missing, or missing dynamic libs
-if [ $? -eq 127 ]; then
-    message WARNING "docker-extract failed, missing executable or libarchive\n"
-    message WARNING "Will use old layer extraction method - this does not handle whiteouts\n"
-    OLD_EXTRACTION="TRUE"
-fi
+    message 1 "Creating container runtime...\n"
+    message 2 "Importing: base Singularity environment\n"
+    zcat $SINGULARITY_libexecdir/singularity/bootstrap-scripts/environment.tar | (cd $SINGULARITY_ROOTFS; tar -xf -) || exit $?
+
+    # With SINGULARITY_STREAM_LAYERS this also extracts the layers
+    eval_abort "$SINGULARITY_libexecdir/singularity/python/import.py"
+
+    # Try to run docker-extract
+    $SINGULARITY_libexecdir/singularity/bin/docker-extract >/dev/null 2>/dev/null
+    # Code 127 if docker-extract is missing, or missing dynamic libs
+    if [ $? -eq 127 ]; then
+        message WARNING "docker-extract failed, missing executable or libarchive\n"
+        message WARNING "Will use old layer extraction method - this does not handle whiteouts\n"
+        OLD_EXTRACTION="TRUE"
+    fi
 
-for i in `cat "$SINGULARITY_CONTENTS"`; do
-    name=`basename "$i"`
-    message 1 "Exploding layer: $name\n"
     if [ ! -z "${OLD_EXTRACTION:-}" ]; then
-        zcat "$i" | (cd "$SINGULARITY_ROOTFS"; tar --exclude=dev/* -xf -) || exit $?
+        for i in `cat "$SINGULARITY_CONTENTS"`; do
+            name=`basename "$i"`
+            message 1 "Exploding layer: $name\n"
+            zcat "$i" | (cd "$SINGULARITY_ROOTFS"; tar --exclude=dev/* -xf -) || exit $?
+        done
     else
-        $SINGULARITY_libexecdir/singularity/bin/docker-extract "$i" || exit $?
+        # All layers in one call, so they are extracted concurrently
+        $SINGULARITY_libexecdir/singularity/bin/docker-extract `cat "$SINGULARITY_CONTENTS"` || exit $?
     fi
-done
 
-rm -f "$SINGULARITY_CONTENTS"
+    rm -f "$SINGULARITY_CONTENTS"
+
+    if [ -n "$SINGULARITY_RUNTIME_IMAGE" ]; then
+        if [ "`id -u`" != "0" ]; then
+            OPTS="-all-root"
+        else
+            OPTS=""
+        fi
+        message 1 "Caching container runtime image...\n"
+        if mksquashfs "$SINGULARITY_ROOTFS/" "$SINGULARITY_RUNTIME_IMAGE.$$" -noappend $OPTS >/dev/null && \
+           mv -f "$SINGULARITY_RUNTIME_IMAGE.$$" "$SINGULARITY_RUNTIME_IMAGE"; then
+            message 2 "Cached image: $SINGULARITY_RUNTIME_IMAGE\n"
+            SINGULARITY_IMAGE="$SINGULARITY_RUNTIME_IMAGE"
+            export SINGULARITY_IMAGE
+        else
+            message WARNING "Failed caching the container runtime image, running from $SINGULARITY_ROOTFS\n"
+            rm -f "$SINGULARITY_RUNTIME_IMAGE.$$"
+        fi
+    fi
+fi
@@ -10,6 +10,7 @@ from message import bot
 from defaults import SINGULARITY_WORKERS
 import multiprocessing
 import itertools
+import hashlib
 import tempfile
 import time
 import signal
@@ -195,13 +196,20 @@ class ApiConnection(object):
                data=None,
                headers=None,
                default_headers=True,
-               show_progress=False):
+               show_progress=False,
+               hasher=None,
+               tee=None):
 
         '''stream is a get that will stream to file_name
         :param data: a dictionary of key:value items
                      to add to the data args variable
         :param url: the url to get
         :param show_progress: if True, show a progress bar with the bot
+        :param hasher: if given, a hashlib object updated with the content
+        :param tee: if given, an open file the content is also written to
+                    as it arrives. If file_name is None, it is only written
+                    to tee. Errors writing to tee stop writing to it, but
+                    not the download, and None is returned
         :returns response: the requests response object, or stream
         '''
         bot.debug("GET (stream) %s" % (url))
@@ -230,11 +238,30 @@ class ApiConnection(object):
                 bot.show_progress(progress, content_size, length=35)
 
         chunk_size = 1 << 20
-        with open(file_name, 'wb') as filey:
+        filey = None
+        if file_name is not None:
+            filey = open(file_name, 'wb')
+        tee_failed = False
+
+        try:
             while True:
                 chunk = response.read(chunk_size)
                 if not chunk:
                     break
+                if hasher is not None:
+                    hasher.update(chunk)
+                if tee is not None:
+                    try:
+                        tee.write(chunk)
+                    except (IOError, OSError) as error:
+                        bot.error("Error writing %s to %s: %s"
+                                  % (url, tee.name, error))
+                        tee = None
+                        tee_failed = True
+                        if filey is None:
+                            break
+                if filey is None:
+                    continue
                 try:
                     filey.write(chunk)
                     if show_progress:
@@ -254,6 +281,14 @@ class ApiConnection(object):
             if show_progress:
                 sys.stdout.write('\n')
 
+        finally:
+            if filey is not None:
+                filey.close()
+
+        if tee_failed:
+            return None
+        if file_name is None:
+            return tee.name
         return file_name
 
     def get(self,
@@ -353,7 +388,9 @@ class ApiConnection(object):
                             url,
                             file_name,
                             headers=None,
-                            show_progress=False):
+                            show_progress=False,
+                            digest=None,
+                            tee=None):
 
         '''download stream atomically will stream to a temporary file, and
         rename only upon successful completion. This is to ensure that
@@ -361,14 +398,40 @@ class ApiConnection(object):
         :param file_name: the file name to stream to
         :param url: the url to stream from
         :param headers: additional headers to add to the get (default None)
+        :param digest: expected "algorithm:hex" digest of the content. It is
+                       computed while streaming, and on a mismatch the file
+                       is removed and None returned (default None)
+        :param tee: an open file the content is also written to while it
+                    downloads, see stream (default None)
         '''
+        hasher = None
+        if digest is not None:
+            algorithm, _, expected = digest.partition(':')
+            try:
+                hasher = hashlib.new(algorithm)
+            except ValueError:
+                bot.warning("Unknown hash function %s for %s - will not "
+                            "checksum" % (algorithm, url))
+
         try:
             tmp_file = "%s.%s" % (file_name,
                                   next(tempfile._get_candidate_names()))
             response = self.stream(url,
                                    file_name=tmp_file,
                                    headers=headers,
-                                   show_progress=show_progress)
+                                   show_progress=show_progress,
+                                   hasher=hasher,
+                                   tee=tee)
+
+            if hasher is not None:
+                computed = hasher.hexdigest()
+                bot.debug("Computed checksum %s, expected checksum %s"
+                          % (computed, expected))
+                if computed != expected:
+                    bot.error("Download of %s does not match checksum" % url)
+                    os.remove(tmp_file)
+                    return None
+
             os.rename(tmp_file, file_name)
 
         except Exception:
@@ -148,6 +148,12 @@ LABELFILE = getenv("SINGULARITY_LABELFILE", _labelfile)
 INCLUDE_CMD = convert2boolean(getenv("SINGULARITY_INCLUDECMD", False))
 DISABLE_HTTPS = convert2boolean(getenv("SINGULARITY_NOHTTPS", False))
 
+# Extract layers with docker-extract while they download (the layer file then
+# only lists the metadata tar)
+STREAM_LAYERS = convert2boolean(getenv("SINGULARITY_STREAM_LAYERS", False))
+_libexecdir = getenv("SINGULARITY_libexecdir", "")
+DOCKER_EXTRACT = "%s/singularity/bin/docker-extract" % (_libexecdir)
+
 #######################################################################
 # Singularity Hub
 #######################################################################
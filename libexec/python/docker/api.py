@@ -58,6 +58,7 @@ from message import bot
 from shell import parse_image_uri
 from templates import get_template
 
+import hashlib
 import json
 import re
 import tempfile
@@ -82,6 +83,7 @@ class DockerApiConnection(ApiConnection):
         self.api_version = DOCKER_API_VERSION
         self.manifest = None
         self.manifestv1 = None
+        self.manifest_digest = None
 
         if 'auth' in kwargs:
             self.auth = kwargs['auth']
@@ -358,6 +360,11 @@ class DockerApiConnection(ApiConnection):
 
         response = self.get(base, headers=headers)
 
+        # Registries address a manifest by the sha256 of its body
+        if old_version is False:
+            digest = hashlib.sha256(response.encode('utf-8')).hexdigest()
+            self.manifest_digest = "sha256:%s" % digest
+
         try:
             response = json.loads(response)
 
@@ -417,11 +424,28 @@ class DockerApiConnection(ApiConnection):
         if "manifests" in self.manifest:
             self.manifest = self.manifestv1
 
+    def get_layer_url(self, image_id):
+        '''get_layer_url returns the url of the blob of layer image_id
+        '''
+        registry = self.registry
+        if registry is None:
+            registry = self.api_base
+
+        # make sure we have a complete url
+        registry = add_http(registry)
+
+        # The <name> variable is repo_name
+        return "%s/%s/%s/blobs/%s" % (registry,
+                                      self.api_version,
+                                      self.repo_name,
+                                      image_id)
+
     def get_layer(self,
                   image_id,
                   download_folder=None,
                   change_perms=False,
-                  return_tmp=False):
+                  return_tmp=False,
+                  tee=None):
 
         '''get_layer will download an image layer (.tar.gz)
         to a specified download folder.
@@ -433,19 +457,10 @@ class DockerApiConnection(ApiConnection):
                              don't rename to the file's final name). Default
                              is False, should be True for multiprocessing
                              that requires extra permission changes
+        :param tee: an open file (e.g. a pipe to docker-extract) the layer
+                    is also written to while it downloads (default None)
         '''
-        registry = self.registry
-        if registry is None:
-            registry = self.api_base
-
-        # make sure we have a complete url
-        registry = add_http(registry)
-
-        # The <name> variable is repo_name
-        base = "%s/%s/%s/blobs/%s" % (registry,
-                                      self.api_version,
-                                      self.repo_name,
-                                      image_id)
+        base = self.get_layer_url(image_id)
         bot.verbose("Downloading layers from %s" % base)
 
         if download_folder is None:
@@ -460,7 +475,11 @@ class DockerApiConnection(ApiConnection):
         file_name = "%s.%s" % (download_folder,
                                next(tempfile._get_candidate_names()))
         tar_download = self.download_atomically(url=base,
-                                                file_name=file_name)
+                                                file_name=file_name,
+                                                digest=image_id,
+                                                tee=tee)
+        if tar_download is None:
+            return None
         bot.debug('Download of raw file (pre permissions fix) is %s'
                   % tar_download)
 
@@ -480,6 +499,31 @@ class DockerApiConnection(ApiConnection):
             sys.exit(1)
         return download_folder
 
+    def stream_layer(self, image_id, output):
+        '''stream_layer writes layer image_id to the open file output
+        (e.g. a pipe to docker-extract) without keeping a copy. Returns
+        True if the layer was written and its checksum matched.
+        '''
+        base = self.get_layer_url(image_id)
+        bot.verbose("Streaming layer from %s" % base)
+
+        hasher = None
+        algorithm, _, expected = image_id.partition(':')
+        try:
+            hasher = hashlib.new(algorithm)
+        except ValueError:
+            bot.warning("Unknown hash function %s for %s - will not "
+                        "checksum" % (algorithm, base))
+
+        if self.stream(base, file_name=None, tee=output,
+                       hasher=hasher) is None:
+            return False
+
+        if hasher is not None and hasher.hexdigest() != expected:
+            bot.error("Download of %s does not match checksum" % base)
+            return False
+        return True
+
     def get_size(self, add_padding=True, round_up=True, return_mb=True):
         '''get_size will return the image size (must use v.2.0 manifest)
         :add_padding: if true, return reported size * 5
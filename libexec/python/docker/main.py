@@ -25,12 +25,13 @@ import os
 import sys
 
 from defaults import (
+    DISABLE_CACHE,
     INCLUDE_CMD,
-    PLUGIN_FIXPERMS
+    PLUGIN_FIXPERMS,
+    RUNSCRIPT_COMMAND_ASIS,
+    STREAM_LAYERS
 )
 
-from base import MultiProcess
-
 from sutils import (
     get_cache,
     write_file
@@ -41,8 +42,9 @@ from .api import (
 )
 
 from .tasks import (
-    download_layer,
-    change_permissions,
+    can_stream_layers,
+    download_layers,
+    stream_layers,
     extract_runscript,
     extract_metadata_tar
 )
@@ -64,6 +66,40 @@ def SIZE(image, auth=None, contentfile=None):
     return size
 
 
+def RUNTIME(image, auth=None, contentfile=None):
+    '''RUNTIME is intended to be run before running a docker:// image, to
+    return to the contentfile the path in the cache of the squashfs image
+    the docker image is converted to. The path is named by the manifest
+    digest, so it only exists if this exact image was converted before.
+    Nothing is written if the cache is disabled.
+    '''
+    if DISABLE_CACHE:
+        bot.debug("Cache disabled, not looking up a cached runtime image")
+        return None
+
+    bot.debug("Starting Docker RUNTIME, will get digest from manifest")
+    bot.verbose("Docker image: %s" % image)
+    client = DockerApiConnection(image=image, auth=auth)
+    client.update_manifests()
+
+    # The runscript and file permissions depend on these too
+    name = client.manifest_digest.split(':')[-1]
+    if INCLUDE_CMD:
+        name = "%s-cmd" % name
+    if RUNSCRIPT_COMMAND_ASIS:
+        name = "%s-asis" % name
+    if PLUGIN_FIXPERMS:
+        name = "%s-fixperms" % name
+
+    cache_base = get_cache(subfolder="runtime", quiet=True)
+    runtime_image = "%s/%s.simg" % (cache_base, name)
+    bot.verbose2("Runtime image for %s: %s" % (image, runtime_image))
+
+    if contentfile is not None:
+        write_file(contentfile, runtime_image, mode="w")
+    return runtime_image
+
+
 def IMPORT(image, auth=None, layerfile=None):
     '''IMPORT is the main script that will obtain docker layers,
     runscript information (either entrypoint or cmd), and environment
@@ -97,40 +133,14 @@ def IMPORT(image, auth=None, layerfile=None):
 
     # Get the cache (or temporary one) for docker
     cache_base = get_cache(subfolder="docker")
-    download_client = MultiProcess()
-
-    # Generate a queue of tasks to run with MultiProcess
-    layers = []
-    tasks = []
-    for ii in range(len(images)):
-        image_id = images[ii]
-        targz = "%s/%s.tar.gz" % (cache_base, image_id)
-        if not os.path.exists(targz):
-            tasks.append((client, image_id, cache_base))
-        layers.append(targz)
-
-    # Does the user want to change permissions of tar?
-    func2 = None
-    if PLUGIN_FIXPERMS:
-        func2 = change_permissions
 
-    if len(tasks) > 0:
-        download_layers = download_client.run(func=download_layer,
-                                              func2=func2,
-                                              tasks=tasks)
-
-        # We should receive valid filenames back, and files exist
-        # If a checksum failed for a layer we get None for that layer
-        for layer in download_layers:
-
-            if layer is None:
-                bot.abort("Error during layer download - one or more layers failed to download correctly.")  # noqa
-                sys.exit(1)
-
-            if not os.path.exists(layer):
-                bot.abort("A downloaded layer file could not be found: %s"
-                          % layer)
-                sys.exit(1)
+    # Extract the layers while they download? Then only the metadata tar
+    # is left for the calling function to extract
+    streamed = STREAM_LAYERS and can_stream_layers()
+    if streamed:
+        layers = stream_layers(client, images, cache_base)
+    else:
+        layers = download_layers(client, images, cache_base)
 
     # Get Docker runscript
     runscript = extract_runscript(manifest=client.manifestv1,
@@ -146,7 +156,8 @@ def IMPORT(image, auth=None, layerfile=None):
     # Write all layers to the layerfile
     if layerfile is not None:
         bot.verbose3("Writing Docker layers files to %s" % layerfile)
-        write_file(layerfile, "\n".join(layers), mode="w")
+        write_file(layerfile, "\n".join([] if streamed else layers),
+                   mode="w")
         if tar_file is not None:
             write_file(layerfile, "\n%s" % tar_file, mode="a")
 
@@ -17,105 +17,263 @@ from sutils import (
     add_http,
     get_cache,
     create_tar,
-    change_tar_permissions,
     print_json,
     write_singularity_infos
 )
 
 from defaults import (
+    DISABLE_CACHE,
+    DOCKER_EXTRACT,
     DOCKER_NUMBER,
     DOCKER_PREFIX,
     ENV_BASE,
     LABELFILE,
-    PLUGIN_FIXPERMS,
     METADATA_FOLDER_NAME,
-    RUNSCRIPT_COMMAND_ASIS
+    RUNSCRIPT_COMMAND_ASIS,
+    SINGULARITY_ROOTFS
 )
 
+from base import MultiProcess
 from helpers.json.main import ADD
 from message import bot
 from templates import get_template
 
-import hashlib
+import fcntl
 import json
 import os
 import re
+import shutil
+import subprocess
+import tempfile
+import threading
+import time
 
 
-def download_layer(client, image_id, cache_base):
+def download_layer(client, image_id, cache_base, pipe=None):
     '''download_layer is a function (external to the client)
     to download a layer and update the client's token after.
     This is intended to be used by the multiprocessing function.
-    If return_tmp is True, the temporary file is returned
-    (intended to be renamed later)'''
-
-    # Token will only really be updated if within 5s of expiry
-    client.update_token()
-    targz = client.get_layer(image_id=image_id,
-                             download_folder=cache_base,  # return tmp when
-                             return_tmp=PLUGIN_FIXPERMS)  # fix permissions
-    if verify_layer(targz):
-        return targz
-    else:
-        os.remove(targz)
-        return None
-
-
-def verify_layer(targz):
-    '''check that a downloaded layer's sha256 checksum is OK
-       correct checksum is in the filename:
-           sha256:7d460157dea423c1e16c544fecad995439e12dd50c8db4a8e134fa245cd1846e.tar.gz
+    Processes sharing a cache download each layer once: the first holds
+    the layer's lock file while it downloads, verifies and renames the
+    layer into place, the others wait for the lock and then use that file.
+    The layer is kept as served, SINGULARITY_FIX_PERMS is applied by
+    docker-extract. If pipe is given (a named pipe docker-extract reads
+    the layer from) the layer is also written to it as it downloads, and
+    only there if the cache is disabled.'''
+
+    if pipe is None:
+        return fetch_layer(client, image_id, cache_base)
+
+    # Opened first, so the reader sees the end of the layer however we fail
+    with open(pipe, 'wb') as output:
+        targz = fetch_layer(client, image_id, cache_base, output)
+    return targz
+
+
+def fetch_layer(client, image_id, cache_base, output=None):
+    '''fetch_layer does the work of download_layer, writing the layer
+    to the open file output too if given'''
+
+    targz = "%s/%s.tar.gz" % (cache_base, image_id)
+    lock_file = "%s/%s.lock" % (cache_base, image_id)
+    waited = 0
+
+    with open(lock_file, 'a') as lock:
+        try:
+            fcntl.flock(lock, fcntl.LOCK_EX | fcntl.LOCK_NB)
+        except (IOError, OSError):
+            bot.verbose("Waiting for layer %s downloaded by another process"
+                        % image_id)
+            start = time.time()
+            fcntl.flock(lock, fcntl.LOCK_EX)
+            waited = time.time() - start
+
+        if os.path.exists(targz):
+            record_layer_stats(cache_base, "wait" if waited else "hit", waited)
+            if output is not None:
+                try:
+                    with open(targz, 'rb') as filey:
+                        shutil.copyfileobj(filey, output, 1 << 20)
+                except (IOError, OSError) as e:
+                    bot.error("Error writing %s to %s: %s"
+                              % (targz, output.name, e))
+                    return None
+            return targz
+
+        # Token will only really be updated if within 5s of expiry
+        client.update_token()
+
+        # Nothing to keep, only feed the extractor
+        if output is not None and DISABLE_CACHE:
+            if not client.stream_layer(image_id, output):
+                return None
+            record_layer_stats(cache_base, "miss", waited)
+            return output.name
+
+        tmp_targz = client.get_layer(image_id=image_id,
+                                     download_folder=cache_base,
+                                     return_tmp=True,
+                                     tee=output)
+        # The checksum is verified while downloading
+        if tmp_targz is None:
+            return None
+
+        os.rename(tmp_targz, targz)
+        record_layer_stats(cache_base, "miss", waited)
+
+    return targz
+
+
+def download_layers(client, images, cache_base):
+    '''download_layers downloads the layers of images missing from the
+    cache with MultiProcess. Returns the list of layers in the cache, exits
+    if one failed to download.
     '''
-
-    targz_basename = os.path.basename(targz)
-
-    bot.debug("Verifying checksum for layer: %s" % targz_basename)
-
-    if targz_basename[:6] != 'sha256':
-        bot.warning("Unknown hash function for layer (%s) - will not checksum"
-                    % targz_basename[:5])
-        return True
-
-    expected = targz_basename[7:71]
-
-    sha256 = hashlib.sha256()
-
-    try:
-        with open(targz, 'rb') as f:
-            for block in iter(lambda: f.read(1048576), b''):
-                sha256.update(block)
-    except Exception as e:
-        bot.error("Error computing checksum for layer (%s) - %s"
-                  % (targz_basename, str(e)))
+    layers = []
+    tasks = []
+    for image_id in images:
+        targz = "%s/%s.tar.gz" % (cache_base, image_id)
+        if not os.path.exists(targz):
+            tasks.append((client, image_id, cache_base))
+        else:
+            record_layer_stats(cache_base, "hit")
+        layers.append(targz)
+
+    # Layers are downloaded once per cache, other processes importing the
+    # same image wait for them
+    if len(tasks) > 0:
+        downloaded = MultiProcess().run(func=download_layer, tasks=tasks)
+
+        # We should receive valid filenames back, and files exist
+        # If a checksum failed for a layer we get None for that layer
+        for layer in downloaded:
+
+            if layer is None:
+                bot.abort("Error during layer download - one or more layers failed to download correctly.")  # noqa
+                sys.exit(1)
+
+            if not os.path.exists(layer):
+                bot.abort("A downloaded layer file could not be found: %s"
+                          % layer)
+                sys.exit(1)
+
+    return layers
+
+
+def can_stream_layers():
+    '''can_stream_layers returns True if layers can be extracted with
+    stream_layers, which needs docker-extract and SINGULARITY_ROOTFS'''
+    if SINGULARITY_ROOTFS is None or not os.path.isdir(SINGULARITY_ROOTFS):
+        bot.verbose("SINGULARITY_ROOTFS is not set, not streaming layers")
         return False
-
-    computed = sha256.hexdigest()
-
-    bot.debug("Computed checksum %s, expected checksum %s"
-              % (computed, expected))
-
-    if computed != expected:
-        bot.error("Downloaded layer %s does not match checksum"
-                  % targz_basename)
+    if not os.access(DOCKER_EXTRACT, os.X_OK):
+        bot.verbose("%s not found, not streaming layers" % DOCKER_EXTRACT)
         return False
-
     return True
 
 
-def change_permissions(tar_file, file_permission=None, folder_permission=None):
-    '''change_permissions is a wrapper for change_tar_permissions,
-    intended for use as a function for multiprocessing. To ensure atomic
-    download and permission changes, the input file here is expected
-    to have a temporary extension. This wrapper simply calls the function
-    to change_tar_permissions, and then renames to the final file
+def stream_layers(client, images, cache_base):
+    '''stream_layers downloads the layers of images and extracts them into
+    SINGULARITY_ROOTFS as they arrive. docker-extract is given the layers
+    in order, reading those already cached from the cache and the others
+    from named pipes the download processes write to. All layers are
+    extracted at once and applied in order, so network and CPU are busy
+    at the same time. Returns the list of layers in the cache, exits if
+    a download or the extraction failed.
     '''
-    fixed_tar = change_tar_permissions(tar_file,
-                                       file_permission=file_permission,
-                                       folder_permission=folder_permission)
+    pipe_dir = tempfile.mkdtemp(prefix=".singularity-stream.")
+    layers = []
+    sources = []
+    pipes = []
+    tasks = []
+    for image_id in images:
+        targz = "%s/%s.tar.gz" % (cache_base, image_id)
+        layers.append(targz)
+        if os.path.exists(targz):
+            record_layer_stats(cache_base, "hit")
+            sources.append(targz)
+            continue
+        pipe = "%s/%s.tar.gz" % (pipe_dir, image_id)
+        os.mkfifo(pipe, 0o600)
+        sources.append(pipe)
+        pipes.append(pipe)
+        tasks.append((client, image_id, cache_base, pipe))
+
+    bot.verbose("Extracting %s layers while downloading %s"
+                % (len(sources), len(tasks)))
+    extractor = subprocess.Popen([DOCKER_EXTRACT] + sources)
+    watcher = threading.Thread(target=release_pipes,
+                               args=(extractor, pipes))
+    watcher.daemon = True
+    watcher.start()
+
+    downloaded = []
+    if len(tasks) > 0:
+        downloaded = MultiProcess().run(func=download_layer, tasks=tasks)
+
+    # A pipe nobody wrote to would keep its reader waiting, give it an end
+    for pipe in pipes:
+        try:
+            os.close(os.open(pipe, os.O_WRONLY | os.O_NONBLOCK))
+        except OSError:
+            pass
+
+    watcher.join()
+    shutil.rmtree(pipe_dir, ignore_errors=True)
+
+    if len(downloaded) != len(tasks) or None in downloaded:
+        bot.abort("Error during layer download - one or more layers failed to download correctly.")  # noqa
+        sys.exit(1)
+
+    if extractor.returncode != 0:
+        bot.abort("Error extracting the layers")
+        sys.exit(1)
+
+    return layers
+
+
+def release_pipes(extractor, pipes):
+    '''release_pipes waits for the docker-extract process extractor. If it
+    failed, download processes blocked opening one of the pipes are woken
+    up (their writes then fail) and the pipes removed so later opens do
+    not block.'''
+    if extractor.wait() == 0:
+        return
+
+    for pipe in pipes:
+        try:
+            fd = os.open(pipe, os.O_RDONLY | os.O_NONBLOCK)
+            os.unlink(pipe)
+            os.close(fd)
+        except OSError:
+            pass
+
+
+def record_layer_stats(cache_base, status, waited=0):
+    '''record_layer_stats counts layers found in the cache ("hit"),
+    downloaded ("miss") and downloaded by another process while this one
+    waited ("wait") in stats.json in the cache, along with the total
+    seconds spent waiting for other processes.'''
+
+    bot.verbose2("Layer cache %s, waited %.2f seconds" % (status, waited))
+    stats_file = "%s/stats.json" % cache_base
 
-    final_tar = "%s.tar.gz" % fixed_tar.split('.tar.gz')[0]
-    os.rename(fixed_tar, final_tar)
-    return final_tar
+    try:
+        with open(stats_file, 'a+') as filey:
+            fcntl.flock(filey, fcntl.LOCK_EX)
+            filey.seek(0)
+            try:
+                stats = json.loads(filey.read())
+            except ValueError:
+                stats = dict()
+            stats[status] = stats.get(status, 0) + 1
+            waited += stats.get("wait_seconds", 0)
+            stats["wait_seconds"] = round(waited, 3)
+            filey.seek(0)
+            filey.truncate()
+            filey.write(json.dumps(stats))
+    except (IOError, OSError) as e:
+        bot.debug("Cannot update layer cache stats %s: %s" % (stats_file, e))
 
 
 def extract_runscript(manifest, includecmd=False):
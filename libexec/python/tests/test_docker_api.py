@@ -123,6 +123,15 @@ class TestApi(TestCase):
         print("Case 3: Bad tag should print valid tags and exit")
         client = DockerApiConnection(image="ubuntu:mmm.avocado")
 
+    def test_get_manifest_digest(self):
+        '''test_get_manifest_digest will check that the digest of the
+        primary manifest is recorded
+        '''
+        print("Case 1: Digest is recorded for the primary manifest")
+        self.client.get_manifest()
+        self.assertTrue(self.client.manifest_digest.startswith("sha256:"))
+        self.assertEqual(len(self.client.manifest_digest), 71)
+
     def test_get_images(self):
         '''test_get_images will obtain a list of images
         '''
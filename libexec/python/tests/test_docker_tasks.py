@@ -14,6 +14,7 @@ sys.path.append('..')  # noqa
 from unittest import TestCase
 import shutil
 import tempfile
+from docker.api import DockerApiConnection
 
 VERSION = sys.version_info[0]
 
@@ -100,6 +101,122 @@ class TestApi(TestCase):
                                 spec="Cmd")
         self.assertTrue('/bin/bash' in entrypoint)
 
+    def test_download_layer_once(self):
+        '''test_download_layer_once checks that processes sharing a cache
+        download a layer once and the others reuse it
+        '''
+        import hashlib
+        import json
+        import multiprocessing
+
+        print("Case 1: Concurrent downloads of one layer")
+        data = b"layer"
+        image_id = "sha256:%s" % hashlib.sha256(data).hexdigest()
+        cache = "%s/cache" % self.tmpdir
+        os.mkdir(cache)
+        pool = multiprocessing.Pool(4)
+        layers = pool.map(_download_fake_layer, [(image_id, cache, data)] * 4)
+        pool.close()
+        pool.join()
+
+        targz = "%s/%s.tar.gz" % (cache, image_id)
+        self.assertEqual(set(layers), set([targz]))
+        with open("%s/stats.json" % cache) as filey:
+            stats = json.loads(filey.read())
+        self.assertEqual(stats.get("miss"), 1)
+        self.assertEqual(stats.get("wait", 0) + stats.get("hit", 0), 3)
+
+    def test_stream_layers(self):
+        '''test_stream_layers checks that layers served over http are
+        extracted while they download, in order, and kept in the cache
+        '''
+        import hashlib
+        import tarfile
+        import threading
+        from docker.tasks import stream_layers
+        try:
+            from http.server import HTTPServer, SimpleHTTPRequestHandler
+        except ImportError:
+            from BaseHTTPServer import HTTPServer
+            from SimpleHTTPServer import SimpleHTTPRequestHandler
+        from defaults import DOCKER_EXTRACT
+        if not os.access(DOCKER_EXTRACT, os.X_OK):
+            print("Skipping, %s not found" % DOCKER_EXTRACT)
+            return
+
+        print("Case 1: Layers are extracted in order while downloading")
+        serve = "%s/serve" % self.tmpdir
+        cache = "%s/cache" % self.tmpdir
+        os.mkdir(serve)
+        os.mkdir(cache)
+        images = []
+        for content in [b"lower", b"upper"]:
+            src = "%s/file" % serve
+            with open(src, 'wb') as filey:
+                filey.write(content)
+            layer = "%s/layer.tar.gz" % self.tmpdir
+            with tarfile.open(layer, "w:gz") as tar:
+                tar.add(src, arcname="file")
+            with open(layer, 'rb') as filey:
+                digest = hashlib.sha256(filey.read()).hexdigest()
+            os.remove(src)
+            os.rename(layer, "%s/sha256:%s" % (serve, digest))
+            images.append("sha256:%s" % digest)
+
+        here = os.getcwd()
+        os.chdir(serve)
+        server = HTTPServer(("127.0.0.1", 0), SimpleHTTPRequestHandler)
+        thread = threading.Thread(target=server.serve_forever)
+        thread.daemon = True
+        thread.start()
+        base = "http://127.0.0.1:%s" % server.server_address[1]
+
+        layers = stream_layers(_LocalLayerClient(base), images, cache)
+        server.shutdown()
+        server.server_close()
+        os.chdir(here)
+        with open("%s/file" % self.tmpdir, 'rb') as filey:
+            self.assertEqual(filey.read(), b"upper")
+        for layer in layers:
+            self.assertTrue(os.path.exists(layer))
+
+
+class _LocalLayerClient(DockerApiConnection):
+
+    def __init__(self, base):
+        self.base = base
+        super(_LocalLayerClient, self).__init__()
+
+    def update_token(self, response=None):
+        pass
+
+    def get_layer_url(self, image_id):
+        return "%s/%s" % (self.base, image_id)
+
+
+class _FakeLayerClient(object):
+
+    def __init__(self, data):
+        self.data = data
+
+    def update_token(self):
+        pass
+
+    def get_layer(self, image_id, download_folder, return_tmp, tee=None):
+        import time
+        time.sleep(0.5)
+        tmp_targz = "%s/%s.tar.gz.%s" % (download_folder, image_id,
+                                         os.getpid())
+        with open(tmp_targz, 'wb') as filey:
+            filey.write(self.data)
+        return tmp_targz
+
+
+def _download_fake_layer(args):
+    from docker.tasks import download_layer
+    image_id, cache, data = args
+    return download_layer(_FakeLayerClient(data), image_id, cache)
+
 
 if __name__ == '__main__':
     unittest.main()
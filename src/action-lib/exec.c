@@ -44,6 +44,7 @@ void action_exec(int argc, char **argv) {
     singularity_message(DEBUG, "Checking for: /.singularity.d/actions/exec\n");
     if ( is_exec("/.singularity.d/actions/exec") == 0 ) {
         singularity_message(VERBOSE, "Exec'ing /.singularity.d/actions/exec\n");
+        singularity_message_flush();
         if ( execv("/.singularity.d/actions/exec", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /.singularity.d/actions/exec: %s\n", strerror(errno));
         }
@@ -52,12 +53,14 @@ void action_exec(int argc, char **argv) {
     singularity_message(DEBUG, "Checking for: /.exec\n");
     if ( is_exec("/.exec") == 0 ) {
         singularity_message(VERBOSE, "Exec'ing /.exec\n");
+        singularity_message_flush();
         if ( execv("/.exec", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /.exec: %s\n", strerror(errno));
         }
     }
 
     singularity_message(WARNING, "Container does not have an exec helper script, calling '%s' directly\n", argv[1]);
+    singularity_message_flush();
     if ( execvp(argv[1], &argv[1]) < 0 ) { // Flawfinder: ignore
         singularity_message(ERROR, "Failed to execvp() %s: %s\n", argv[1], strerror(errno));
         ABORT(255);
@@ -39,16 +39,19 @@ void action_run(int argc, char **argv) {
 
     if ( is_exec("/.singularity.d/actions/run") == 0 ) {
         singularity_message(DEBUG, "Exec'ing /.singularity.d/actions/run\n");
+        singularity_message_flush();
         if ( execv("/.singularity.d/actions/run", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /.singularity.d/actions/run: %s\n", strerror(errno));
             ABORT(255);
         }
     } else if ( is_exec("/.run") == 0 ) {
+        singularity_message_flush();
         if ( execv("/.run", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /.run, continuing to /bin/sh: %s\n", strerror(errno));
         }
     } else if ( is_exec("/singularity") == 0 ) {
         singularity_message(DEBUG, "Exec'ing /singularity\n");
+        singularity_message_flush();
         if ( execv("/singularity", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /singularity: %s\n", strerror(errno));
             ABORT(255);
@@ -41,11 +41,13 @@ void action_shell(int argc, char **argv) {
 
     if ( is_exec("/.singularity.d/actions/shell") == 0 ) {
         singularity_message(DEBUG, "Exec'ing /.singularity.d/actions/shell\n");
+        singularity_message_flush();
         if ( execv("/.singularity.d/actions/shell", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /.singularity.d/actions/shell, continuing to /bin/sh: %s\n", strerror(errno));
         }
     } else if ( is_exec("/.shell") == 0 ) {
         singularity_message(DEBUG, "Exec'ing /.shell\n");
+        singularity_message_flush();
         if ( execv("/.shell", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /.shell, continuing to /bin/sh: %s\n", strerror(errno));
         }
@@ -55,6 +57,7 @@ void action_shell(int argc, char **argv) {
     if ( is_exec("/bin/sh") == 0 ) {
         singularity_message(DEBUG, "Exec'ing /bin/sh\n");
         argv[0] = strdup("/bin/sh");
+        singularity_message_flush();
         if ( execv("/bin/sh", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /bin/sh: %s\n", strerror(errno));
             ABORT(255);
@@ -39,11 +39,13 @@ void action_test(int argc, char **argv) {
 
     if ( is_exec("/.singularity.d/actions/test") == 0 ) {
         singularity_message(DEBUG, "Exec'ing /.singularity.d/actions/test\n");
+        singularity_message_flush();
         if ( execv("/.singularity.d/actions/test", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /.singularity.d/actions/test: %s\n", strerror(errno));
             ABORT(255);
         }
     } else if ( is_exec("/.test") == 0 ) {
+        singularity_message_flush();
         if ( execv("/.test", argv) < 0 ) { // Flawfinder: ignore
             singularity_message(ERROR, "Failed to execv() /.test, continuing to /bin/sh: %s\n", strerror(errno));
         }
@@ -42,6 +42,7 @@
 #include "util/suid.h"
 #include "util/sessiondir.h"
 #include "util/cleanupd.h"
+#include "util/trace.h"
 
 #include "./action-lib/include.h"
 
@@ -53,25 +54,32 @@
 int main(int argc, char **argv) {
     struct image_object image;
     char *pwd = get_current_dir_name();
-    char *target_pwd = NULL;
-    char *command = NULL;
+    const char *target_pwd = NULL;
+    const char *command = NULL;
 
     fd_cleanup();
 
+    singularity_trace_init("config");
     singularity_config_init(joinpath(SYSCONFDIR, "/singularity/singularity.conf"));
 
+    singularity_trace_stage("priv");
     singularity_priv_init();
     singularity_suid_init(argv);
 
+    singularity_trace_stage("registry");
     singularity_registry_init();
     
+    singularity_trace_stage("userns");
     singularity_priv_userns();
     singularity_priv_drop();
 
+    singularity_trace_stage("autofs");
     singularity_runtime_autofs();
 
+    singularity_trace_stage("daemon");
     singularity_daemon_init();
 
+    singularity_trace_stage("image_init");
     if ( singularity_registry_get("WRITABLE") != NULL ) {
         singularity_message(VERBOSE3, "Instantiating writable container image object\n");
         image = singularity_image_init(singularity_registry_get("IMAGE"), O_RDWR);
@@ -81,29 +89,41 @@ int main(int argc, char **argv) {
     }
 
     if ( singularity_registry_get("DAEMON_JOIN") == NULL ) {
+        singularity_trace_stage("cleanupd");
         singularity_cleanupd();
 
+        singularity_trace_stage("ns");
         singularity_runtime_ns(SR_NS_ALL);
 
+        singularity_trace_stage("sessiondir");
         singularity_sessiondir();
 
+        singularity_trace_stage("image_mount");
         singularity_image_mount(&image, CONTAINER_MOUNTDIR);
 
         action_ready();
 
+        singularity_trace_stage("overlayfs");
         singularity_runtime_overlayfs();
+        singularity_trace_stage("mounts");
         singularity_runtime_mounts();
+        singularity_trace_stage("files");
         singularity_runtime_files();
     } else {
+        singularity_trace_stage("ns");
         singularity_runtime_ns(SR_NS_ALL);
     }
 
+    singularity_trace_stage("enter");
     singularity_runtime_enter();
     
+    singularity_trace_stage("environment");
     singularity_runtime_environment();
     
     singularity_priv_drop_perm();
 
+    singularity_trace_finish();
+
     if ( ( target_pwd = singularity_registry_get("TARGET_PWD") ) != NULL ) {
         singularity_message(DEBUG, "Attempting to chdir to TARGET_PWD: %s\n", target_pwd);
         if ( chdir(target_pwd) != 0 ) {
@@ -136,8 +156,6 @@ int main(int argc, char **argv) {
         ABORT(255);
     }
 
-    free(target_pwd);
-
     command = singularity_registry_get("COMMAND");
 
     envar_set("SINGULARITY_CONTAINER", singularity_image_name(&image), 1); // Legacy PS1 support
@@ -25,7 +25,7 @@
 #define __BOOTSTRAP_LIB_H_
 
 extern int bootstrap_init(int argc, char **argv);
-extern int bootstrap_keyval_parse(char *path);
+extern int bootstrap_keyval_parse(const char *path);
 extern int bootstrap_deffile(void);
 
 #endif /* __BOOTSTRAP_LIB_H */
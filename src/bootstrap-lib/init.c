@@ -42,7 +42,7 @@
 
 
 int bootstrap_init(int argc, char **argv) {
-    char *builddef = singularity_registry_get("BUILDDEF");
+    const char *builddef = singularity_registry_get("BUILDDEF");
 
 
     if ( strncmp(builddef, "docker://", 9) == 0 ) {
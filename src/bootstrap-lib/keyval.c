@@ -38,7 +38,7 @@
 #define MAX_LINE_LEN 4096
 
 
-int bootstrap_keyval_parse(char *path) {
+int bootstrap_keyval_parse(const char *path) {
     FILE *bootdef_fp;
     char *line;
 
@@ -59,7 +59,7 @@ int main(int argc, char **argv) {
     struct image_object image;
     FILE *bootdef_fp;
     char *line;
-    char *builddef;
+    const char *builddef;
 
     singularity_config_init(joinpath(SYSCONFDIR, "/singularity/singularity.conf"));
     singularity_registry_init();
@@ -167,6 +167,11 @@ int main(int argc, char **argv) {
     envar_set("SINGULARITY_DOCKER_PASSWORD", singularity_registry_get("DOCKER_PASSWORD"), 1);
     envar_set("SINGULARITY_DOCKER_USERNAME", singularity_registry_get("DOCKER_USERNAME"), 1);
     envar_set("SINGULARITY_CACHEDIR", singularity_registry_get("CACHEDIR"), 1);
+    envar_set("SINGULARITY_DISABLE_CACHE", singularity_registry_get("DISABLE_CACHE"), 1);
+    envar_set("SINGULARITY_BUILDCACHE", singularity_registry_get("BUILDCACHE"), 1);
+    envar_set("SINGULARITY_BUILDCACHE_DAYS", singularity_registry_get("BUILDCACHE_DAYS"), 1);
+    envar_set("SINGULARITY_PKGCACHE", singularity_registry_get("PKGCACHE"), 1);
+    envar_set("SINGULARITY_PKGCACHE_MAX", singularity_registry_get("PKGCACHE_MAX"), 1);
     envar_set("SINGULARITY_NOHTTPS", singularity_registry_get("NOHTTPS"), 1);
     envar_set("SINGULARITY_version", singularity_registry_get("VERSION"), 1);
     envar_set("HOME", singularity_priv_home(), 1);
@@ -174,6 +179,7 @@ int main(int argc, char **argv) {
 
     char *bootstrap = joinpath(LIBEXECDIR, "/singularity/bootstrap-scripts/main-deffile.sh");
 
+    singularity_message_flush();
     execl(bootstrap, bootstrap, NULL); //Flawfinder: ignore (Yes, yes, we know, and this is required)
 
     singularity_message(ERROR, "Exec of bootstrap code failed: %s\n", strerror(errno));
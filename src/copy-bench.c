@@ -0,0 +1,171 @@
+/*
+ * Copyright (c) 2017-2018, SyLabs, Inc. All rights reserved.
+ * Copyright (c) 2017, SingularityWare, LLC. All rights reserved.
+ *
+ * See the COPYRIGHT.md file at the top-level directory of this distribution and at
+ * https://github.com/singularityware/singularity/blob/master/COPYRIGHT.md.
+ *
+ * This file is part of the Singularity Linux container project. It is subject to the license
+ * terms in the LICENSE.md file found in the top-level directory of this distribution and
+ * at https://github.com/singularityware/singularity/blob/master/LICENSE.md. No part
+ * of Singularity, including this file, may be copied, modified, propagated, or distributed
+ * except according to the terms contained in the LICENSE.md file.
+ *
+*/
+
+/*
+ * Microbenchmark for the copy_fd() strategies. Not installed, build it with
+ * 'make copy-bench' and point it at directories on the file systems to
+ * compare, e.g.:
+ *
+ *   ./copy-bench /dev/shm 64 10
+ *   ./copy-bench /var/tmp 64 10
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#include "config.h"
+#include "util/util.h"
+#include "util/file.h"
+#include "util/message.h"
+
+#define BENCH_STDIO -1
+
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+// The per byte loop copy_file() used before copy_fd()
+static ssize_t copy_stdio(int source_fd, int dest_fd) {
+    FILE *fp_s = fdopen(dup(source_fd), "r");
+    FILE *fp_d = fdopen(dup(dest_fd), "w");
+    ssize_t done = 0;
+    int c;
+
+    if ( fp_s == NULL || fp_d == NULL ) {
+        return(-1);
+    }
+
+    while ( ( c = fgetc(fp_s) ) != EOF ) { // Flawfinder: ignore
+        fputc(c, fp_d);
+        done++;
+    }
+
+    fclose(fp_s);
+    fclose(fp_d);
+
+    return(done);
+}
+
+static int make_source(char *path, size_t size) {
+    char buf[65536];
+    size_t done = 0;
+    unsigned int seed = 1;
+    int fd;
+
+    if ( ( fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644) ) < 0 ) { // Flawfinder: ignore
+        return(-1);
+    }
+
+    while ( done < size ) {
+        size_t len = size - done < sizeof(buf) ? size - done : sizeof(buf);
+        size_t i;
+
+        for ( i = 0; i < len; i++ ) {
+            buf[i] = rand_r(&seed);
+        }
+        if ( write(fd, buf, len) != (ssize_t)len ) {
+            close(fd);
+            return(-1);
+        }
+        done += len;
+    }
+
+    return(close(fd));
+}
+
+static void run(const char *name, int strategy, char *source, char *dest, size_t size, int iterations) {
+    double start;
+    double elapsed;
+    int i;
+
+    start = now();
+    for ( i = 0; i < iterations; i++ ) {
+        int fd_s = open(source, O_RDONLY); // Flawfinder: ignore
+        int fd_d = open(dest, O_WRONLY | O_CREAT | O_TRUNC, 0644); // Flawfinder: ignore
+        ssize_t len;
+
+        if ( fd_s < 0 || fd_d < 0 ) {
+            printf("%-16s failed to open files: %s\n", name, strerror(errno));
+            return;
+        }
+
+        if ( strategy == BENCH_STDIO ) {
+            len = copy_stdio(fd_s, fd_d);
+        } else {
+            len = copy_fd(fd_s, fd_d, strategy);
+        }
+
+        close(fd_s);
+        close(fd_d);
+
+        if ( len != (ssize_t)size ) {
+            printf("%-16s not usable here: %s\n", name, len < 0 ? strerror(errno) : "short copy");
+            return;
+        }
+    }
+    elapsed = now() - start;
+
+    printf("%-16s %10.1f MB/s %10.3f ms/copy\n", name, ( (double)size * iterations ) / ( 1024 * 1024 ) / elapsed,
+            elapsed * 1000 / iterations);
+}
+
+int main(int argc, char **argv) {
+    char *source;
+    char *dest;
+    size_t size;
+    int iterations;
+
+    if ( argc < 2 ) {
+        fprintf(stderr, "USAGE: %s <directory> [size in MB] [iterations]\n", argv[0]);
+        return(1);
+    }
+
+    size = ( argc > 2 ? strtoul(argv[2], NULL, 10) : 64 ) * 1024 * 1024;
+    iterations = argc > 3 ? atoi(argv[3]) : 5;
+    if ( size == 0 || iterations <= 0 ) {
+        fprintf(stderr, "Size and iterations must be greater than 0\n");
+        return(1);
+    }
+
+    source = joinpath(argv[1], "copy-bench.src");
+    dest = joinpath(argv[1], "copy-bench.dst");
+
+    if ( make_source(source, size) < 0 ) {
+        fprintf(stderr, "Could not create %s: %s\n", source, strerror(errno));
+        return(1);
+    }
+
+    printf("Copying %zu MB %d times in %s\n", size / ( 1024 * 1024 ), iterations, argv[1]);
+    run("copy_file_range", COPY_FD_RANGE, source, dest, size, iterations);
+    run("sendfile", COPY_FD_SENDFILE, source, dest, size, iterations);
+    run("read/write", COPY_FD_READWRITE, source, dest, size, iterations);
+    run("stdio", BENCH_STDIO, source, dest, size, iterations);
+
+    unlink(source);
+    unlink(dest);
+
+    return(0);
+}
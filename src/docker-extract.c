@@ -4,9 +4,14 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <strings.h>
 #include <fcntl.h>
 #include <sys/file.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <signal.h>
 #include <limits.h>
 #include <locale.h>
 #include <archive.h>
@@ -18,189 +23,370 @@
 #include "util/registry.h"
 #include "util/util.h"
 
-/* apply_opaque
- *  Given opq_marker as a path to a whiteout opaque marker
- *    e.g. usr/share/doc/test/.wh..wh..opq
- *  Make the directory containing the make opaque for this layer by removing it
- *  if it exists under rootfs_dir
+/* Read block for archive_read_open_filename(). Layers are read sequentially
+ * so a large block mainly saves read() calls on multi-GB layers.
  */
-int apply_opaque(const char *opq_marker, char *rootfs_dir) {
-    int retval = 0;
-    char *token;
-    char target[PATH_MAX];
-    char *target_real;
+#define EXTRACT_BLOCK_SIZE (1024 * 1024)
 
-    token = strrchr(opq_marker, '/');
-    if (token == NULL) {
-        singularity_message(ERROR, "Error getting dirname for opaque marker\n");
-        ABORT(255);
+#define WHITEOUT_PREFIX ".wh."
+#define WHITEOUT_OPAQUE ".wh..wh..opq"
+
+/* Name of the layer staging directory in the root of the rootfs, which an
+ * opaque marker for the root of a layer must leave alone
+ */
+static char *stage_name = NULL;
+
+/* Add owner permissions while extracting (SINGULARITY_FIX_PERMS) */
+static int fix_perms = 0;
+
+/* path_set
+ *  Open addressing hash set of the paths (relative to rootfs_dir) written by
+ *  the layer being extracted. Whiteouts only apply to lower layers, so
+ *  entries of this layer must survive a marker which appears after them in
+ *  the tar stream.
+ */
+struct path_set {
+    char **slots;
+    size_t size;
+    size_t count;
+};
+
+static char **path_set_slot(char **slots, size_t size, const char *path) {
+    size_t i = fnv1a(FNV1A_INIT, path, strlen(path)) & ( size - 1 );
+
+    while ( slots[i] != NULL && strcmp(slots[i], path) != 0 ) {
+        i = ( i + 1 ) & ( size - 1 );
+    }
+
+    return(&slots[i]);
+}
+
+static int path_set_contains(struct path_set *set, const char *path) {
+    if ( set->size == 0 ) {
+        return(0);
     }
+    return(*path_set_slot(set->slots, set->size, path) != NULL);
+}
+
+static void path_set_grow(struct path_set *set) {
+    size_t size = set->size ? set->size * 2 : 4096;
+    char **slots = (char **)calloc(size, sizeof(char *));
+    size_t i;
 
-    retval = snprintf(target, sizeof(target), "%s/%s", rootfs_dir, opq_marker);
-    if (retval == -1 || retval >= sizeof(target)) {
-        singularity_message(ERROR, "Error with pathname too long\n");
+    if ( slots == NULL ) {
+        singularity_message(ERROR, "Failed to allocate memory for layer path set\n");
         ABORT(255);
     }
 
-    // Target may not exist - that's ok
-    retval = 0;
+    for ( i = 0; i < set->size; i++ ) {
+        if ( set->slots[i] != NULL ) {
+            *path_set_slot(slots, size, set->slots[i]) = set->slots[i];
+        }
+    }
 
-    if (is_dir(target) == 0) {
+    free(set->slots);
+    set->slots = slots;
+    set->size = size;
+}
 
-        target_real = realpath(target, NULL);  // Flawfinder: ignore
+/* Add path, return 0 if it was already in the set */
+static int path_set_insert(struct path_set *set, const char *path) {
+    char **slot;
 
-        if(target_real == NULL) {
-            singularity_message(ERROR, "Error canonicalizing whiteout path %s - aborting.\n", target);
-            ABORT(255);
+    if ( ( set->count + 1 ) * 2 > set->size ) {
+        path_set_grow(set);
+    }
+
+    slot = path_set_slot(set->slots, set->size, path);
+    if ( *slot != NULL ) {
+        return(0);
+    }
+    *slot = strdup(path);
+    set->count++;
+
+    return(1);
+}
+
+/* Add path and all of its parents, which may have been created implicitly */
+static void path_set_add(struct path_set *set, const char *path) {
+    char *tmp = strdup(path);
+    char *slash;
+
+    while ( *tmp != '\0' && path_set_insert(set, tmp) ) {
+        if ( ( slash = strrchr(tmp, '/') ) == NULL ) {
+            break;
         }
+        *slash = '\0';
+    }
 
-        if(strncmp(rootfs_dir, target_real, strlen(rootfs_dir)) != 0) {
-            singularity_message(ERROR, "Attempt to whiteout outside of rootfs %s - aborting.\n", target_real);
-            ABORT(255);
+    free(tmp);
+}
+
+static void path_set_free(struct path_set *set) {
+    size_t i;
+
+    for ( i = 0; i < set->size; i++ ) {
+        free(set->slots[i]);
+    }
+    free(set->slots);
+}
+
+/* normalize_path
+ *  Strip leading ./ and trailing / from a tar entry path, "." becomes ""
+ */
+static char *normalize_path(const char *pathname) {
+    char *path;
+    size_t len;
+
+    while ( pathname[0] == '.' && ( pathname[1] == '/' || pathname[1] == '\0' ) ) {
+        pathname += pathname[1] ? 2 : 1;
+        while ( *pathname == '/' ) {
+            pathname++;
         }
+    }
+
+    path = strdup(pathname);
+    len = strlen(path);
+    while ( len > 0 && path[len - 1] == '/' ) {
+        path[--len] = '\0';
+    }
+
+    return(path);
+}
 
-        retval = s_rmdir(target_real);
+/* rootfs_contains
+ *  Return 1 if the canonical path is rootfs_dir itself (when allow_root is
+ *  set) or lies below it
+ */
+static int rootfs_contains(const char *rootfs_dir, const char *path, int allow_root) {
+    size_t len = strlen(rootfs_dir);
 
-        free(target_real);
+    if (strncmp(rootfs_dir, path, len) != 0) {
+        return 0;
+    }
+    if (path[len] == '\0') {
+        return allow_root;
     }
 
+    return path[len] == '/';
+}
 
-    return retval;
+/* whiteout_name_valid
+ *  Return 1 if name (what follows .wh. in a whiteout marker) names a single
+ *  entry of the marker's directory
+ */
+static int whiteout_name_valid(const char *name) {
+    return *name != '\0' && strcmp(name, ".") != 0 && strcmp(name, "..") != 0 && strchr(name, '/') == NULL;
 }
 
-/* apply_whiteout
- *  Given wh_marker as a path to a whiteout marker
- *    e.g. usr/share/doc/test/.wh.deletedfile
- *  Whiteout the referenced file for this layer by removing it if it exists
- *  under rootfs_dir
+/* rootfs_subdir
+ *  Canonical path of the directory relpath below rootfs_dir, or NULL if
+ *  it does not exist
  */
-int apply_whiteout(const char *wh_marker, char *rootfs_dir) {
-    int retval = 0;
-    char* token;
-    size_t token_pos, l = 0;
-    char target[PATH_MAX];
+static char *rootfs_subdir(const char *relpath, char *rootfs_dir) {
+    char *target = joinpath(rootfs_dir, relpath);
     char *target_real;
-    struct stat statbuf;
 
-    token = strstr(wh_marker, ".wh.");
-    if (token == NULL) {
-        singularity_message(ERROR, "Error getting filename for whiteout marker\n");
-        ABORT(255);
+    if (is_dir(target) < 0) {
+        free(target);
+        return NULL;
     }
 
-    // Start with ROOTFS
-    retval = snprintf(target, sizeof(target), "%s/", rootfs_dir);
-    if (retval == -1 || retval >= sizeof(target)) {
-        singularity_message(ERROR, "Error with pathname too long\n");
+    target_real = realpath(target, NULL);  // Flawfinder: ignore
+
+    if(target_real == NULL) {
+        singularity_message(ERROR, "Error canonicalizing whiteout path %s - aborting.\n", target);
         ABORT(255);
     }
-    l = strlen(target);
-    // Add whiteout path up to .wh.
-    if (strlen(target) + strlen(token) > sizeof(target) - 1) {
-        singularity_message(ERROR, "Error with pathname too long\n");
+
+    if(!rootfs_contains(rootfs_dir, target_real, 1)) {
+        singularity_message(ERROR, "Attempt to whiteout outside of rootfs %s - aborting.\n", target_real);
         ABORT(255);
     }
-    token_pos = strlen(wh_marker) - strlen(token);
-    retval = snprintf(target + l, token_pos + 1, "%s", wh_marker);
-    if (retval == -1 || retval >= sizeof(target) - l) {
-        singularity_message(ERROR, "Error with pathname too long\n");
-        ABORT(255);
+
+    free(target);
+
+    return target_real;
+}
+
+/* clear_opaque_dir
+ *  Remove everything below dir that was not written by the current layer
+ */
+static int clear_opaque_dir(const char *dir, const char *relpath, struct path_set *layer) {
+    int retval = 0;
+    DIR *dirp;
+    struct dirent *dirent;
+
+    if ((dirp = opendir(dir)) == NULL) {
+        singularity_message(ERROR, "Could not open opaque directory %s: %s\n", dir, strerror(errno));
+        return -1;
     }
-    l = strlen(target);
-    // Concatenate suffix after .wh
-    retval = snprintf(target + l, sizeof(target) - l, "%s", token + 4);
-    if (retval == -1 || retval >= sizeof(target) - l) {
-        singularity_message(ERROR, "Error with pathname too long\n");
-        ABORT(255);
+
+    while (retval == 0 && (dirent = readdir(dirp)) != NULL) {
+        struct stat statbuf;
+        char *child;
+        char *child_rel;
+
+        if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0) {
+            continue;
+        }
+        if (*relpath == '\0' && stage_name != NULL && strcmp(dirent->d_name, stage_name) == 0) {
+            continue;
+        }
+
+        child = joinpath(dir, dirent->d_name);
+        child_rel = *relpath ? joinpath(relpath, dirent->d_name) : strdup(dirent->d_name);
+
+        if (lstat(child, &statbuf) < 0) {
+            retval = -1;
+        } else if (path_set_contains(layer, child_rel)) {
+            if (S_ISDIR(statbuf.st_mode)) {
+                retval = clear_opaque_dir(child, child_rel, layer);
+            }
+        } else if (S_ISDIR(statbuf.st_mode)) {
+            retval = s_rmdir(child);
+        } else {
+            singularity_message(DEBUG, "Removing opaque-ed file: %s\n", child);
+            retval = unlink(child);
+        }
+
+        free(child);
+        free(child_rel);
     }
 
+    closedir(dirp);
+
+    return retval;
+}
+
+/* apply_opaque
+ *  Given dir as the directory containing a whiteout opaque marker
+ *    e.g. usr/share/doc/test for usr/share/doc/test/.wh..wh..opq
+ *  Make the directory opaque for this layer by removing everything in it
+ *  under rootfs_dir that did not come from this layer
+ */
+int apply_opaque(const char *dir, char *rootfs_dir, struct path_set *layer) {
+    int retval = 0;
+    char *target_real;
+
     // Target may not exist - that's ok
-    if (stat(target, &statbuf) < 0){
+    if ((target_real = rootfs_subdir(dir, rootfs_dir)) == NULL) {
         return 0;
     }
 
-    target_real = realpath(target, NULL);  // Flawfinder: ignore
+    retval = clear_opaque_dir(target_real, dir, layer);
 
-    if(target_real == NULL) {
-        singularity_message(ERROR, "Error canonicalizing whiteout path %s - aborting.\n", target);
-        ABORT(255);
+    free(target_real);
+
+    return retval;
+}
+
+/* apply_whiteout
+ *  Given dir and name from a whiteout marker
+ *    e.g. usr/share/doc/test and deletedfile for usr/share/doc/test/.wh.deletedfile
+ *  Whiteout the referenced file for this layer by removing it if it exists
+ *  under rootfs_dir
+ */
+int apply_whiteout(const char *dir, const char *name, char *rootfs_dir, struct path_set *layer) {
+    int retval = 0;
+    char *parent_real;
+    char *target_real;
+    char *relpath;
+    struct stat statbuf;
+
+    relpath = *dir ? joinpath(dir, name) : strdup(name);
+    if (path_set_contains(layer, relpath)) {
+        singularity_message(DEBUG, "Not applying whiteout to %s written by this layer\n", relpath);
+        free(relpath);
+        return 0;
+    }
+    free(relpath);
+
+    // Target may not exist - that's ok
+    if ((parent_real = rootfs_subdir(dir, rootfs_dir)) == NULL) {
+        return 0;
     }
- 
-    if(strncmp(rootfs_dir, target_real, strlen(rootfs_dir)) != 0) {
+
+    target_real = joinpath(parent_real, name);
+
+    if (!whiteout_name_valid(name) || !rootfs_contains(rootfs_dir, target_real, 0)) {
         singularity_message(ERROR, "Attempt to whiteout outside of rootfs %s - aborting.\n", target_real);
         ABORT(255);
     }
 
-    if (is_dir(target_real) == 0) {
-        retval = s_rmdir(target_real);
-    } else if (is_file(target_real) == 0 || is_link(target_real) == 0) {
-        singularity_message(DEBUG, "Removing whiteout-ed file: %s\n",
-                            target_real);
-        retval = unlink(target_real);
+    if (lstat(target_real, &statbuf) == 0) {
+        if (S_ISDIR(statbuf.st_mode)) {
+            retval = s_rmdir(target_real);
+        } else {
+            singularity_message(DEBUG, "Removing whiteout-ed file: %s\n",
+                                target_real);
+            retval = unlink(target_real);
+        }
     }
 
     free(target_real);
+    free(parent_real);
 
     return retval;
 }
 
-/* apply_whiteouts
- *  Process tarfile and apply any aufs opaque/whiteouts on rootfs_dir
+/* is_marker
+ *  Return 1 if pathname is an aufs opaque/whiteout marker
  */
-int apply_whiteouts(char *tarfile, char *rootfs_dir) {
-    int retval = 0;
-    int errcode = 0;
-    struct archive *a;
-    struct archive_entry *entry;
+static int is_marker(const char *pathname) {
+    char *path = normalize_path(pathname);
+    char *name = strrchr(path, '/');
+    int retval;
 
-    a = archive_read_new();
-#if ARCHIVE_VERSION_NUMBER <= 3000000
-    archive_read_support_compression_all(a);
-#else
-    archive_read_support_filter_all(a);
-#endif
-    archive_read_support_format_all(a);
-    retval = archive_read_open_filename(a, tarfile, 10240);
-    if (retval != ARCHIVE_OK) {
-        return (1);
-    }
+    retval = strncmp(name ? name + 1 : path, WHITEOUT_PREFIX, strlen(WHITEOUT_PREFIX)) == 0;
+    free(path);
 
-    while (archive_read_next_header(a, &entry) == ARCHIVE_OK) {
+    return retval;
+}
 
-        const char *pathname = archive_entry_pathname(entry);
+/* apply_marker
+ *  If pathname is an aufs opaque/whiteout marker apply it on rootfs_dir and
+ *  return 1, otherwise return 0
+ */
+static int apply_marker(const char *pathname, char *rootfs_dir, struct path_set *layer) {
+    char *dir = normalize_path(pathname);
+    char *name = strrchr(dir, '/');
 
-        if (*pathname == '/') {
-            singularity_message(ERROR, "Archive contains absolute paths %s - aborting.\n", pathname);
+    if (!is_marker(pathname)) {
+        free(dir);
+        return 0;
+    }
+
+    if (name == NULL) {
+        name = dir;
+        dir = strdup("");
+    } else {
+        *name++ = '\0';
+        name = strdup(name);
+    }
+
+    if (strcmp(name, WHITEOUT_OPAQUE) == 0) {
+        singularity_message(DEBUG, "Opaque Marker %s\n", pathname);
+        if (apply_opaque(dir, rootfs_dir, layer) != 0) {
+            singularity_message(ERROR, "Error applying opaque marker from docker layer.\n");
             ABORT(255);
         }
-
-        if (strstr(pathname, "/.wh..wh..opq")) {
-            singularity_message(DEBUG, "Opaque Marker %s\n", pathname);
-            errcode = apply_opaque(pathname, rootfs_dir);
-            if (errcode != 0) {
-                singularity_message(ERROR, "Error applying opaque marker from docker layer.\n");
-                ABORT(255);
-            }
-        } else if (strstr(pathname, "/.wh.")) {
-            singularity_message(DEBUG, "Whiteout Marker %s\n", pathname);
-            errcode = apply_whiteout(pathname, rootfs_dir);
-            if (errcode != 0) {
-                singularity_message(ERROR, "Error applying whiteout marker from docker layer.\n");
-                ABORT(255);
-            }
+    } else {
+        singularity_message(DEBUG, "Whiteout Marker %s\n", pathname);
+        if (!whiteout_name_valid(name + strlen(WHITEOUT_PREFIX))) {
+            singularity_message(ERROR, "Invalid whiteout marker %s - aborting.\n", pathname);
+            ABORT(255);
+        }
+        if (apply_whiteout(dir, name + strlen(WHITEOUT_PREFIX), rootfs_dir, layer) != 0) {
+            singularity_message(ERROR, "Error applying whiteout marker from docker layer.\n");
+            ABORT(255);
         }
-    }
-#if ARCHIVE_VERSION_NUMBER <= 3000000
-    retval = archive_read_finish(a);
-#else
-    retval = archive_read_free(a);
-#endif
-    if (retval != ARCHIVE_OK){
-        singularity_message(ERROR, "Error freeing archive\n");
-        ABORT(255);
     }
 
-    return errcode;
+    free(dir);
+    free(name);
+
+    return 1;
 }
 
 /* See  https://github.com/libarchive/libarchive/wiki/Examples#A_Complete_Extractor */
@@ -228,21 +414,28 @@ static int copy_data(struct archive *ar, struct archive *aw) {
 
 /* extract_tar
  *  Extract a tar file to rootfs_dir using libarchive. Handles compression.
- *  Exclude any .wh. whiteout files, and device/pipe/fifo entries
+ *  Whiteout markers are applied as they are read, so the layer is only
+ *  decompressed once, or if markers is not NULL written to it (NUL
+ *  separated) to be applied later. If dirs is not NULL the directories
+ *  that have their own entry in the tar are written to it the same way.
+ *  Device/pipe/fifo entries are skipped.
  *
  * See https://github.com/libarchive/libarchive/wiki/Examples#A_Complete_Extractor
  */
-int extract_tar(const char *tarfile, const char *rootfs_dir) {
+int extract_tar(const char *tarfile, char *rootfs_dir, FILE *markers, FILE *dirs) {
     int retval = 0;
     struct archive *a;
     struct archive *ext;
     struct archive_entry *entry;
     mode_t perms;
+    mode_t perms_add;
     int flags;
     int r;
     char *orig_dir;
     const char *pathname;
+    char *layer_path;
     int pathtype;
+    struct path_set layer = { NULL, 0, 0 };
 
     orig_dir = get_current_dir_name();
 
@@ -265,7 +458,7 @@ int extract_tar(const char *tarfile, const char *rootfs_dir) {
     ext = archive_write_disk_new();
     archive_write_disk_set_options(ext, flags);
     archive_write_disk_set_standard_lookup(ext);
-    if ((r = archive_read_open_filename(a, tarfile, 10240))){
+    if ((r = archive_read_open_filename(a, tarfile, EXTRACT_BLOCK_SIZE))){
         singularity_message(ERROR, "Error opening tar file %s\n", tarfile);
         ABORT(255);
     }
@@ -300,24 +493,56 @@ int extract_tar(const char *tarfile, const char *rootfs_dir) {
             ABORT(255);
         }
 
-        // Do not extract whiteout markers (handled in apply_whiteouts)
+        // Apply whiteout markers instead of extracting them
+        if (markers != NULL && is_marker(pathname)) {
+            if (fwrite(pathname, strlen(pathname) + 1, 1, markers) != 1) {
+                singularity_message(ERROR, "Could not record whiteout marker %s: %s\n", pathname, strerror(errno));
+                ABORT(255);
+            }
+            continue;
+        }
+        if (markers == NULL && apply_marker(pathname, rootfs_dir, &layer)) {
+            continue;
+        }
+
         // Do not extract sockers, chr/blk devices, pipes
-        if (strstr(pathname, "/.wh.") || pathtype == AE_IFSOCK ||
-            pathtype == AE_IFCHR || pathtype == AE_IFBLK || pathtype == AE_IFIFO) {
+        if (pathtype == AE_IFSOCK || pathtype == AE_IFCHR ||
+            pathtype == AE_IFBLK || pathtype == AE_IFIFO) {
             continue;
         }
 
+        layer_path = normalize_path(pathname);
+        path_set_add(&layer, layer_path);
+        if (dirs != NULL && pathtype == AE_IFDIR && fwrite(layer_path, strlen(layer_path) + 1, 1, dirs) != 1) {
+            singularity_message(ERROR, "Could not record layer directory %s: %s\n", layer_path, strerror(errno));
+            ABORT(255);
+        }
+        free(layer_path);
+
+        perms_add = 0;
+
         // Issue 977 - Force write perms needed for user builds
         if(getuid() != 0) {
+            perms_add |= S_IWUSR;
+        }
+
+        // SINGULARITY_FIX_PERMS - owner rw for files, rwx for directories
+        if (fix_perms && pathtype == AE_IFDIR) {
+            perms_add |= S_IRWXU;
+        } else if (fix_perms && pathtype == AE_IFREG) {
+            perms_add |= S_IRUSR | S_IWUSR;
+        }
+
+        if (perms_add != 0) {
 #if ARCHIVE_VERSION_NUMBER <= 3000000
             perms = archive_entry_mode(entry);
-            if( (perms & S_IWUSR) != S_IWUSR) {
-                archive_entry_set_mode(entry, perms | S_IWUSR);
+            if( (perms & perms_add) != perms_add) {
+                archive_entry_set_mode(entry, perms | perms_add);
             }
 #else
             perms = archive_entry_perm(entry);
-            if( (perms & S_IWUSR) != S_IWUSR) {
-                archive_entry_set_perm(entry, perms | S_IWUSR);
+            if( (perms & perms_add) != perms_add) {
+                archive_entry_set_perm(entry, perms | perms_add);
             }
 #endif
         }
@@ -361,15 +586,749 @@ int extract_tar(const char *tarfile, const char *rootfs_dir) {
     }
 
     free(orig_dir);
+    path_set_free(&layer);
 
     return (retval);
 }
 
+/* merge_layer_dir
+ *  Move the contents of the staged layer directory src into dst. Entries
+ *  of the layer replace whatever lower layers left at the same path, and
+ *  directories present in both are merged. A merged directory takes the
+ *  layer's owner, mode and times only if the layer has an entry for it
+ *  (in dirs), not when libarchive created it as a parent of another entry.
+ */
+static int merge_layer_dir(const char *src, const char *dst, const char *relpath, struct path_set *dirs) {
+    int retval = 0;
+    DIR *dirp;
+    struct dirent *dirent;
+
+    if ((dirp = opendir(src)) == NULL) {
+        singularity_message(ERROR, "Could not open staged layer directory %s: %s\n", src, strerror(errno));
+        return -1;
+    }
+
+    while (retval == 0 && (dirent = readdir(dirp)) != NULL) {
+        struct stat src_stat;
+        struct stat dst_stat;
+        char *src_path;
+        char *dst_path;
+
+        if (strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0) {
+            continue;
+        }
+
+        src_path = joinpath(src, dirent->d_name);
+        dst_path = joinpath(dst, dirent->d_name);
+
+        if (lstat(src_path, &src_stat) < 0) {
+            retval = -1;
+        } else if (lstat(dst_path, &dst_stat) < 0) {
+            retval = rename(src_path, dst_path);
+        } else if (S_ISDIR(src_stat.st_mode) && S_ISDIR(dst_stat.st_mode)) {
+            struct timespec times[2] = { src_stat.st_atim, src_stat.st_mtim };
+            char *child_rel = *relpath ? joinpath(relpath, dirent->d_name) : strdup(dirent->d_name);
+            int explicit = path_set_contains(dirs, child_rel);
+
+            retval = merge_layer_dir(src_path, dst_path, child_rel, dirs);
+            free(child_rel);
+
+            // The upper layer's directory attributes win
+            if (retval == 0 && explicit && getuid() == 0) {
+                retval = lchown(dst_path, src_stat.st_uid, src_stat.st_gid);
+            }
+            if (retval == 0 && explicit) {
+                retval = chmod(dst_path, src_stat.st_mode & 07777);
+            }
+            if (retval == 0 && explicit) {
+                retval = utimensat(AT_FDCWD, dst_path, times, AT_SYMLINK_NOFOLLOW);
+            }
+        } else {
+            if (S_ISDIR(dst_stat.st_mode)) {
+                retval = s_rmdir(dst_path);
+            } else {
+                retval = unlink(dst_path);
+            }
+            if (retval == 0) {
+                retval = rename(src_path, dst_path);
+            }
+        }
+
+        if (retval != 0) {
+            singularity_message(ERROR, "Could not merge layer entry %s into %s: %s\n", src_path, dst_path, strerror(errno));
+        }
+
+        free(src_path);
+        free(dst_path);
+    }
+
+    closedir(dirp);
+
+    return retval;
+}
+
+/* merge_layer
+ *  Apply the whiteout markers recorded for a staged layer to rootfs_dir,
+ *  which at this point holds exactly the layers below it, then move the
+ *  layer's files into place
+ */
+static int merge_layer(const char *stage_dir, const char *markers_file, const char *dirs_file, char *rootfs_dir) {
+    struct path_set none = { NULL, 0, 0 };
+    struct path_set dirs = { NULL, 0, 0 };
+    char *marker = NULL;
+    size_t marker_size = 0;
+    FILE *markers;
+    int retval;
+
+    if ((markers = fopen(dirs_file, "r")) == NULL) { // Flawfinder: ignore
+        singularity_message(ERROR, "Could not open layer directory list %s: %s\n", dirs_file, strerror(errno));
+        return -1;
+    }
+    while (getdelim(&marker, &marker_size, '\0', markers) > 0) {
+        path_set_add(&dirs, marker);
+    }
+    fclose(markers);
+
+    if ((markers = fopen(markers_file, "r")) == NULL) { // Flawfinder: ignore
+        singularity_message(ERROR, "Could not open layer whiteout list %s: %s\n", markers_file, strerror(errno));
+        return -1;
+    }
+
+    while (getdelim(&marker, &marker_size, '\0', markers) > 0) {
+        apply_marker(marker, rootfs_dir, &none);
+    }
+
+    free(marker);
+    fclose(markers);
+
+    retval = merge_layer_dir(stage_dir, rootfs_dir, "", &dirs);
+    path_set_free(&dirs);
+
+    return retval;
+}
+
+/* extract_layers
+ *  Extract the ordered (lowest first) list of layers into rootfs_dir using
+ *  up to workers processes. The lowest layer is extracted in place, the
+ *  others into their own staging directories below rootfs_dir (so they can
+ *  be renamed into place) and merged in order as soon as every layer below
+ *  them is done.
+ */
+static int extract_layers(char **tarfiles, int count, int workers, char *rootfs_dir) {
+    pid_t *pids = (pid_t *)calloc(count, sizeof(pid_t));
+    int *done = (int *)calloc(count, sizeof(int));
+    char *stage = joinpath(rootfs_dir, ".singularity-layers.XXXXXX");
+    int running = 0;
+    int next = 0;
+    int merged = 1;
+    int failed = 0;
+    int i;
+
+    if (mkdtemp(stage) == NULL) {
+        singularity_message(ERROR, "Could not create layer staging directory: %s\n", strerror(errno));
+        ABORT(255);
+    }
+    stage_name = strrchr(stage, '/') + 1;
+
+    singularity_message(VERBOSE, "Extracting %d layers with %d workers in %s\n", count, workers, stage);
+
+    while (merged < count && failed == 0) {
+        int status;
+        pid_t pid;
+
+        while (running < workers && next < count) {
+            char *layer_dir = joinpath(stage, int2str(next));
+            char *markers_file = strjoin(layer_dir, ".wh");
+            char *dirs_file = strjoin(layer_dir, ".dirs");
+
+            singularity_message(INFO, "Exploding layer: %s\n", basename(tarfiles[next]));
+
+            if ((pids[next] = fork()) == 0) {
+                FILE *markers = NULL;
+                FILE *dirs = NULL;
+                int retval;
+
+                if (next == 0) {
+                    exit(extract_tar(tarfiles[next], rootfs_dir, NULL, NULL));
+                }
+
+                if (s_mkpath(layer_dir, 0755) < 0 || (markers = fopen(markers_file, "w")) == NULL || // Flawfinder: ignore
+                        (dirs = fopen(dirs_file, "w")) == NULL) { // Flawfinder: ignore
+                    singularity_message(ERROR, "Could not create layer staging directory %s: %s\n", layer_dir, strerror(errno));
+                    exit(255);
+                }
+                retval = extract_tar(tarfiles[next], layer_dir, markers, dirs);
+                if (fclose(markers) != 0 || fclose(dirs) != 0) {
+                    singularity_message(ERROR, "Could not write layer lists for %s: %s\n", layer_dir, strerror(errno));
+                    exit(255);
+                }
+                exit(retval);
+            } else if (pids[next] < 0) {
+                singularity_message(ERROR, "Could not fork layer extraction: %s\n", strerror(errno));
+                ABORT(255);
+            }
+
+            free(layer_dir);
+            free(markers_file);
+            free(dirs_file);
+            running++;
+            next++;
+        }
+
+        if ((pid = wait(&status)) < 0) {
+            singularity_message(ERROR, "Failed waiting for layer extraction: %s\n", strerror(errno));
+            ABORT(255);
+        }
+
+        for (i = 0; i < count; i++) {
+            if (pids[i] == pid) {
+                break;
+            }
+        }
+        if (i == count) {
+            continue;
+        }
+
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            singularity_message(ERROR, "Error extracting layer %s\n", tarfiles[i]);
+            failed = 1;
+            break;
+        }
+        done[i] = 1;
+
+        while (merged < count && done[0] && done[merged]) {
+            char *layer_dir = joinpath(stage, int2str(merged));
+            char *markers_file = strjoin(layer_dir, ".wh");
+            char *dirs_file = strjoin(layer_dir, ".dirs");
+
+            singularity_message(DEBUG, "Merging layer %s\n", tarfiles[merged]);
+            if (merge_layer(layer_dir, markers_file, dirs_file, rootfs_dir) != 0) {
+                failed = 1;
+                break;
+            }
+
+            free(layer_dir);
+            free(markers_file);
+            free(dirs_file);
+            merged++;
+        }
+    }
+
+    if (failed) {
+        for (i = 0; i < next; i++) {
+            if (!done[i]) {
+                kill(pids[i], SIGTERM);
+            }
+        }
+        while (wait(NULL) > 0) {
+        }
+    }
+
+    if (s_rmdir(stage) < 0) {
+        singularity_message(WARNING, "Could not remove layer staging directory %s\n", stage);
+    }
+    stage_name = NULL;
+
+    free(stage);
+    free(pids);
+    free(done);
+
+    return failed;
+}
+
+#if ARCHIVE_VERSION_NUMBER >= 3000000
+/* flatten
+ *  State of docker-extract --flatten, which merges the layers into a single
+ *  tar stream instead of extracting them. Layers are read top down, so the
+ *  sets hold what the layers above the current one wrote or removed, and
+ *  the layer_ sets what the current layer does to the layers below it.
+ */
+struct flatten_link;
+
+struct flatten {
+    struct archive *out;
+    struct flatten_link *links;
+    struct path_set written;
+    struct path_set deleted;
+    struct path_set opaque;
+    struct path_set layer_written;
+    struct path_set layer_deleted;
+    struct path_set layer_opaque;
+};
+
+/* flatten_link
+ *  Hard link of the current layer to a file that a layer above hides. The
+ *  link itself is visible, so once the layer is read flatten_links() reads
+ *  it again to write the first link of the file with its data, and points
+ *  the later ones to that link.
+ */
+struct flatten_link {
+    char *path;
+    char *target;
+    int written;
+    struct flatten_link *next;
+};
+
+/* Move the paths of src into dst */
+static void path_set_merge(struct path_set *dst, struct path_set *src) {
+    size_t i;
+
+    for ( i = 0; i < src->size; i++ ) {
+        if ( src->slots[i] != NULL ) {
+            path_set_insert(dst, src->slots[i]);
+        }
+    }
+
+    path_set_free(src);
+    src->slots = NULL;
+    src->size = 0;
+    src->count = 0;
+}
+
+/* flatten_hidden
+ *  Return 1 if path was written or removed by a layer above, or if one of
+ *  its parents was removed, replaced by a non directory or made opaque
+ */
+static int flatten_hidden(struct flatten *state, const char *path) {
+    char *tmp;
+    char *slash;
+    int hidden;
+
+    if ( path_set_contains(&state->written, path) || path_set_contains(&state->deleted, path) ) {
+        return 1;
+    }
+
+    tmp = strdup(path);
+    hidden = path_set_contains(&state->opaque, "");
+    while (!hidden && ( slash = strrchr(tmp, '/') ) != NULL ) {
+        *slash = '\0';
+        hidden = path_set_contains(&state->deleted, tmp) || path_set_contains(&state->opaque, tmp);
+    }
+    free(tmp);
+
+    return hidden;
+}
+
+/* flatten_marker
+ *  Record the aufs opaque/whiteout marker path for the layers below
+ */
+static void flatten_marker(struct flatten *state, const char *path) {
+    char *dir = strdup(path);
+    char *name = strrchr(dir, '/');
+    char *target;
+
+    if (name == NULL) {
+        name = dir;
+        dir = strdup("");
+    } else {
+        *name++ = '\0';
+        name = strdup(name);
+    }
+
+    if (strcmp(name, WHITEOUT_OPAQUE) == 0) {
+        singularity_message(DEBUG, "Opaque Marker %s\n", path);
+        path_set_insert(&state->layer_opaque, dir);
+    } else {
+        singularity_message(DEBUG, "Whiteout Marker %s\n", path);
+        if (!whiteout_name_valid(name + strlen(WHITEOUT_PREFIX))) {
+            singularity_message(ERROR, "Invalid whiteout marker %s - aborting.\n", path);
+            ABORT(255);
+        }
+        if (*dir == '\0') {
+            target = strdup(name + strlen(WHITEOUT_PREFIX));
+        } else {
+            target = joinpath(dir, name + strlen(WHITEOUT_PREFIX));
+        }
+        path_set_insert(&state->layer_deleted, target);
+        free(target);
+    }
+
+    free(dir);
+    free(name);
+}
+
+/* Return the deferred hard link named path */
+static struct flatten_link *flatten_link_find(struct flatten *state, const char *path) {
+    struct flatten_link *link;
+
+    for (link = state->links; link != NULL; link = link->next) {
+        if (strcmp(link->path, path) == 0) {
+            return link;
+        }
+    }
+
+    return NULL;
+}
+
+/* Defer the hard link path to target, links keep the order of the layer */
+static void flatten_link_add(struct flatten *state, const char *path, const char *target) {
+    struct flatten_link **tail = &state->links;
+    struct flatten_link *link = malloc(sizeof(struct flatten_link));
+
+    if (link == NULL) {
+        singularity_message(ERROR, "Failed to allocate memory\n");
+        ABORT(255);
+    }
+    link->path = strdup(path);
+    link->target = strdup(target);
+    link->written = 0;
+    link->next = NULL;
+
+    while (*tail != NULL) {
+        tail = &(*tail)->next;
+    }
+    *tail = link;
+}
+
+static void flatten_link_free(struct flatten *state) {
+    struct flatten_link *link;
+
+    while ((link = state->links) != NULL) {
+        state->links = link->next;
+        if (!link->written) {
+            singularity_message(WARNING, "Skipping hard link %s, %s is not a file of this layer\n", link->path, link->target);
+        }
+        free(link->path);
+        free(link->target);
+        free(link);
+    }
+}
+
+/* flatten_write
+ *  Write the header of entry and its data from in to the merged stream
+ */
+static void flatten_write(struct flatten *state, struct archive *in, struct archive_entry *entry) {
+    char buff[65536];
+    int pathtype = archive_entry_filetype(entry);
+    ssize_t size;
+    int r;
+
+    // SINGULARITY_FIX_PERMS - owner rw for files, rwx for directories
+    if (fix_perms && pathtype == AE_IFDIR) {
+        archive_entry_set_perm(entry, archive_entry_perm(entry) | S_IRWXU);
+    } else if (fix_perms && pathtype == AE_IFREG) {
+        archive_entry_set_perm(entry, archive_entry_perm(entry) | S_IRUSR | S_IWUSR);
+    }
+
+    r = archive_write_header(state->out, entry);
+    if (r < ARCHIVE_OK) {
+        singularity_message(WARNING, "Warning writing tar header: %s\n", archive_error_string(state->out));
+    }
+    if (r < ARCHIVE_WARN) {
+        singularity_message(ERROR, "Error writing tar header: %s\n", archive_error_string(state->out));
+        ABORT(255);
+    }
+
+    if (in == NULL) {
+        return;
+    }
+
+    while ((size = archive_read_data(in, buff, sizeof(buff))) > 0) {
+        if (archive_write_data(state->out, buff, size) != size) {
+            singularity_message(ERROR, "Error writing tar data: %s\n", archive_error_string(state->out));
+            ABORT(255);
+        }
+    }
+    if (size < 0) {
+        singularity_message(ERROR, "Error reading %s: %s\n", archive_entry_pathname(entry), archive_error_string(in));
+        ABORT(255);
+    }
+}
+
+/* flatten_entry
+ *  Write entry from in to the merged stream unless a layer above hides it
+ */
+static void flatten_entry(struct flatten *state, struct archive *in, struct archive_entry *entry) {
+    const char *pathname = archive_entry_pathname(entry);
+    const char *hardlink = archive_entry_hardlink(entry);
+    int pathtype = archive_entry_filetype(entry);
+    struct flatten_link *link;
+    char *path;
+    char *target;
+
+    if (*pathname == '/') {
+        singularity_message(ERROR, "Archive contains absolute paths - aborting.\n");
+        ABORT(255);
+    }
+
+    if (is_marker(pathname)) {
+        path = normalize_path(pathname);
+        flatten_marker(state, path);
+        free(path);
+        return;
+    }
+
+    // Do not extract sockers, chr/blk devices, pipes
+    if (pathtype == AE_IFSOCK || pathtype == AE_IFCHR ||
+        pathtype == AE_IFBLK || pathtype == AE_IFIFO) {
+        return;
+    }
+
+    path = normalize_path(pathname);
+
+    // The image root is created by mksquashfs
+    if (*path == '\0' || flatten_hidden(state, path)) {
+        free(path);
+        return;
+    }
+
+    // Hard links can only refer to an entry of the same layer. When a layer
+    // above hides the target, the link waits for flatten_links().
+    if (hardlink != NULL) {
+        target = normalize_path(hardlink);
+        if ((link = flatten_link_find(state, target)) != NULL) {
+            free(target);
+            target = strdup(link->target);
+        }
+        if (link != NULL || !path_set_contains(&state->layer_written, target)) {
+            flatten_link_add(state, path, target);
+            path_set_insert(&state->layer_written, path);
+            path_set_insert(&state->layer_deleted, path);
+            free(target);
+            free(path);
+            return;
+        }
+        archive_entry_copy_hardlink(entry, target);
+        free(target);
+    }
+
+    path_set_insert(&state->layer_written, path);
+    if (pathtype != AE_IFDIR) {
+        path_set_insert(&state->layer_deleted, path);
+    }
+    archive_entry_copy_pathname(entry, path);
+    free(path);
+
+    flatten_write(state, in, entry);
+}
+
+/* flatten_layer_done
+ *  Make the changes of the layer just read visible to the layers below
+ */
+static void flatten_layer_done(struct flatten *state) {
+    flatten_link_free(state);
+    path_set_merge(&state->written, &state->layer_written);
+    path_set_merge(&state->deleted, &state->layer_deleted);
+    path_set_merge(&state->opaque, &state->layer_opaque);
+}
+
+static struct archive *flatten_open(const char *tarfile) {
+    struct archive *a;
+
+    a = archive_read_new();
+    archive_read_support_format_all(a);
+#if ARCHIVE_VERSION_NUMBER <= 3000000
+    archive_read_support_compression_all(a);
+#else
+    archive_read_support_filter_all(a);
+#endif
+    if (archive_read_open_filename(a, tarfile, EXTRACT_BLOCK_SIZE)) {
+        singularity_message(ERROR, "Error opening tar file %s\n", tarfile);
+        ABORT(255);
+    }
+
+    return a;
+}
+
+/* Return the next entry of a, or NULL at the end */
+static struct archive_entry *flatten_next(struct archive *a) {
+    struct archive_entry *entry;
+    int r = archive_read_next_header(a, &entry);
+
+    if (r == ARCHIVE_EOF) {
+        return NULL;
+    }
+
+    if (r < ARCHIVE_OK) {
+        singularity_message(WARNING, "Warning reading tar header: %s\n", archive_error_string(a));
+    }
+    if (r < ARCHIVE_WARN) {
+        singularity_message(ERROR, "Error reading tar header: %s\n", archive_error_string(a));
+        ABORT(255);
+    }
+
+    return entry;
+}
+
+static void flatten_close(struct archive *a) {
+    archive_read_close(a);
+#if ARCHIVE_VERSION_NUMBER <= 3000000
+    archive_read_finish(a);
+#else
+    archive_read_free(a);
+#endif
+}
+
+/* flatten_links
+ *  Read tarfile again for the hidden files the deferred hard links of the
+ *  layer refer to. Only needed when a layer above replaces or removes a
+ *  file that has hard links, so nothing of it is kept while reading.
+ */
+static void flatten_links(struct flatten *state, const char *tarfile) {
+    struct archive *a;
+    struct archive_entry *entry;
+    struct flatten_link *link;
+    struct flatten_link *first;
+    char *path;
+
+    if (state->links == NULL) {
+        return;
+    }
+
+    a = flatten_open(tarfile);
+    while ((entry = flatten_next(a)) != NULL) {
+        if (archive_entry_filetype(entry) != AE_IFREG || archive_entry_hardlink(entry) != NULL) {
+            continue;
+        }
+
+        path = normalize_path(archive_entry_pathname(entry));
+        first = NULL;
+        for (link = state->links; link != NULL; link = link->next) {
+            if (link->written || strcmp(link->target, path) != 0) {
+                continue;
+            }
+            if (first == NULL) {
+                archive_entry_copy_pathname(entry, link->path);
+                flatten_write(state, a, entry);
+                first = link;
+            } else {
+                archive_entry_copy_pathname(entry, link->path);
+                archive_entry_copy_hardlink(entry, first->path);
+                archive_entry_set_size(entry, 0);
+                flatten_write(state, NULL, entry);
+            }
+            link->written = 1;
+        }
+        free(path);
+    }
+    flatten_close(a);
+}
+
+static void flatten_tar(struct flatten *state, const char *tarfile) {
+    struct archive *a;
+    struct archive_entry *entry;
+
+    a = flatten_open(tarfile);
+    while ((entry = flatten_next(a)) != NULL) {
+        flatten_entry(state, a, entry);
+    }
+    flatten_close(a);
+
+    flatten_links(state, tarfile);
+    flatten_layer_done(state);
+}
+
+/* flatten_rootfs
+ *  Add what is already in rootfs_dir (the Singularity environment and
+ *  metadata) below the lowest layer
+ */
+static void flatten_rootfs(struct flatten *state, char *rootfs_dir) {
+    struct archive *a;
+    struct archive_entry *entry;
+    char *orig_dir = get_current_dir_name();
+    int r;
+
+    if (chdir(rootfs_dir) < 0) {
+        singularity_message(ERROR, "Could not chdir to SINGULARITY_ROOTFS %s\n", rootfs_dir);
+        ABORT(255);
+    }
+
+    a = archive_read_disk_new();
+    archive_read_disk_set_standard_lookup(a);
+    archive_read_disk_set_symlink_physical(a);
+    if (archive_read_disk_open(a, ".") != ARCHIVE_OK) {
+        singularity_message(ERROR, "Error reading %s: %s\n", rootfs_dir, archive_error_string(a));
+        ABORT(255);
+    }
+
+    entry = archive_entry_new();
+    while ((r = archive_read_next_header2(a, entry)) != ARCHIVE_EOF) {
+        if (r < ARCHIVE_WARN) {
+            singularity_message(ERROR, "Error reading %s: %s\n", rootfs_dir, archive_error_string(a));
+            ABORT(255);
+        }
+        archive_read_disk_descend(a);
+        flatten_entry(state, a, entry);
+    }
+    archive_entry_free(entry);
+
+    archive_read_close(a);
+    archive_read_free(a);
+    flatten_link_free(state);
+
+    if (chdir(orig_dir) < 0) {
+        singularity_message(ERROR, "Could not chdir back to %s\n", orig_dir);
+        ABORT(255);
+    }
+    free(orig_dir);
+}
+
+/* flatten_layers
+ *  Write the merged contents of rootfs_dir and the ordered (lowest first)
+ *  list of layers as a tar stream to stdout, e.g. for 'mksquashfs - -tar'.
+ *  Whiteouts are applied on the fly so nothing is written to disk.
+ */
+static int flatten_layers(char **tarfiles, int count, char *rootfs_dir) {
+    struct flatten state;
+    int out_fd;
+    int i;
+
+    if (isatty(STDOUT_FILENO)) {
+        singularity_message(ERROR, "Refusing to write the tar stream to a terminal\n");
+        ABORT(255);
+    }
+
+    // Messages are printed to stdout, keep them out of the tar stream
+    if ((out_fd = dup(STDOUT_FILENO)) < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+        singularity_message(ERROR, "Could not redirect stdout: %s\n", strerror(errno));
+        ABORT(255);
+    }
+
+    memset(&state, 0, sizeof(state));
+    state.out = archive_write_new();
+    archive_write_set_format_pax_restricted(state.out);
+    if (archive_write_open_fd(state.out, out_fd) != ARCHIVE_OK) {
+        singularity_message(ERROR, "Could not open tar output: %s\n", archive_error_string(state.out));
+        ABORT(255);
+    }
+
+    for (i = count - 1; i >= 0; i--) {
+        singularity_message(INFO, "Flattening layer: %s\n", basename(tarfiles[i]));
+        flatten_tar(&state, tarfiles[i]);
+    }
+    flatten_rootfs(&state, rootfs_dir);
+
+    if (archive_write_close(state.out) != ARCHIVE_OK) {
+        singularity_message(ERROR, "Error writing tar output: %s\n", archive_error_string(state.out));
+        ABORT(255);
+    }
+    archive_write_free(state.out);
+    close(out_fd);
+
+    path_set_free(&state.written);
+    path_set_free(&state.deleted);
+    path_set_free(&state.opaque);
+
+    return 0;
+}
+#else
+static int flatten_layers(char **tarfiles, int count, char *rootfs_dir) {
+    singularity_message(ERROR, "docker-extract --flatten requires libarchive 3\n");
+    return -1;
+}
+#endif
+
 int main(int argc, char **argv) {
     int retval = 0;
-    char *rootfs_dir = singularity_registry_get("ROOTFS");
+    const char *rootfs_dir = singularity_registry_get("ROOTFS");
+    const char *workers_string = singularity_registry_get("EXTRACT_WORKERS");
+    const char *fix_perms_string = singularity_registry_get("FIX_PERMS");
     char *rootfs_realpath;
-    char *tarfile = NULL;
+    long int workers;
+    int flatten = 0;
+    int pipes = 0;
+    int i;
 
     // Set UTF8 locale so that libarchive doesn't produce warnings for UTF8
     // names - en_US.UTF-8 is most likely to be available
@@ -380,8 +1339,30 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (argc != 2) {
-        singularity_message(ERROR, "Provide a single docker tar file to extract\n");
+    // --flatten writes the merged layers to stdout instead of extracting
+    if (argc > 1 && strcmp(argv[1], "--flatten") == 0) {
+        flatten = 1;
+        argv++;
+        argc--;
+    }
+
+    if (argc < 2) {
+        singularity_message(ERROR, "Provide the docker tar files to extract, lowest layer first\n");
+        ABORT(255);
+    }
+
+    // Same values as the python helpers accept for SINGULARITY_FIX_PERMS
+    if (fix_perms_string != NULL) {
+        fix_perms = strcasecmp(fix_perms_string, "yes") == 0 || strcasecmp(fix_perms_string, "true") == 0 ||
+                    strcasecmp(fix_perms_string, "t") == 0 || strcasecmp(fix_perms_string, "y") == 0 ||
+                    strcmp(fix_perms_string, "1") == 0;
+    }
+
+    // Number of layers extracted at the same time, defaults to one per CPU
+    if (workers_string == NULL) {
+        workers = sysconf(_SC_NPROCESSORS_ONLN);
+    } else if (str2int(workers_string, &workers) < 0 || workers < 1) {
+        singularity_message(ERROR, "SINGULARITY_EXTRACT_WORKERS must be a positive integer: %s\n", workers_string);
         ABORT(255);
     }
 
@@ -409,23 +1390,32 @@ int main(int argc, char **argv) {
         ABORT(255);
     }
 
-    tarfile = argv[1];
-
-    if (is_file(tarfile) < 0) {
-        singularity_message(ERROR, "tar file does not exist: %s\n", tarfile);
-        ABORT(255);
+    // Layers can also be named pipes, which are fed while they download
+    for (i = 1; i < argc; i++) {
+        if (is_fifo(argv[i]) == 0) {
+            pipes++;
+        } else if (is_file(argv[i]) < 0) {
+            singularity_message(ERROR, "tar file does not exist: %s\n", argv[i]);
+            ABORT(255);
+        }
     }
 
-    singularity_message(DEBUG, "Applying whiteouts for tar file %s\n", tarfile);
-    retval = apply_whiteouts(tarfile, rootfs_realpath);
-
-    if (retval != 0) {
-        singularity_message(ERROR, "Error applying layer whiteouts\n");
-        ABORT(255);
+    // Every pipe needs a reader or the process feeding it blocks
+    if (pipes > 0 && !flatten && workers < argc - 1) {
+        singularity_message(VERBOSE, "Layers are streamed, extracting all %d at once\n", argc - 1);
+        workers = argc - 1;
     }
 
-    singularity_message(DEBUG, "Extracting docker tar file %s\n", tarfile);
-    retval = extract_tar(tarfile, rootfs_realpath);
+    if (flatten) {
+        retval = flatten_layers(&argv[1], argc - 1, rootfs_realpath);
+    } else if (argc == 2 || workers == 1) {
+        for (i = 1; i < argc && retval == 0; i++) {
+            singularity_message(INFO, "Exploding layer: %s\n", basename(argv[i]));
+            retval = extract_tar(argv[i], rootfs_realpath, NULL, NULL);
+        }
+    } else {
+        retval = extract_layers(&argv[1], argc - 1, workers > argc - 1 ? argc - 1 : workers, rootfs_realpath);
+    }
 
     if (retval != 0) {
         singularity_message(ERROR, "Error extracting tar file\n");
@@ -0,0 +1,108 @@
+/*
+ * Copyright (c) 2017-2018, SyLabs, Inc. All rights reserved.
+ * Copyright (c) 2017, SingularityWare, LLC. All rights reserved.
+ *
+ * See the COPYRIGHT.md file at the top-level directory of this distribution and at
+ * https://github.com/singularityware/singularity/blob/master/COPYRIGHT.md.
+ *
+ * This file is part of the Singularity Linux container project. It is subject to the license
+ * terms in the LICENSE.md file found in the top-level directory of this distribution and
+ * at https://github.com/singularityware/singularity/blob/master/LICENSE.md. No part
+ * of Singularity, including this file, may be copied, modified, propagated, or distributed
+ * except according to the terms contained in the LICENSE.md file.
+ *
+*/
+
+/*
+ * Microbenchmark for the two singularity_fork() child supervision paths. Not
+ * installed, build it with 'make fork-bench' and run it with the number of
+ * iterations, e.g.:
+ *
+ *   ./fork-bench 2000
+ *
+ * Each iteration runs this program again through singularity_fork_exec(),
+ * the exec'd copy reports when it reached main() over a pipe.
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include "config.h"
+#include "util/util.h"
+#include "util/fork.h"
+#include "util/message.h"
+
+
+static double now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return(ts.tv_sec + ts.tv_nsec / 1e9);
+}
+
+static void run(const char *name, int *stamp_fds, int iterations) {
+    char *argv[] = { "/proc/self/exe", "--stamp", int2str(stamp_fds[1]), NULL };
+    double exec_time = 0;
+    double total_time = 0;
+    int i;
+
+    for ( i = 0; i < iterations; i++ ) {
+        double start = now();
+        double stamp;
+
+        if ( singularity_fork_exec(0, argv) != 0 ) {
+            printf("%-8s child failed\n", name);
+            return;
+        }
+        total_time += now() - start;
+
+        if ( read(stamp_fds[0], &stamp, sizeof(stamp)) != sizeof(stamp) ) { // Flawfinder: ignore
+            printf("%-8s failed to read time stamp: %s\n", name, strerror(errno));
+            return;
+        }
+        exec_time += stamp - start;
+    }
+
+    printf("%-8s fork to exec %8.1f us, fork to reaped %8.1f us\n", name,
+            exec_time * 1e6 / iterations, total_time * 1e6 / iterations);
+}
+
+int main(int argc, char **argv) {
+    int iterations;
+    int fds[2];
+
+    if ( argc == 3 && strcmp(argv[1], "--stamp") == 0 ) {
+        double stamp = now();
+
+        return( write(atoi(argv[2]), &stamp, sizeof(stamp)) == sizeof(stamp) ? 0 : 1 );
+    }
+
+    iterations = argc > 1 ? atoi(argv[1]) : 1000;
+    if ( iterations <= 0 ) {
+        fprintf(stderr, "USAGE: %s [iterations]\n", argv[0]);
+        return(1);
+    }
+
+    if ( pipe(fds) < 0 ) {
+        fprintf(stderr, "Could not create pipe: %s\n", strerror(errno));
+        return(1);
+    }
+
+    // Keep debug output out of the measurement
+    setenv("SINGULARITY_MESSAGELEVEL", "1", 0);
+
+    printf("Running %d children\n", iterations);
+    run("pidfd", fds, iterations);
+    if ( singularity_fork_pidfd == 0 ) {
+        printf("pidfd    not supported by this kernel\n");
+    }
+    singularity_fork_pidfd = 0;
+    run("signals", fds, iterations);
+
+    return(0);
+}
@@ -32,6 +32,8 @@
 #include <string.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
+#include <dirent.h>
+#include <limits.h>
 
 #include "config.h"
 #include "lib/image/image.h"
@@ -48,15 +50,239 @@
 #define LO_FLAGS_AUTOCLEAR 4
 #endif
 
+#ifndef LO_FLAGS_READ_ONLY
+#define LO_FLAGS_READ_ONLY 1
+#endif
+
+#ifndef LOOP_SET_DIRECT_IO
+#define LOOP_SET_DIRECT_IO 0x4C08
+#endif
+
+#ifndef LOOP_CTL_GET_FREE
+#define LOOP_CTL_GET_FREE 0x4C82
+#endif
+
+#define LOOP_CONTROL "/dev/loop-control"
+
+// Bounds for the loop-control allocator. Another process may grab the
+// device returned by LOOP_CTL_GET_FREE before we attach to it, so we retry
+// with an exponential backoff (in microseconds) capped at LOOP_BACKOFF_MAX.
+#define LOOP_MAX_ATTEMPTS 32
+#define LOOP_BACKOFF_MIN 100
+#define LOOP_BACKOFF_MAX 50000
+
+#define SYSFS_BLOCK "/sys/block"
+
+struct loop_bind_stats {
+    int attempts;
+    int busy;
+};
+
+
+// Returns the file descriptor of /dev/loopN associated with the image, or
+// -1 with errno set. Must be called with escalated privileges.
+static int loop_attach(long int devnum, int image_fd, int open_flags) {
+    char *test_loopdev = strjoin("/dev/loop", int2str(devnum));
+    int loop_fd;
+
+    if ( is_blk(test_loopdev) < 0 ) {
+        singularity_message(DEBUG, "Instantiating loop device: %s\n", test_loopdev);
+        if ( mknod(test_loopdev, S_IFBLK | 0644, makedev(7, devnum)) < 0 ) {
+            if ( errno != EEXIST ) {
+                singularity_message(ERROR, "Could not create %s: %s\n", test_loopdev, strerror(errno));
+                ABORT(255);
+            }
+        }
+    }
+
+    if ( ( loop_fd = open(test_loopdev, open_flags) ) < 0 ) { // Flawfinder: ignore
+        int err = errno;
+        singularity_message(VERBOSE, "Could not open loop device %s: %s\n", test_loopdev, strerror(err));
+        free(test_loopdev);
+        errno = err;
+        return(-1);
+    }
+
+    if ( ioctl(loop_fd, LOOP_SET_FD, image_fd) < 0 ) {
+        int err = errno;
+        if ( err != EBUSY ) {
+            singularity_message(WARNING, "Could not associate image to loop %s: %s\n", test_loopdev, strerror(err));
+        }
+        close(loop_fd);
+        free(test_loopdev);
+        errno = err;
+        return(-1);
+    }
+
+    free(test_loopdev);
+    return(loop_fd);
+}
+
+// Look for a loop device that is already attached read-only to the same
+// file (device/inode) at the same offset. Reusing it means every concurrent
+// run of this image shares one block device, and therefore one squashfs or
+// ext3 superblock and page cache. The loop device is torn down by
+// LO_FLAGS_AUTOCLEAR when its last user goes away. Returns the device number
+// with *loop_fd opened, or -1. Must be called with escalated privileges.
+static long int loop_find_shared(struct image_object *image, int open_flags, int *loop_fd) {
+    struct stat image_stat;
+    struct dirent *dent;
+    DIR *dir;
+
+    if ( fstat(image->fd, &image_stat) < 0 ) {
+        singularity_message(DEBUG, "Could not stat image file descriptor: %s\n", strerror(errno));
+        return(-1);
+    }
+
+    if ( ( dir = opendir(SYSFS_BLOCK) ) == NULL ) {
+        singularity_message(DEBUG, "Could not open %s: %s\n", SYSFS_BLOCK, strerror(errno));
+        return(-1);
+    }
+
+    while ( ( dent = readdir(dir) ) != NULL ) {
+        struct loop_info64 lo64;
+        char backing_file[PATH_MAX];
+        char *backing_path;
+        char *loop_dev;
+        long int devnum;
+        FILE *fp;
+        int fd;
+
+        if ( strncmp(dent->d_name, "loop", 4) != 0 || str2int(dent->d_name + 4, &devnum) != 0 ) {
+            continue;
+        }
+
+        // Unbound loop devices have no loop/ attributes, so this skips them
+        backing_path = joinpath(SYSFS_BLOCK, strjoin(dent->d_name, "/loop/backing_file"));
+        if ( ( fp = fopen(backing_path, "r") ) == NULL ) { // Flawfinder: ignore
+            free(backing_path);
+            continue;
+        }
+        free(backing_path);
+
+        if ( fgets(backing_file, sizeof(backing_file), fp) == NULL ) {
+            fclose(fp);
+            continue;
+        }
+        fclose(fp);
+        chomp(backing_file);
+
+        if ( strcmp(backing_file, image->path) != 0 ) {
+            continue;
+        }
+
+        loop_dev = strjoin("/dev/", dent->d_name);
+        if ( ( fd = open(loop_dev, open_flags) ) < 0 ) { // Flawfinder: ignore
+            free(loop_dev);
+            continue;
+        }
+
+        // Holding the fd keeps the device from being autocleared, so verify
+        // it now that we can no longer race with its teardown
+        if ( ioctl(fd, LOOP_GET_STATUS64, &lo64) == 0 &&
+                lo64.lo_device == image_stat.st_dev &&
+                lo64.lo_inode == image_stat.st_ino &&
+                lo64.lo_offset == (unsigned long long)image->offset &&
+                ( lo64.lo_flags & LO_FLAGS_READ_ONLY ) &&
+                ( lo64.lo_flags & LO_FLAGS_AUTOCLEAR ) ) {
+            singularity_message(DEBUG, "Found loop device %s already attached to image\n", loop_dev);
+            free(loop_dev);
+            closedir(dir);
+            *loop_fd = fd;
+            return(devnum);
+        }
+
+        free(loop_dev);
+        close(fd);
+    }
+
+    closedir(dir);
+    return(-1);
+}
+
+// Ask the kernel for a free loop device via /dev/loop-control. Returns the
+// attached loop device number, or -1 if loop-control is not usable and the
+// caller should fall back to probing.
+static long int loop_bind_control(int image_fd, int open_flags, long int max_loop_devs, int *loop_fd, struct loop_bind_stats *stats) {
+    int backoff = LOOP_BACKOFF_MIN;
+    int ctl_fd;
+
+    if ( ( ctl_fd = open(LOOP_CONTROL, O_RDWR | O_CLOEXEC) ) < 0 ) { // Flawfinder: ignore
+        singularity_message(DEBUG, "Could not open %s, falling back to probing: %s\n", LOOP_CONTROL, strerror(errno));
+        return(-1);
+    }
+
+    while ( stats->attempts < LOOP_MAX_ATTEMPTS ) {
+        long int devnum;
+
+        stats->attempts++;
+
+        if ( ( devnum = ioctl(ctl_fd, LOOP_CTL_GET_FREE) ) < 0 ) {
+            singularity_message(DEBUG, "LOOP_CTL_GET_FREE failed, falling back to probing: %s\n", strerror(errno));
+            close(ctl_fd);
+            return(-1);
+        }
+
+        if ( devnum >= max_loop_devs ) {
+            singularity_message(ERROR, "No more available loop devices, try increasing '%s' in singularity.conf\n", MAX_LOOP_DEVS);
+            ABORT(255);
+        }
+
+        if ( ( *loop_fd = loop_attach(devnum, image_fd, open_flags) ) >= 0 ) {
+            close(ctl_fd);
+            return(devnum);
+        }
+
+        // Anything but EBUSY will not go away by retrying
+        if ( errno != EBUSY ) {
+            singularity_message(DEBUG, "Could not attach loop device %ld, falling back to probing: %s\n", devnum, strerror(errno));
+            close(ctl_fd);
+            return(-1);
+        }
+
+        // Lost the race for this device to another process, back off
+        stats->busy++;
+        singularity_message(DEBUG, "Loop device %ld was taken, retrying in %d usec\n", devnum, backoff);
+        usleep(backoff);
+        if ( ( backoff *= 2 ) > LOOP_BACKOFF_MAX ) {
+            backoff = LOOP_BACKOFF_MAX;
+        }
+    }
+
+    close(ctl_fd);
+    singularity_message(ERROR, "Failed to obtain a loop device after %d attempts\n", stats->attempts);
+    ABORT(255);
+    return(-1);
+}
+
+// Legacy allocator for kernels without /dev/loop-control
+static long int loop_bind_probe(int image_fd, int open_flags, long int max_loop_devs, int *loop_fd, struct loop_bind_stats *stats) {
+    long int i;
+
+    for( i=0; i < max_loop_devs; i++ ) {
+        stats->attempts++;
+        if ( ( *loop_fd = loop_attach(i, image_fd, open_flags) ) >= 0 ) {
+            return(i);
+        }
+        if ( errno == EBUSY ) {
+            stats->busy++;
+        }
+    }
+
+    return(-1);
+}
+
 
 char *singularity_image_bind(struct image_object *image) {
     struct loop_info64 lo64 = {0};
+    struct loop_bind_stats stats = {0, 0};
     long int max_loop_devs;
     const char *max_loop_devs_string = singularity_config_get_value(MAX_LOOP_DEVS);
     char *loop_dev = NULL;
+    long int loop_num;
     int loop_fd = -1;
     int loop_mount_opts;
-    int i;
+    int shared_lock = 0;
 
     singularity_message(DEBUG, "Entered singularity_image_bind()\n");
 
@@ -79,65 +305,81 @@ char *singularity_image_bind(struct image_object *image) {
         loop_mount_opts = O_RDWR;
     }
 
-    singularity_priv_escalate();
-    singularity_message(DEBUG, "Finding next available loop device...\n");
-    for( i=0; i < max_loop_devs; i++ ) {
-        char *test_loopdev = strjoin("/dev/loop", int2str(i));
-
-        if ( is_blk(test_loopdev) < 0 ) {
-            singularity_message(DEBUG, "Instantiating loop device: %s\n", test_loopdev);
-            if ( mknod(test_loopdev, S_IFBLK | 0644, makedev(7, i)) < 0 ) {
-                if ( errno != EEXIST ) {
-                    singularity_message(ERROR, "Could not create %s: %s\n", test_loopdev, strerror(errno));
-                    ABORT(255);
-                }
-            }
-        }
+    singularity_message(DEBUG, "Setting LO_FLAGS_AUTOCLEAR\n");
+    lo64.lo_flags = LO_FLAGS_AUTOCLEAR;
 
-        if ( ( loop_fd = open(test_loopdev, loop_mount_opts) ) < 0 ) { // Flawfinder: ignore
-            singularity_message(VERBOSE, "Could not open loop device %s: %s\n", test_loopdev, strerror(errno));
-            continue;
-        }
+    singularity_message(DEBUG, "Using image offset: %d\n", image->offset);
+    lo64.lo_offset = image->offset;
 
-        if ( ioctl(loop_fd, LOOP_SET_FD, image->fd)== 0 ) {
-            loop_dev = strdup(test_loopdev);
-            break;
+    if ( image->writable <= 0 && singularity_config_get_bool(SHARED_LOOP_DEVICES) > 0 ) {
+        // Serialize lookup and attach between processes binding this image,
+        // otherwise concurrent first runs would each attach their own device
+        singularity_message(DEBUG, "Obtaining lock on image to look for a shared loop device\n");
+        if ( flock(image->fd, LOCK_EX) == 0 ) {
+            shared_lock = 1;
         } else {
-            if ( errno == EBUSY ) {
-                close(loop_fd);
-                continue;
-            } else {
-                singularity_message(WARNING, "Could not associate image to loop %s: %s\n", test_loopdev, strerror(errno));
-                close(loop_fd);
-                continue;
+            singularity_message(VERBOSE, "Could not lock image, not sharing loop devices: %s\n", strerror(errno));
+        }
+    }
+
+    singularity_priv_escalate();
+    if ( shared_lock == 1 ) {
+        if ( ( loop_num = loop_find_shared(image, loop_mount_opts, &loop_fd) ) >= 0 ) {
+            singularity_priv_drop();
+            flock(image->fd, LOCK_UN);
+
+            loop_dev = strjoin("/dev/loop", int2str(loop_num));
+            singularity_message(VERBOSE, "Sharing loop device already attached to image: %s\n", loop_dev);
+
+            if ( fcntl(loop_fd, F_SETFD, FD_CLOEXEC) != 0 ) {
+                singularity_message(ERROR, "Could not set file descriptor flag to close on exit: %s\n", strerror(errno));
+                ABORT(255);
             }
+
+            return(loop_dev);
         }
+    }
 
+    singularity_message(DEBUG, "Finding next available loop device...\n");
+    if ( ( loop_num = loop_bind_control(image->fd, loop_mount_opts, max_loop_devs, &loop_fd, &stats) ) < 0 ) {
+        loop_num = loop_bind_probe(image->fd, loop_mount_opts, max_loop_devs, &loop_fd, &stats);
     }
-    singularity_priv_drop();
 
-    if ( loop_dev == NULL ) {
+    if ( loop_num < 0 ) {
         singularity_message(ERROR, "No more available loop devices, try increasing '%s' in singularity.conf\n", MAX_LOOP_DEVS);
         ABORT(255);
     }
 
-    singularity_message(VERBOSE, "Found available loop device: %s\n", loop_dev);
-
-    singularity_message(DEBUG, "Setting LO_FLAGS_AUTOCLEAR\n");
-    lo64.lo_flags = LO_FLAGS_AUTOCLEAR;
-
-    singularity_message(DEBUG, "Using image offset: %d\n", image->offset);
-    lo64.lo_offset = image->offset;
-
-    singularity_priv_escalate();
     singularity_message(DEBUG, "Setting loop device flags\n");
     if ( ioctl(loop_fd, LOOP_SET_STATUS64, &lo64) < 0 ) {
         singularity_message(ERROR, "Failed to set loop flags on loop device: %s\n", strerror(errno));
         (void)ioctl(loop_fd, LOOP_CLR_FD, 0);
         ABORT(255);
     }
+
+    // Direct I/O keeps the backing file out of the page cache so image data
+    // is only cached once, by the file system mounted on the loop device.
+    // Kernels before 4.4, some backing file systems, and offsets that are
+    // not block aligned reject it, in which case we stay in buffered mode.
+    if ( singularity_config_get_bool(LOOP_DIRECT_IO) > 0 ) {
+        if ( ioctl(loop_fd, LOOP_SET_DIRECT_IO, 1) == 0 ) {
+            singularity_message(DEBUG, "Using direct I/O mode for loop device\n");
+        } else {
+            singularity_message(DEBUG, "Direct I/O rejected (%s), using buffered mode for loop device\n", strerror(errno));
+        }
+    } else {
+        singularity_message(DEBUG, "Using buffered mode for loop device\n");
+    }
     singularity_priv_drop();
 
+    if ( shared_lock == 1 ) {
+        flock(image->fd, LOCK_UN);
+    }
+
+    loop_dev = strjoin("/dev/loop", int2str(loop_num));
+
+    singularity_message(VERBOSE, "Loop device allocation took %d attempt(s), %d busy\n", stats.attempts, stats.busy);
+
     singularity_message(VERBOSE, "Using loop device: %s\n", loop_dev);
 
     if ( fcntl(loop_fd, F_SETFD, FD_CLOEXEC) != 0 ) {
@@ -25,7 +25,7 @@
 #ifndef __SINGULARITY_IMAGE_DIR_H_
 #define __SINGULARITY_IMAGE_DIR_H_
 
-extern int _singularity_image_dir_init(struct image_object *image, int open_flags);
+extern int _singularity_image_dir_init(struct image_object *image, struct image_header *header, int open_flags);
 extern int _singularity_image_dir_mount(struct image_object *image, char *mount_point);
 
 #endif /* __SINGULARITY_IMAGE_DIR_H_ */
@@ -37,29 +37,13 @@
 
 #include "../image.h"
 
-int _singularity_image_dir_init(struct image_object *image, int open_flags) {
-    int fd = -1;
-    struct stat st;
+int _singularity_image_dir_init(struct image_object *image, struct image_header *header, int open_flags) {
 
-    singularity_message(DEBUG, "Opening file descriptor to directory: %s\n", image->path);
-    if ( ( fd = open(image->path, O_RDONLY, 0755) ) < 0 ) {
-        singularity_message(ERROR, "Could not open image %s: %s\n", image->path, strerror(errno));
-        ABORT(255);
-    }
-
-    if ( fstat(fd, &st) != 0 ) {
-        singularity_message(ERROR, "Could not stat file descriptor: %s\n", strerror(errno));
-        ABORT(255);
-    }
-
-    if ( S_ISDIR(st.st_mode) == 0 ) {
+    if ( S_ISDIR(header->st.st_mode) == 0 ) {
         singularity_message(DEBUG, "This is not a directory based image\n");
-        close(fd);
         return(-1);
     }
 
     // If we got here, we assume things are a directory
-    image->fd = fd;
-
     return(0);
 }
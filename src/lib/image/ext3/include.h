@@ -25,7 +25,7 @@
 #ifndef __SINGULARITY_IMAGE_EXT3_H_
 #define __SINGULARITY_IMAGE_EXT3_H_
 
-extern int _singularity_image_ext3_init(struct image_object *image, int open_flags);
+extern int _singularity_image_ext3_init(struct image_object *image, struct image_header *header, int open_flags);
 extern int _singularity_image_ext3_mount(struct image_object *image, char *mount_point);
 
 #endif /* __SINGULARITY_IMAGE_EXT3_H_ */
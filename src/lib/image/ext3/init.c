@@ -64,76 +64,46 @@ struct extfs_info {
 };
 
 
-int _singularity_image_ext3_init(struct image_object *image, int open_flags) {
-    int image_fd;
-    int ret;
+int _singularity_image_ext3_init(struct image_object *image, struct image_header *header, int open_flags) {
+    int offset;
     int magicoff = 1080;
-    FILE *image_fp;
-    static char buf[2048];
     struct extfs_info *einfo;
 
-    singularity_message(DEBUG, "Opening file descriptor to image: %s\n", image->path);
-    if ( ( image_fd = open(image->path, open_flags, 0755) ) < 0 ) {
-        singularity_message(ERROR, "Could not open image %s: %s\n", image->path, strerror(errno));
-        ABORT(255);
-    }
-
-    if ( ( image_fp = fdopen(dup(image_fd), "r") ) == NULL ) {
-        singularity_message(ERROR, "Could not associate file pointer from file descriptor on image %s: %s\n", image->path, strerror(errno));
-        ABORT(255);
-    }
-
-
-    singularity_message(VERBOSE3, "Checking that file pointer is a Singularity image\n");
-    rewind(image_fp);
-
-    // Get the first line from the config
-    buf[sizeof(buf)-1] = '\0';
-    ret = fread(buf, 1, sizeof(buf)-1, image_fp);
-    fclose(image_fp);
-    if ( ret != sizeof(buf)-1 ) {
-        singularity_message(DEBUG, "Could not read the top of the image\n");
+    if ( S_ISREG(header->st.st_mode) == 0 ) {
         return(-1);
     }
 
     /* if LAUNCH_STRING is present, figure out EXTFS magic offset */
-    if ( strstr(buf, "singularity") != NULL ) {
-        magicoff += strlen(buf);
-        image->offset = strlen(buf);
-    }
+    offset = singularity_image_header_offset(header);
+    magicoff += offset;
 
-    if ( ( magicoff + sizeof(struct extfs_info) ) > ( sizeof(buf)-1 ) ) {
-        close(image_fd);
-        singularity_message(VERBOSE, "Can not find EXT3 information header");
+    if ( ( magicoff + sizeof(struct extfs_info) ) > header->len ) {
+        singularity_message(VERBOSE, "Can not find EXT3 information header\n");
         return(-1);
     }
 
-    einfo = (struct extfs_info *)&buf[magicoff];
+    einfo = (struct extfs_info *)&header->buf[magicoff];
     if ( memcmp(einfo->magic, EXTFS_MAGIC, 2 ) != 0 ) {
-        close(image_fd);
         singularity_message(VERBOSE, "File is not a valid EXT3 image\n");
         return(-1);
     }
     /* Check for features supported by EXT3 */
     if ( !(einfo->feat_compat & COMPAT_HASJOURNAL) ) {
-        close(image_fd);
         singularity_message(VERBOSE, "File is not a valid EXT3 image\n");
         return(-1);
     }
     /* check for unsupported incompat ext3 features */
     if ( einfo->feat_incompat & ~(INCOMPAT_FILETYPE|INCOMPAT_RECOVER|INCOMPAT_METABG) ) {
-        close(image_fd);
         singularity_message(VERBOSE, "File is not a valid EXT3 image\n");
         return(-1);
     }
     /* check for unsupported rocompat ext3 features */
     if ( einfo->feat_rocompat & ~(ROCOMPAT_SPARSESUPER|ROCOMPAT_LARGEFILE|ROCOMPAT_BTREEDIR) ) {
-        close(image_fd);
         singularity_message(VERBOSE, "File is not a valid EXT3 image\n");
         return(-1);
     }
 
-    image->fd = image_fd;
+    image->offset = offset;
 
     return(0);
 }
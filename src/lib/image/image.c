@@ -31,8 +31,6 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <stdlib.h>
-#include <grp.h>
-#include <pwd.h>
 #include <libgen.h>
 
 #include "util/file.h"
@@ -45,15 +43,82 @@
 
 #include "./image.h"
 #include "./bind.h"
+#include "./stage.h"
 #include "./squashfs/include.h"
 #include "./dir/include.h"
 #include "./ext3/include.h"
 
 
-struct image_object singularity_image_init(char *path, int open_flags) {
+// Image format modules, probed in order against the image header. Adding a
+// new format only needs its init/mount module and an entry here.
+struct image_format {
+    int type;
+    char *name;
+    int (*init)(struct image_object *image, struct image_header *header, int open_flags);
+    int (*mount)(struct image_object *image, char *mount_point);
+    const char *allow_key;
+    int allow_default;
+};
+
+static struct image_format image_formats[] = {
+    { DIRECTORY, "directory", _singularity_image_dir_init, _singularity_image_dir_mount, ALLOW_CONTAINER_DIR, ALLOW_CONTAINER_DIR_DEFAULT },
+    { SQUASHFS, "squashfs", _singularity_image_squashfs_init, _singularity_image_squashfs_mount, ALLOW_CONTAINER_SQUASHFS, ALLOW_CONTAINER_SQUASHFS_DEFAULT },
+    { EXT3, "ext3", _singularity_image_ext3_init, _singularity_image_ext3_mount, ALLOW_CONTAINER_EXTFS, ALLOW_CONTAINER_EXTFS_DEFAULT },
+    { 0, NULL, NULL, NULL, NULL, 0 }
+};
+
+
+// Returns the length of the launch script line at the top of the image (see
+// LAUNCH_STRING), which is where the file system begins, or 0 if none.
+int singularity_image_header_offset(struct image_header *header) {
+    char *eol;
+
+    if ( header->len < 2 || strncmp(header->buf, "#!", 2) != 0 ) {
+        return(0);
+    }
+
+    if ( ( eol = memchr(header->buf, '\n', header->len) ) == NULL ) {
+        return(0);
+    }
+
+    return(eol - header->buf + 1);
+}
+
+
+// Reopen the probed image with open_flags, making sure it is still the same
+// file that was identified.
+static int image_reopen(struct image_object *image, struct image_header *header, int open_flags) {
+    struct stat st;
+    char *fd_path = joinpath("/proc/self/fd", int2str(image->fd));
+    int fd;
+
+    singularity_message(DEBUG, "Reopening image for writing: %s\n", image->path);
+    if ( ( fd = open(fd_path, open_flags, 0755) ) < 0 && errno == ENOENT ) { // Flawfinder: ignore
+        fd = open(image->path, open_flags, 0755); // Flawfinder: ignore
+    }
+    free(fd_path);
+
+    if ( fd < 0 ) {
+        singularity_message(ERROR, "Could not open image %s: %s\n", image->path, strerror(errno));
+        ABORT(255);
+    }
+    if ( fstat(fd, &st) != 0 || st.st_dev != header->st.st_dev || st.st_ino != header->st.st_ino ) {
+        singularity_message(ERROR, "Image %s changed while it was being opened\n", image->path);
+        ABORT(255);
+    }
+
+    close(image->fd);
+    return(fd);
+}
+
+
+struct image_object singularity_image_init(const char *path, int open_flags) {
     struct image_object image;
-    char *urip;
+    struct image_header header;
+    struct image_format *format;
+    const char *urip;
     char *real_path;
+    int readonly_error = 0;
 
     if ( path == NULL ) {
         singularity_message(ERROR, "No container image path defined\n");
@@ -63,8 +128,7 @@ struct image_object singularity_image_init(char *path, int open_flags) {
     urip = strstr(path, "://");
 
     if (urip != NULL) {
-        *(urip + 3) = '\0';
-        singularity_message(ERROR, "Image paths beginning with %s are not supported\n", path);
+        singularity_message(ERROR, "Image paths beginning with %.*s are not supported\n", (int)(urip + 3 - path), path);
         ABORT(255);
     }
 
@@ -87,37 +151,59 @@ struct image_object singularity_image_init(char *path, int open_flags) {
         image.writable = 0;
     }
 
-    singularity_message(DEBUG, "Calling image_init for each file system module\n");
-    if ( _singularity_image_dir_init(&image, open_flags) == 0 ) {
-        singularity_message(DEBUG, "got image_init type for directory\n");
-        image.type = DIRECTORY;
-        if ( ( singularity_config_get_bool(ALLOW_CONTAINER_DIR) <= 0 ) && ( singularity_priv_getuid() != 0 ) ) {
-            singularity_message(ERROR, "Configuration disallows users from running directory based containers\n");
-            ABORT(255);
-        }
-    } else if ( _singularity_image_squashfs_init(&image, open_flags) == 0 ) {
-        singularity_message(DEBUG, "got image_init type for squashfs\n");
-        image.type = SQUASHFS;
-        if ( ( singularity_config_get_bool(ALLOW_CONTAINER_SQUASHFS) <= 0 ) && ( singularity_priv_getuid() != 0 ) ) {
-            singularity_message(ERROR, "Configuration disallows users from running squashFS based containers\n");
+    // Probe read only, formats that can't be written report EROFS below
+    // before we ask for write access
+    singularity_message(DEBUG, "Opening file descriptor to image: %s\n", image.path);
+    if ( ( image.fd = open(image.path, O_RDONLY, 0755) ) < 0 ) { // Flawfinder: ignore
+        singularity_message(ERROR, "Could not open image %s: %s\n", image.path, strerror(errno));
+        ABORT(255);
+    }
+
+    if ( fstat(image.fd, &header.st) != 0 ) {
+        singularity_message(ERROR, "Could not stat file descriptor: %s\n", strerror(errno));
+        ABORT(255);
+    }
+
+    header.len = 0;
+    if ( S_ISREG(header.st.st_mode) ) {
+        singularity_message(VERBOSE3, "Reading the top of the image to identify its format\n");
+        if ( ( header.len = pread(image.fd, header.buf, sizeof(header.buf), 0) ) < 0 ) {
+            singularity_message(ERROR, "Could not read the top of the image %s: %s\n", image.path, strerror(errno));
             ABORT(255);
         }
-    } else if ( _singularity_image_ext3_init(&image, open_flags) == 0 ) {
-        singularity_message(DEBUG, "got image_init type for ext3\n");
-        image.type = EXT3;
-        if ( ( singularity_config_get_bool(ALLOW_CONTAINER_EXTFS) <= 0 ) && ( singularity_priv_getuid() != 0 ) ) {
-            singularity_message(ERROR, "Configuration disallows users from running extFS based containers\n");
-            ABORT(255);
+    }
+
+    singularity_message(DEBUG, "Calling image_init for each file system module\n");
+    for ( format = image_formats; format->name != NULL; format++ ) {
+        errno = 0;
+        if ( format->init(&image, &header, open_flags) == 0 ) {
+            break;
         }
-    } else {
         if ( errno == EROFS ) {
-            singularity_message(ERROR, "Unable to open squashfs image in read-write mode: %s\n", strerror(errno));
+            readonly_error = 1;
+        }
+    }
+
+    if ( format->name == NULL ) {
+        if ( readonly_error == 1 ) {
+            singularity_message(ERROR, "Unable to open squashfs image in read-write mode: %s\n", strerror(EROFS));
         } else {
             singularity_message(ERROR, "Unknown image format/type: %s\n", path);
         }
         ABORT(255);
     }
 
+    singularity_message(DEBUG, "got image_init type for %s\n", format->name);
+    image.type = format->type;
+    if ( ( _singularity_config_get_bool_impl(format->allow_key, format->allow_default) <= 0 ) && ( singularity_priv_getuid() != 0 ) ) {
+        singularity_message(ERROR, "Configuration disallows users from running %s based containers\n", format->name);
+        ABORT(255);
+    }
+
+    if ( image.writable == 1 && S_ISREG(header.st.st_mode) ) {
+        image.fd = image_reopen(&image, &header, open_flags);
+    }
+
     if ( fcntl(image.fd, F_SETFD, FD_CLOEXEC) != 0 ) {
         singularity_message(ERROR, "Failed to set CLOEXEC on image file descriptor\n");
         ABORT(255);
@@ -161,24 +247,25 @@ int singularity_image_writable(struct image_object *image) {
 }
 
 int singularity_image_mount(struct image_object *image, char *mount_point) {
+    struct image_format *format;
+
     if ( singularity_registry_get("DAEMON_JOIN") ) {
         singularity_message(ERROR, "Internal Error - This function should not be called when joining an instance\n");
     }
 
+    // Run from a node local copy if this image is configured for staging
+    singularity_image_stage(image);
+
     singularity_message(DEBUG, "Figuring out which mount module to use...\n");
-    if ( image->type == SQUASHFS ) {
-        singularity_message(DEBUG, "Calling squashfs_mount\n");
-        return(_singularity_image_squashfs_mount(image, mount_point));
-    } else if ( image->type == DIRECTORY ) {
-        singularity_message(DEBUG, "Calling dir_mount\n");
-        return(_singularity_image_dir_mount(image, mount_point));
-    } else if ( image->type == EXT3 ) {
-        singularity_message(DEBUG, "Calling ext3_mount\n");
-        return(_singularity_image_ext3_mount(image, mount_point));
-    } else {
-        singularity_message(ERROR, "Can not mount file system of unknown type\n");
-        ABORT(255);
+    for ( format = image_formats; format->name != NULL; format++ ) {
+        if ( format->type == image->type ) {
+            singularity_message(DEBUG, "Calling %s mount\n", format->name);
+            return(format->mount(image, mount_point));
+        }
     }
+
+    singularity_message(ERROR, "Can not mount file system of unknown type\n");
+    ABORT(255);
     return(-1);
 }
 
@@ -187,10 +274,9 @@ void singularity_limit_container_owners(struct image_object *image) {
 
     if ( strcmp(limit_container_owners, "NULL") != 0 ) {
         struct stat image_stat;
-        char *user_token = NULL;
-        char *current = strtok_r(strdup(limit_container_owners), ",", &user_token);
-
-        chomp(current);
+        const uint32_t *uids;
+        int count;
+        int i;
 
         singularity_message(DEBUG, "Limiting container access to allowed users\n");
 
@@ -199,30 +285,16 @@ void singularity_limit_container_owners(struct image_object *image) {
             ABORT(255);
         }
 
-        while (1) {
-            struct passwd *user_pw;
-
-            if ( current[0] == '\0' ) {
-                singularity_message(DEBUG, "Skipping blank user limit entry\n");
-            } else {
-                singularity_message(DEBUG, "Checking user: '%s'\n", current);
-
-                if ( ( user_pw = getpwnam(current) ) != NULL ) {
-                    if ( user_pw->pw_uid == image_stat.st_uid ) {
-                        singularity_message(DEBUG, "Singularity image is owned by required user: %s\n", current);
-                        break;
-                    }
-                }
-            }
-
-            current = strtok_r(NULL, ",", &user_token);
-            chomp(current);
-
-            if ( current == NULL ) {
-                singularity_message(ERROR, "Singularity image is not owned by required user(s)\n");
-                ABORT(255);
+        count = singularity_config_get_uids(LIMIT_CONTAINER_OWNERS, &uids);
+        for ( i = 0; i < count; i++ ) {
+            if ( uids[i] == image_stat.st_uid ) {
+                singularity_message(DEBUG, "Singularity image is owned by required user: %d\n", uids[i]);
+                return;
             }
         }
+
+        singularity_message(ERROR, "Singularity image is not owned by required user(s)\n");
+        ABORT(255);
     }
 }
 
@@ -231,10 +303,9 @@ void singularity_limit_container_groups(struct image_object *image) {
 
     if ( strcmp(limit_container_groups, "NULL") != 0 ) {
         struct stat image_stat;
-        char *group_token = NULL;
-        char *current = strtok_r(strdup(limit_container_groups), ",", &group_token);
-
-        chomp(current);
+        const uint32_t *gids;
+        int count;
+        int i;
 
         singularity_message(DEBUG, "Limiting container access to allowed groups\n");
 
@@ -243,30 +314,16 @@ void singularity_limit_container_groups(struct image_object *image) {
             ABORT(255);
         }
 
-        while (1) {
-            struct group *group;
-
-            if ( current[0] == '\0' ) {
-                singularity_message(DEBUG, "Skipping blank group limit entry\n");
-            } else {
-                singularity_message(DEBUG, "Checking group: '%s'\n", current);
-
-                if ( ( group = getgrnam(current) ) != NULL ) {
-                    if ( group->gr_gid == image_stat.st_gid ) {
-                        singularity_message(DEBUG, "Singularity image is owned by required group: %s\n", current);
-                        break;
-                    }
-                }
-            }
-
-            current = strtok_r(NULL, ",", &group_token);
-            chomp(current);
-
-            if ( current == NULL ) {
-                singularity_message(ERROR, "Singularity image is not owned by required group(s)\n");
-                ABORT(255);
+        count = singularity_config_get_gids(LIMIT_CONTAINER_GROUPS, &gids);
+        for ( i = 0; i < count; i++ ) {
+            if ( gids[i] == image_stat.st_gid ) {
+                singularity_message(DEBUG, "Singularity image is owned by required group: %d\n", gids[i]);
+                return;
             }
         }
+
+        singularity_message(ERROR, "Singularity image is not owned by required group(s)\n");
+        ABORT(255);
     }
 }
 
@@ -25,10 +25,15 @@
 #ifndef __SINGULARITY_IMAGE_H_
 #define __SINGULARITY_IMAGE_H_
 
+#include <sys/stat.h>
+
 #define SQUASHFS    1
 #define EXT3        2
 #define DIRECTORY   3
 
+// Large enough to hold the launch script and the ext3 superblock
+#define IMAGE_HEADER_SIZE 2048
+
 struct image_object {
     char *path;
     char *name;
@@ -39,11 +44,20 @@ struct image_object {
     int writable;
 };
 
-extern struct image_object singularity_image_init(char *path, int open_flags);
+// The top of the image, read once by singularity_image_init() and handed to
+// each format module in turn to see if it recognizes the image.
+struct image_header {
+    struct stat st;
+    char buf[IMAGE_HEADER_SIZE];
+    int len;
+};
+
+extern struct image_object singularity_image_init(const char *path, int open_flags);
 int singularity_image_fd(struct image_object *object);
 char *singularity_image_loopdev(struct image_object *object);
 char *singularity_image_name(struct image_object *object);
 char *singularity_image_path(struct image_object *object);
+int singularity_image_header_offset(struct image_header *header);
 char *singularity_image_bind(struct image_object *object);
 int singularity_image_writable(struct image_object *object);
 int singularity_image_type(struct image_object *object);
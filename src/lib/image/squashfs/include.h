@@ -25,7 +25,7 @@
 #ifndef __SINGULARITY_IMAGE_SQUASHFS_H_
 #define __SINGULARITY_IMAGE_SQUASHFS_H_
 
-extern int _singularity_image_squashfs_init(struct image_object *image, int open_flags);
+extern int _singularity_image_squashfs_init(struct image_object *image, struct image_header *header, int open_flags);
 extern int _singularity_image_squashfs_mount(struct image_object *image, char *mount_point);
 
 #endif /* __SINGULARITY_IMAGE_SQUASHFS_H_ */
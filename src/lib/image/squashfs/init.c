@@ -28,7 +28,7 @@
 #include <sys/types.h>
 #include <errno.h> 
 #include <string.h>
-#include <fcntl.h>  
+#include <fcntl.h>
 
 #include "util/message.h"
 #include "util/util.h"
@@ -36,55 +36,32 @@
 
 #include "../image.h"
 
-int _singularity_image_squashfs_init(struct image_object *image, int open_flags) {
-    int image_fd;
-    int ret;
-    FILE *image_fp;
-    static char buf[1024];
-    char *p;
+#define SQUASHFS_MAGIC "hsqs"
 
-    singularity_message(DEBUG, "Checking if writable image requested\n");
-    if ( open_flags == O_RDWR ) {
-        errno = EROFS;
-        return(-1);
-    }
-    
-    singularity_message(DEBUG, "Opening file descriptor to image: %s\n", image->path);
-    if ( ( image_fd = open(image->path, open_flags, 0755) ) < 0 ) {
-        singularity_message(ERROR, "Could not open image %s: %s\n", image->path, strerror(errno));
-        ABORT(255);
-    }
-
-    if ( ( image_fp = fdopen(dup(image_fd), "r") ) == NULL ) {
-        singularity_message(ERROR, "Could not associate file pointer from file descriptor on image %s: %s\n", image->path, strerror(errno));
-        ABORT(255);
-    }
+int _singularity_image_squashfs_init(struct image_object *image, struct image_header *header, int open_flags) {
+    int offset;
 
-    singularity_message(VERBOSE3, "Checking that file pointer is a Singularity image\n");
-    rewind(image_fp);
-
-    // Get the first line from the config
-    ret = fread(buf, 1, sizeof(buf), image_fp);
-    fclose(image_fp);
-    if ( ret != sizeof(buf) ) {
-        singularity_message(DEBUG, "Could not read the top of the image\n");
+    if ( S_ISREG(header->st.st_mode) == 0 ) {
         return(-1);
     }
 
     singularity_message(DEBUG, "Checking for magic in the top of the file\n");
 
-    /* if LAUNCH_STRING is present, figure out squashfs magic offset */
-    p = strstr(buf, "hsqs");
-    if ( p != NULL ) {
-        singularity_message(VERBOSE2, "File is a valid SquashFS image\n");
-        image->offset = p - buf;
-    } else {
-        close(image_fd);
+    /* if LAUNCH_STRING is present, squashfs magic follows it */
+    offset = singularity_image_header_offset(header);
+    if ( offset + 4 > header->len || memcmp(&header->buf[offset], SQUASHFS_MAGIC, 4) != 0 ) {
         singularity_message(VERBOSE, "File is not a valid SquashFS image\n");
         return(-1);
     }
 
-    image->fd = image_fd;
+    singularity_message(DEBUG, "Checking if writable image requested\n");
+    if ( ( open_flags & ( O_RDWR | O_WRONLY ) ) != 0 ) {
+        errno = EROFS;
+        return(-1);
+    }
+
+    singularity_message(VERBOSE2, "File is a valid SquashFS image\n");
+    image->offset = offset;
 
     return(0);
 }
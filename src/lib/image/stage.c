@@ -0,0 +1,518 @@
+/*
+ * Copyright (c) 2017-2018, SyLabs, Inc. All rights reserved.
+ * Copyright (c) 2017, SingularityWare, LLC. All rights reserved.
+ *
+ * Copyright (c) 2015-2017, Gregory M. Kurtzer. All rights reserved.
+ *
+ * Copyright (c) 2016-2017, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This software is licensed under a customized 3-clause BSD license.  Please
+ * consult LICENSE file distributed with the sources of this project regarding
+ * your rights to use or distribute this software.
+ *
+ * NOTICE.  This Software was developed under funding from the U.S. Department of
+ * Energy and the U.S. Government consequently retains certain rights. As such,
+ * the U.S. Government has been granted for itself and others acting on its
+ * behalf a paid-up, nonexclusive, irrevocable, worldwide license in the Software
+ * to reproduce, distribute copies to the public, prepare derivative works, and
+ * perform publicly and display publicly, and to permit other to do so.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <fcntl.h>
+#include <limits.h>
+
+#include "config.h"
+#include "util/util.h"
+#include "util/file.h"
+#include "util/message.h"
+#include "util/privilege.h"
+#include "util/config_parser.h"
+
+#include "./image.h"
+#include "./stage.h"
+
+#define STAGE_BUFFER_SIZE (1024*1024)
+#define STAGE_MAX_ENTRIES 1024
+
+
+struct stage_entry {
+    char *key;
+    off_t size;
+    time_t used;
+};
+
+
+// Return 1 if path is below one of the 'stage image from' prefixes
+static int stage_path_match(char *path) {
+    const char **prefix_list = singularity_config_get_value_multi(STAGE_IMAGE_FROM);
+
+    while ( *prefix_list != NULL ) {
+        char *prefix = strdup(*prefix_list);
+        int len;
+
+        prefix_list++;
+        chomp(prefix);
+        len = strlength(prefix, PATH_MAX);
+
+        if ( len > 0 && strncmp(path, prefix, len) == 0 &&
+                ( prefix[len-1] == '/' || path[len] == '/' || path[len] == '\0' ) ) {
+            singularity_message(DEBUG, "Image %s is under stage prefix %s\n", path, prefix);
+            free(prefix);
+            return(1);
+        }
+        free(prefix);
+    }
+
+    return(0);
+}
+
+static char *stage_path(const char *stage_dir, const char *key, const char *suffix) {
+    char *file = strjoin((char *)key, (char *)suffix);
+    char *ret = joinpath(stage_dir, file);
+
+    free(file);
+    return(ret);
+}
+
+// FNV-1a over the first size bytes of fd. Returns 0 and sets *checksum if
+// exactly size bytes could be read.
+static int stage_checksum(int fd, off_t size, uint64_t *checksum) {
+    char *buf = (char *) malloc(STAGE_BUFFER_SIZE);
+    uint64_t hash = FNV1A_INIT;
+    off_t pos = 0;
+    ssize_t len;
+
+    while ( ( len = pread(fd, buf, STAGE_BUFFER_SIZE, pos) ) > 0 ) {
+        hash = fnv1a(hash, (unsigned char *)buf, len);
+        pos += len;
+    }
+    free(buf);
+
+    if ( len < 0 || pos != size ) {
+        return(-1);
+    }
+
+    *checksum = hash;
+    return(0);
+}
+
+// Write the identity of a file (size, times, device and inode) as one line
+static void stage_stat_write(FILE *fp, struct stat *st) {
+    fprintf(fp, "%lld %lld %lld %lld %lld %llu %llu\n", (long long)st->st_size,
+            (long long)st->st_mtim.tv_sec, (long long)st->st_mtim.tv_nsec,
+            (long long)st->st_ctim.tv_sec, (long long)st->st_ctim.tv_nsec,
+            (unsigned long long)st->st_dev, (unsigned long long)st->st_ino);
+}
+
+// Returns 0 if the next line of fp is the identity of st
+static int stage_stat_match(FILE *fp, struct stat *st) {
+    long long size, mtime, mtime_nsec, ctime, ctime_nsec;
+    unsigned long long dev, ino;
+
+    if ( fscanf(fp, "%lld %lld %lld %lld %lld %llu %llu\n", &size, &mtime, &mtime_nsec, &ctime, &ctime_nsec, &dev, &ino) != 7 ) {
+        return(-1);
+    }
+
+    if ( size != st->st_size || mtime != st->st_mtim.tv_sec || mtime_nsec != st->st_mtim.tv_nsec ||
+            ctime != st->st_ctim.tv_sec || ctime_nsec != st->st_ctim.tv_nsec ||
+            dev != (unsigned long long)st->st_dev || ino != (unsigned long long)st->st_ino ) {
+        return(-1);
+    }
+
+    return(0);
+}
+
+// Returns a read only fd to the staged copy if it was made from the same
+// file (path, device, inode, size and times) as source and is itself
+// unchanged since staging, or -1. The contents were verified by stage_copy()
+// and only root can write to the stage directory, so they are not read
+// again here.
+static int stage_reuse(const char *stage_dir, const char *key, char *source_path, struct stat *source) {
+    char *image_path = stage_path(stage_dir, key, ".img");
+    char *meta_path = stage_path(stage_dir, key, ".meta");
+    char path[PATH_MAX + 2];
+    struct stat staged;
+    FILE *meta_fp;
+    int fd = -1;
+
+    if ( ( meta_fp = fopen(meta_path, "r") ) == NULL ) { // Flawfinder: ignore
+        goto out;
+    }
+
+    if ( stage_stat_match(meta_fp, source) != 0 ) {
+        singularity_message(DEBUG, "Staged image is out of date: %s\n", image_path);
+        goto out;
+    }
+
+    if ( ( fd = open(image_path, O_RDONLY | O_CLOEXEC) ) < 0 ) { // Flawfinder: ignore
+        singularity_message(DEBUG, "Staged image is missing: %s\n", image_path);
+        goto out;
+    }
+
+    if ( fstat(fd, &staged) < 0 || stage_stat_match(meta_fp, &staged) != 0 ) {
+        singularity_message(DEBUG, "Staged image was modified: %s\n", image_path);
+        goto fail;
+    }
+
+    if ( fgets(path, sizeof(path), meta_fp) == NULL ) {
+        singularity_message(DEBUG, "Malformed stage metadata: %s\n", meta_path);
+        goto fail;
+    }
+    path[strcspn(path, "\n")] = '\0';
+
+    if ( strcmp(path, source_path) != 0 ) {
+        singularity_message(DEBUG, "Staged image %s was made from a different file: %s\n", image_path, path);
+        goto fail;
+    }
+
+    singularity_message(VERBOSE, "Using staged image: %s\n", image_path);
+
+    // The metadata mtime records the last use for LRU eviction
+    if ( utimensat(AT_FDCWD, meta_path, NULL, 0) < 0 ) {
+        singularity_message(DEBUG, "Could not update stage metadata timestamp: %s\n", strerror(errno));
+    }
+    goto out;
+
+fail:
+    close(fd);
+    fd = -1;
+out:
+    if ( meta_fp != NULL ) {
+        fclose(meta_fp);
+    }
+    free(image_path);
+    free(meta_path);
+    return(fd);
+}
+
+static int stage_entry_cmp(const void *a, const void *b) {
+    const struct stage_entry *x = a;
+    const struct stage_entry *y = b;
+
+    return( ( x->used > y->used ) - ( x->used < y->used ) );
+}
+
+// Evict least recently used staged images until needed bytes fit under the
+// configured cap. Entries that are locked by another process are skipped.
+// The lock files stay, a process waiting on one must lock the same inode as
+// the next process to come along.
+static void stage_evict(const char *stage_dir, const char *keep, off_t needed, off_t max_size) {
+    struct stage_entry *entries = (struct stage_entry *) malloc(sizeof(struct stage_entry) * STAGE_MAX_ENTRIES);
+    struct dirent *dent;
+    off_t total = 0;
+    int count = 0;
+    int i;
+    DIR *dir;
+
+    if ( ( dir = opendir(stage_dir) ) == NULL ) {
+        free(entries);
+        return;
+    }
+
+    while ( ( dent = readdir(dir) ) != NULL && count < STAGE_MAX_ENTRIES ) {
+        struct stat meta_stat;
+        struct stat image_stat;
+        char *suffix = strstr(dent->d_name, ".meta");
+        char *meta_path;
+        char *image_path;
+
+        if ( suffix == NULL || suffix[5] != '\0' ) {
+            continue;
+        }
+
+        entries[count].key = strndup(dent->d_name, suffix - dent->d_name);
+        meta_path = stage_path(stage_dir, entries[count].key, ".meta");
+        image_path = stage_path(stage_dir, entries[count].key, ".img");
+
+        if ( stat(meta_path, &meta_stat) == 0 && stat(image_path, &image_stat) == 0 ) {
+            entries[count].size = image_stat.st_size;
+            entries[count].used = meta_stat.st_mtime;
+            total += image_stat.st_size;
+            count++;
+        } else {
+            free(entries[count].key);
+        }
+
+        free(meta_path);
+        free(image_path);
+    }
+    closedir(dir);
+
+    qsort(entries, count, sizeof(struct stage_entry), stage_entry_cmp);
+
+    for ( i = 0; i < count && total + needed > max_size; i++ ) {
+        char *lock_path;
+        int lock_fd;
+
+        if ( strcmp(entries[i].key, keep) == 0 ) {
+            continue;
+        }
+
+        lock_path = stage_path(stage_dir, entries[i].key, ".lock");
+        if ( ( lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600) ) >= 0 ) { // Flawfinder: ignore
+            if ( flock(lock_fd, LOCK_EX | LOCK_NB) == 0 ) {
+                char *meta_path = stage_path(stage_dir, entries[i].key, ".meta");
+                char *image_path = stage_path(stage_dir, entries[i].key, ".img");
+
+                singularity_message(VERBOSE, "Evicting staged image: %s\n", image_path);
+                unlink(meta_path);
+                unlink(image_path);
+                total -= entries[i].size;
+
+                free(meta_path);
+                free(image_path);
+            }
+            close(lock_fd);
+        }
+        free(lock_path);
+    }
+
+    for ( i = 0; i < count; i++ ) {
+        free(entries[i].key);
+    }
+    free(entries);
+}
+
+// Copy the source image into tmp_path, then read the copy back to make sure
+// it landed intact. Returns 0 on success.
+static int stage_copy(int source_fd, char *tmp_path, off_t size) {
+    char *buf = (char *) malloc(STAGE_BUFFER_SIZE);
+    uint64_t source_hash = FNV1A_INIT;
+    uint64_t staged_hash;
+    off_t pos = 0;
+    ssize_t len;
+    int tmp_fd;
+
+    if ( ( tmp_fd = open(tmp_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600) ) < 0 ) { // Flawfinder: ignore
+        singularity_message(WARNING, "Could not create staged image %s: %s\n", tmp_path, strerror(errno));
+        free(buf);
+        return(-1);
+    }
+
+    while ( ( len = pread(source_fd, buf, STAGE_BUFFER_SIZE, pos) ) > 0 ) {
+        char *p = buf;
+        ssize_t left = len;
+
+        source_hash = fnv1a(source_hash, (unsigned char *)buf, len);
+        while ( left > 0 ) {
+            ssize_t written = write(tmp_fd, p, left);
+            if ( written < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                singularity_message(WARNING, "Could not write staged image %s: %s\n", tmp_path, strerror(errno));
+                goto fail;
+            }
+            p += written;
+            left -= written;
+        }
+        pos += len;
+    }
+
+    if ( len < 0 || pos != size ) {
+        singularity_message(WARNING, "Could not read image for staging (got %lld of %lld bytes)\n", (long long)pos, (long long)size);
+        goto fail;
+    }
+
+    if ( stage_checksum(tmp_fd, size, &staged_hash) != 0 || staged_hash != source_hash ) {
+        singularity_message(WARNING, "Checksum mismatch on staged image %s\n", tmp_path);
+        goto fail;
+    }
+
+    close(tmp_fd);
+    free(buf);
+    return(0);
+
+fail:
+    close(tmp_fd);
+    unlink(tmp_path);
+    free(buf);
+    return(-1);
+}
+
+// Does the actual staging work, must be called with escalated privileges and
+// the entry lock held exclusively. Returns a read only fd to the staged copy
+// or -1.
+static int stage_image(struct image_object *image, const char *stage_dir, const char *key, struct stat *source, off_t max_size) {
+    char *image_path = stage_path(stage_dir, key, ".img");
+    char *meta_path = stage_path(stage_dir, key, ".meta");
+    char *pid = int2str(getpid());
+    char *tmp_suffix = strjoin(".tmp.", pid);
+    char *tmp_path = stage_path(stage_dir, key, tmp_suffix);
+    struct stat staged;
+    FILE *meta_fp;
+    int fd = -1;
+
+    singularity_message(VERBOSE, "Staging image %s to %s\n", image->path, image_path);
+    unlink(meta_path);
+    unlink(image_path);
+
+    stage_evict(stage_dir, key, source->st_size, max_size);
+
+    if ( stage_copy(image->fd, tmp_path, source->st_size) != 0 ) {
+        goto out;
+    }
+
+    if ( rename(tmp_path, image_path) < 0 ) {
+        singularity_message(WARNING, "Could not rename staged image into place: %s\n", strerror(errno));
+        unlink(tmp_path);
+        goto out;
+    }
+
+    if ( ( fd = open(image_path, O_RDONLY | O_CLOEXEC) ) < 0 || fstat(fd, &staged) < 0 ) { // Flawfinder: ignore
+        singularity_message(WARNING, "Could not open staged image %s: %s\n", image_path, strerror(errno));
+        goto fail;
+    }
+
+    if ( ( meta_fp = fopen(meta_path, "w") ) == NULL ) { // Flawfinder: ignore
+        singularity_message(WARNING, "Could not write stage metadata %s: %s\n", meta_path, strerror(errno));
+        goto fail;
+    }
+    stage_stat_write(meta_fp, source);
+    stage_stat_write(meta_fp, &staged);
+    fprintf(meta_fp, "%s\n", image->path);
+    if ( fclose(meta_fp) != 0 ) {
+        singularity_message(WARNING, "Could not write stage metadata %s: %s\n", meta_path, strerror(errno));
+        unlink(meta_path);
+        goto fail;
+    }
+    goto out;
+
+fail:
+    if ( fd >= 0 ) {
+        close(fd);
+        fd = -1;
+    }
+    unlink(image_path);
+out:
+    free(image_path);
+    free(meta_path);
+    free(pid);
+    free(tmp_suffix);
+    free(tmp_path);
+    return(fd);
+}
+
+
+int singularity_image_stage(struct image_object *image) {
+    const char *stage_dir = singularity_config_get_value(STAGE_IMAGE_DIR);
+    const char *max_size_string = singularity_config_get_value(STAGE_IMAGE_MAX_SIZE);
+    struct stat source;
+    struct stat dir_stat;
+    long int max_size;
+    char key[17];
+    char *lock_path;
+    int lock_fd;
+    int fd;
+
+    if ( strlength(stage_dir, 1) == 0 ) {
+        return(-1);
+    }
+
+    if ( image->type == DIRECTORY || image->writable > 0 ) {
+        return(-1);
+    }
+
+    if ( stage_path_match(image->path) == 0 ) {
+        return(-1);
+    }
+
+    // The stage directory has to be trusted, so only root may populate it
+    if ( singularity_priv_is_suid() != 0 && singularity_priv_getuid() != 0 ) {
+        singularity_message(VERBOSE, "Not staging image, requires running as SUID or root\n");
+        return(-1);
+    }
+
+    if ( str2int(max_size_string, &max_size) != 0 ) {
+        singularity_message(ERROR, "Failed converting config option '%s = %s' to integer\n", STAGE_IMAGE_MAX_SIZE, max_size_string);
+        ABORT(255);
+    }
+    max_size *= 1024 * 1024;
+
+    if ( fstat(image->fd, &source) < 0 ) {
+        singularity_message(WARNING, "Could not stat image, not staging: %s\n", strerror(errno));
+        return(-1);
+    }
+
+    if ( source.st_size > max_size ) {
+        singularity_message(VERBOSE, "Image is larger than '%s', not staging\n", STAGE_IMAGE_MAX_SIZE);
+        return(-1);
+    }
+
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)fnv1a(FNV1A_INIT, (unsigned char *)image->path, strlen(image->path))); // Flawfinder: ignore
+
+    singularity_priv_escalate();
+    if ( is_dir((char *)stage_dir) < 0 && s_mkpath((char *)stage_dir, 0700) < 0 ) {
+        singularity_priv_drop();
+        singularity_message(WARNING, "Could not create image stage directory %s: %s\n", stage_dir, strerror(errno));
+        return(-1);
+    }
+
+    if ( lstat(stage_dir, &dir_stat) < 0 || S_ISDIR(dir_stat.st_mode) == 0 ||
+            dir_stat.st_uid != 0 || ( dir_stat.st_mode & ( S_IWGRP | S_IWOTH ) ) ) {
+        singularity_priv_drop();
+        singularity_message(WARNING, "Image stage directory %s must be a root owned directory not writable by others\n", stage_dir);
+        return(-1);
+    }
+
+    // Concurrent first runs serialize on this lock, so only one copies
+    lock_path = stage_path(stage_dir, key, ".lock");
+    if ( ( lock_fd = open(lock_path, O_RDWR | O_CREAT | O_CLOEXEC, 0600) ) < 0 ) { // Flawfinder: ignore
+        singularity_priv_drop();
+        singularity_message(WARNING, "Could not open stage lock %s: %s\n", lock_path, strerror(errno));
+        free(lock_path);
+        return(-1);
+    }
+    free(lock_path);
+
+    // Runs reusing the staged copy share the lock, restaging takes it
+    // exclusively and checks again as another process may have done it
+    // while this one waited
+    singularity_message(DEBUG, "Waiting for lock on staged image %s\n", key);
+    if ( flock(lock_fd, LOCK_SH) < 0 ) {
+        singularity_priv_drop();
+        singularity_message(WARNING, "Could not lock staged image: %s\n", strerror(errno));
+        close(lock_fd);
+        return(-1);
+    }
+
+    if ( ( fd = stage_reuse(stage_dir, key, image->path, &source) ) < 0 ) {
+        if ( flock(lock_fd, LOCK_EX) < 0 ) {
+            singularity_priv_drop();
+            singularity_message(WARNING, "Could not lock staged image: %s\n", strerror(errno));
+            close(lock_fd);
+            return(-1);
+        }
+        if ( ( fd = stage_reuse(stage_dir, key, image->path, &source) ) < 0 ) {
+            fd = stage_image(image, stage_dir, key, &source, max_size);
+        }
+    }
+
+    close(lock_fd);
+    singularity_priv_drop();
+
+    if ( fd < 0 ) {
+        singularity_message(VERBOSE, "Falling back to using image in place: %s\n", image->path);
+        return(-1);
+    }
+
+    close(image->fd);
+    image->fd = fd;
+    image->path = stage_path(stage_dir, key, ".img");
+
+    return(0);
+}
@@ -0,0 +1,34 @@
+/* 
+ * Copyright (c) 2017-2018, SyLabs, Inc. All rights reserved.
+ * Copyright (c) 2017, SingularityWare, LLC. All rights reserved.
+ *
+ * Copyright (c) 2015-2017, Gregory M. Kurtzer. All rights reserved.
+ * 
+ * Copyright (c) 2016-2017, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ * 
+ * This software is licensed under a customized 3-clause BSD license.  Please
+ * consult LICENSE file distributed with the sources of this project regarding
+ * your rights to use or distribute this software.
+ * 
+ * NOTICE.  This Software was developed under funding from the U.S. Department of
+ * Energy and the U.S. Government consequently retains certain rights. As such,
+ * the U.S. Government has been granted for itself and others acting on its
+ * behalf a paid-up, nonexclusive, irrevocable, worldwide license in the Software
+ * to reproduce, distribute copies to the public, prepare derivative works, and
+ * perform publicly and display publicly, and to permit other to do so. 
+ * 
+*/
+
+#ifndef __SINGULARITY_IMAGE_STAGE_H_
+#define __SINGULARITY_IMAGE_STAGE_H_
+
+// Copy a read only image found under a 'stage image from' prefix into the
+// node local 'stage image dir', and switch the image object over to the
+// staged copy. Returns 0 if the image is now staged, -1 if it is used in
+// place.
+extern int singularity_image_stage(struct image_object *image);
+
+#endif /* __SINGULARITY_IMAGE_STAGE_H_*/
+
@@ -64,15 +64,9 @@ int container_file_bind(char *source, char *dest_path) {
     }
 
     singularity_message(VERBOSE, "Binding file '%s' to '%s'\n", source, dest);
-    if ( singularity_mount(source, dest, NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL) < 0 ) {
-        singularity_message(ERROR, "There was an error binding %s to %s: %s\n", source, dest, strerror(errno));
-        ABORT(255);
-    }
+    singularity_mount_plan_add(source, dest, NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL, 0);
     if ( singularity_priv_userns_enabled() != 1 ) {
-        if ( singularity_mount(NULL, dest, NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL) < 0 ) {
-            singularity_message(ERROR, "There was an error remounting %s to %s: %s\n", source, dest, strerror(errno));
-            ABORT(255);
-        }
+        singularity_mount_plan_add(NULL, dest, NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL, 0);
     }
 
     return(0);
@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2017-2018, SyLabs, Inc. All rights reserved.
+ * Copyright (c) 2017, SingularityWare, LLC. All rights reserved.
+ *
+ * Copyright (c) 2015-2017, Gregory M. Kurtzer. All rights reserved.
+ *
+ * Copyright (c) 2016-2017, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This software is licensed under a customized 3-clause BSD license.  Please
+ * consult LICENSE file distributed with the sources of this project regarding
+ * your rights to use or distribute this software.
+ *
+ * NOTICE.  This Software was developed under funding from the U.S. Department of
+ * Energy and the U.S. Government consequently retains certain rights. As such,
+ * the U.S. Government has been granted for itself and others acting on its
+ * behalf a paid-up, nonexclusive, irrevocable, worldwide license in the Software
+ * to reproduce, distribute copies to the public, prepare derivative works, and
+ * perform publicly and display publicly, and to permit other to do so.
+ *
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <libgen.h>
+#include <time.h>
+
+#include "config.h"
+#include "util/file.h"
+#include "util/util.h"
+#include "util/message.h"
+#include "util/privilege.h"
+#include "util/config_parser.h"
+
+#include "./file-cache.h"
+
+#define FILE_CACHE_DIR LOCALSTATEDIR "/singularity/cache/files"
+#define FILE_CACHE_BUFFER_SIZE (64*1024)
+
+
+static long int file_cache_ttl(void) {
+    const char *ttl_string = singularity_config_get_value(PASSWD_GROUP_CACHE_TTL);
+    long int ttl;
+
+    if ( str2int(ttl_string, &ttl) != 0 ) {
+        singularity_message(ERROR, "Failed converting config option '%s = %s' to integer\n", PASSWD_GROUP_CACHE_TTL, ttl_string);
+        ABORT(255);
+    }
+
+    return(ttl);
+}
+
+// Per user cache directory, created by root and trusted only if nobody
+// else can write to it
+static char *file_cache_dir(void) {
+    char *dir = joinpath(FILE_CACHE_DIR, int2str(singularity_priv_getuid()));
+    struct stat dir_stat;
+
+    if ( is_dir(dir) < 0 ) {
+        int ret;
+
+        singularity_priv_escalate();
+        ret = s_mkpath(dir, 0755);
+        singularity_priv_drop();
+
+        if ( ret < 0 ) {
+            singularity_message(VERBOSE, "Could not create file cache directory %s: %s\n", dir, strerror(errno));
+            free(dir);
+            return(NULL);
+        }
+    }
+
+    if ( lstat(dir, &dir_stat) < 0 || ! S_ISDIR(dir_stat.st_mode) ||
+         dir_stat.st_uid != 0 || ( dir_stat.st_mode & ( S_IWGRP | S_IWOTH ) ) ) {
+        singularity_message(WARNING, "Not using file cache, %s must be a directory owned by root and only writable by root\n", dir);
+        free(dir);
+        return(NULL);
+    }
+
+    return(dir);
+}
+
+char *container_file_cache_entry(char *name, char *source_file, char *key) {
+    char *buf;
+    char *dir;
+    char entry[128];
+    uint64_t hash = FNV1A_INIT;
+    ssize_t len;
+    int fd;
+
+    if ( file_cache_ttl() <= 0 ) {
+        return(NULL);
+    }
+
+    if ( singularity_priv_is_suid() != 0 && singularity_priv_getuid() != 0 ) {
+        singularity_message(DEBUG, "Not caching %s, requires running as SUID or root\n", name);
+        return(NULL);
+    }
+
+    if ( ( fd = open(source_file, O_RDONLY | O_CLOEXEC) ) < 0 ) { // Flawfinder: ignore
+        return(NULL);
+    }
+
+    buf = (char *)malloc(FILE_CACHE_BUFFER_SIZE);
+    while ( ( len = read(fd, buf, FILE_CACHE_BUFFER_SIZE) ) > 0 ) { // Flawfinder: ignore
+        hash = fnv1a(hash, buf, len);
+    }
+    free(buf);
+    close(fd);
+
+    if ( len < 0 ) {
+        return(NULL);
+    }
+
+    hash = fnv1a(hash, key, strlen(key) + 1);
+
+    if ( ( dir = file_cache_dir() ) == NULL ) {
+        return(NULL);
+    }
+
+    snprintf(entry, sizeof(entry), "%s-%016llx", name, (unsigned long long)hash); // Flawfinder: ignore
+    buf = joinpath(dir, entry);
+    free(dir);
+
+    return(buf);
+}
+
+int container_file_cache_valid(char *entry) {
+    struct stat entry_stat;
+    time_t now = time(NULL);
+
+    if ( lstat(entry, &entry_stat) < 0 ) {
+        return(-1);
+    }
+
+    if ( ! S_ISREG(entry_stat.st_mode) || entry_stat.st_uid != 0 ) {
+        return(-1);
+    }
+
+    if ( entry_stat.st_mtime > now || now - entry_stat.st_mtime >= file_cache_ttl() ) {
+        singularity_message(DEBUG, "Cached file has expired: %s\n", entry);
+        return(-1);
+    }
+
+    return(0);
+}
+
+void container_file_cache_store(char *generated, char *entry) {
+    char *dir = dirname(strdup(entry));
+    char *tmp_entry = strjoin(entry, strjoin(".tmp.", int2str(getpid())));
+    long int ttl = file_cache_ttl();
+    time_t now = time(NULL);
+    struct dirent *dirent;
+    DIR *dirp;
+
+    singularity_priv_escalate();
+
+    if ( copy_file(generated, tmp_entry) < 0 || chmod(tmp_entry, 0644) < 0 || rename(tmp_entry, entry) < 0 ) {
+        singularity_message(VERBOSE, "Could not store %s in file cache: %s\n", entry, strerror(errno));
+        unlink(tmp_entry);
+    } else {
+        singularity_message(DEBUG, "Stored generated file in cache: %s\n", entry);
+    }
+
+    // Drop expired entries, e.g. those left behind by a changed container
+    if ( ( dirp = opendir(dir) ) != NULL ) {
+        while ( ( dirent = readdir(dirp) ) != NULL ) {
+            struct stat entry_stat;
+
+            if ( dirent->d_name[0] == '.' ) {
+                continue;
+            }
+            if ( fstatat(dirfd(dirp), dirent->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) == 0 &&
+                 now - entry_stat.st_mtime >= ttl ) {
+                singularity_message(DEBUG, "Removing expired cache entry: %s/%s\n", dir, dirent->d_name);
+                unlinkat(dirfd(dirp), dirent->d_name, 0);
+            }
+        }
+        closedir(dirp);
+    }
+
+    singularity_priv_drop();
+
+    free(tmp_entry);
+    free(dir);
+}
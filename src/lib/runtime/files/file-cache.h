@@ -0,0 +1,37 @@
+/*
+ * Copyright (c) 2017-2018, SyLabs, Inc. All rights reserved.
+ * Copyright (c) 2017, SingularityWare, LLC. All rights reserved.
+ *
+ * Copyright (c) 2015-2017, Gregory M. Kurtzer. All rights reserved.
+ *
+ * Copyright (c) 2016-2017, The Regents of the University of California,
+ * through Lawrence Berkeley National Laboratory (subject to receipt of any
+ * required approvals from the U.S. Dept. of Energy).  All rights reserved.
+ *
+ * This software is licensed under a customized 3-clause BSD license.  Please
+ * consult LICENSE file distributed with the sources of this project regarding
+ * your rights to use or distribute this software.
+ *
+ * NOTICE.  This Software was developed under funding from the U.S. Department of
+ * Energy and the U.S. Government consequently retains certain rights. As such,
+ * the U.S. Government has been granted for itself and others acting on its
+ * behalf a paid-up, nonexclusive, irrevocable, worldwide license in the Software
+ * to reproduce, distribute copies to the public, prepare derivative works, and
+ * perform publicly and display publicly, and to permit other to do so.
+ *
+ */
+
+
+#ifndef __SINGULARITY_FILE_CACHE_H_
+#define __SINGULARITY_FILE_CACHE_H_
+
+    // Path of the cache entry for a file generated from source_file for
+    // key, or NULL if the cache is disabled or can not be used
+    char *container_file_cache_entry(char *name, char *source_file, char *key);
+
+    // Returns 0 if entry exists and has not expired
+    int container_file_cache_valid(char *entry);
+
+    void container_file_cache_store(char *generated, char *entry);
+
+#endif /* __SINGULARITY_FILE_CACHE_H */
@@ -33,6 +33,7 @@
 #include "util/util.h"
 #include "util/message.h"
 #include "util/privilege.h"
+#include "util/mount.h"
 #include "./passwd/passwd.h"
 #include "./group/group.h"
 #include "./resolvconf/resolvconf.h"
@@ -47,6 +48,7 @@ int _singularity_runtime_files(void) {
     retval += _singularity_runtime_files_group();
     retval += _singularity_runtime_files_resolvconf();
     retval += _singularity_runtime_files_libs();
+    retval += singularity_mount_plan_run();
 
     return(retval);
 }
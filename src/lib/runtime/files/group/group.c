@@ -42,6 +42,7 @@
 #include "util/registry.h"
 
 #include "../file-bind.h"
+#include "../file-cache.h"
 #include "../../runtime.h"
 
 
@@ -49,13 +50,15 @@ int _singularity_runtime_files_group(void) {
     FILE *file_fp;
     char *source_file;
     char *tmp_file;
+    char *cache_key;
+    char *cache_entry;
     int i;
     uid_t uid = singularity_priv_getuid();
     uid_t gid = singularity_priv_getgid();
     const gid_t *gids = singularity_priv_getgids();
     int gid_count = singularity_priv_getgidcount();
     char *containerdir = CONTAINER_FINALDIR;
-    char *tmpdir = singularity_registry_get("SESSIONDIR");
+    const char *tmpdir = singularity_registry_get("SESSIONDIR");
 
     singularity_message(DEBUG, "Called singularity_file_group_create()\n");
 
@@ -88,6 +91,18 @@ int _singularity_runtime_files_group(void) {
         return(0);
     }
 
+    cache_key = strjoin(int2str(uid), strjoin(":", int2str(gid)));
+    for (i=0; i < gid_count; i++) {
+        cache_key = strjoin(cache_key, strjoin(",", int2str(gids[i])));
+    }
+
+    cache_entry = container_file_cache_entry("group", source_file, cache_key);
+    if ( cache_entry != NULL && container_file_cache_valid(cache_entry) == 0 ) {
+        singularity_message(VERBOSE, "Using cached group file: %s\n", cache_entry);
+        container_file_bind(cache_entry, "/etc/group");
+        return(0);
+    }
+
     errno = 0;
     struct passwd *pwent = getpwuid(uid);
     if ( ! pwent ) {
@@ -155,6 +170,9 @@ int _singularity_runtime_files_group(void) {
 
     fclose(file_fp);
 
+    if ( cache_entry != NULL ) {
+        container_file_cache_store(tmp_file, cache_entry);
+    }
 
     container_file_bind(tmp_file, "/etc/group");
 
@@ -51,8 +51,8 @@
 
 int _singularity_runtime_files_libs(void) {
     char *container_dir = CONTAINER_FINALDIR;
-    char *tmpdir = singularity_registry_get("SESSIONDIR");
-    char *includelibs_string;
+    const char *tmpdir = singularity_registry_get("SESSIONDIR");
+    const char *includelibs_string;
     char *libdir = joinpath(tmpdir, "/libs");
     char *libdir_contained = joinpath(container_dir, "/.singularity.d/libs");
 
@@ -62,7 +62,7 @@ int _singularity_runtime_files_libs(void) {
 
         singularity_message(DEBUG, "Parsing SINGULARITY_CONTAINLIBS for user-specified libraries to include.\n");
 
-        free(includelibs_string);
+        singularity_mount_plan_sync(libdir_contained);
 
         singularity_message(DEBUG, "Checking if libdir in container exists: %s\n", libdir_contained);
         if ( is_dir(libdir_contained) != 0 ) {
@@ -131,10 +131,7 @@ int _singularity_runtime_files_libs(void) {
             }
 
             singularity_message(VERBOSE, "Binding file '%s' to '%s'\n", source, dest);
-            if ( singularity_mount(source, dest, NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL) < 0 ) {
-                    singularity_message(ERROR, "There was an error binding %s to %s: %s\n", source, dest, strerror(errno));
-                    ABORT(255);
-            }
+            singularity_mount_plan_add(source, dest, NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL, 0);
 
             free(source);
             free(dest);
@@ -161,10 +158,7 @@ int _singularity_runtime_files_libs(void) {
         }
 
         singularity_message(VERBOSE, "Binding libdir '%s' to '%s'\n", libdir, libdir_contained);
-        if ( singularity_mount(libdir, libdir_contained, NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL) < 0 ) {
-                singularity_message(ERROR, "There was an error binding %s to %s: %s\n", libdir, libdir_contained, strerror(errno));
-                ABORT(255);
-        }
+        singularity_mount_plan_add(libdir, libdir_contained, NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL, 0);
     }
 
     return(0);
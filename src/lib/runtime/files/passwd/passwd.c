@@ -42,6 +42,7 @@
 #include "util/registry.h"
 
 #include "../file-bind.h"
+#include "../file-cache.h"
 #include "../../runtime.h"
 
 
@@ -49,11 +50,12 @@ int _singularity_runtime_files_passwd(void) {
     FILE *file_fp;
     char *source_file;
     char *tmp_file;
+    char *cache_entry;
     char *homedir = singularity_priv_home();
     uid_t uid = singularity_priv_getuid();
-    struct passwd *pwent = getpwuid(uid);
+    struct passwd *pwent;
     char *containerdir = CONTAINER_FINALDIR;
-    char *tmpdir = singularity_registry_get("SESSIONDIR");
+    const char *tmpdir = singularity_registry_get("SESSIONDIR");
 
     singularity_message(DEBUG, "Called singularity_file_passwd_create()\n");
 
@@ -87,6 +89,16 @@ int _singularity_runtime_files_passwd(void) {
         return(0);
     }
 
+    cache_entry = container_file_cache_entry("passwd", source_file, strjoin(int2str(uid), strjoin(":", homedir)));
+    if ( cache_entry != NULL && container_file_cache_valid(cache_entry) == 0 ) {
+        singularity_message(VERBOSE, "Using cached passwd file: %s\n", cache_entry);
+        container_file_bind(cache_entry, "/etc/passwd");
+        envar_set("HOME", homedir, 1);
+        return(0);
+    }
+
+    pwent = getpwuid(uid);
+
     singularity_message(VERBOSE2, "Creating template of /etc/passwd\n");
     if ( ( copy_file(source_file, tmp_file) ) < 0 ) {
         singularity_message(ERROR, "Failed copying template passwd file to tmpdir: %s\n", strerror(errno));
@@ -102,6 +114,9 @@ int _singularity_runtime_files_passwd(void) {
     fprintf(file_fp, "%s:x:%d:%d:%s:%s:%s\n", pwent->pw_name, pwent->pw_uid, pwent->pw_gid, pwent->pw_gecos, homedir, pwent->pw_shell);
     fclose(file_fp);
 
+    if ( cache_entry != NULL ) {
+        container_file_cache_store(tmp_file, cache_entry);
+    }
 
     container_file_bind(tmp_file, "/etc/passwd");
 
@@ -51,7 +51,6 @@
 int _singularity_runtime_mount_cwd(void) {
     char *container_dir = CONTAINER_FINALDIR;
     char *cwd_path = (char *)malloc(PATH_MAX);
-    int r;
 
     singularity_message(DEBUG, "Checking to see if we should mount current working directory\n");
     if ( cwd_path == NULL ) {
@@ -73,6 +72,8 @@ int _singularity_runtime_mount_cwd(void) {
         return(0);
     }
 
+    singularity_mount_plan_sync(joinpath(container_dir, cwd_path));
+
     singularity_message(DEBUG, "Checking if current directory already available within container: %s\n", cwd_path);
     if ( is_dir(joinpath(container_dir, cwd_path)) == 0 ) {
         char *cwd_fileid = file_devino(cwd_path);
@@ -132,12 +133,9 @@ int _singularity_runtime_mount_cwd(void) {
     }
 
     singularity_message(VERBOSE, "Binding '%s' to '%s/%s'\n", cwd_path, container_dir, cwd_path);
-    r = singularity_mount(cwd_path, joinpath(container_dir, cwd_path), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL);
+    singularity_mount_plan_add(cwd_path, joinpath(container_dir, cwd_path), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL, MOUNT_PLAN_OPTIONAL);
     if ( singularity_priv_userns_enabled() != 1 ) {
-        r = singularity_mount(NULL, joinpath(container_dir, cwd_path), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL);
-    }
-    if ( r < 0 ) {
-        singularity_message(WARNING, "Could not bind CWD to container %s: %s\n", cwd_path, strerror(errno));
+        singularity_mount_plan_add(NULL, joinpath(container_dir, cwd_path), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL, MOUNT_PLAN_OPTIONAL);
     }
 
     free(cwd_path);
@@ -45,17 +45,18 @@
 
 #include "../../runtime.h"
 
-static int bind_dev(char *tmpdir, char *dev);
+static int bind_dev(const char *tmpdir, char *dev);
 
 
 int _singularity_runtime_mount_dev(void) {
     char *container_dir = CONTAINER_FINALDIR;
 
     if ( ( singularity_registry_get("CONTAIN") != NULL ) || ( strcmp("minimal", singularity_config_get_value(MOUNT_DEV)) == 0 ) ) {
-        char *sessiondir = singularity_registry_get("SESSIONDIR");
+        const char *sessiondir = singularity_registry_get("SESSIONDIR");
         char *devdir = joinpath(sessiondir, "/dev");
-        char *nvopt = singularity_registry_get("NV"); 
+        const char *nvopt = singularity_registry_get("NV"); 
 
+        singularity_mount_plan_sync(joinpath(container_dir, "/dev"));
         if ( is_dir(joinpath(container_dir, "/dev")) < 0 ) {
             int ret;
 
@@ -127,10 +128,7 @@ int _singularity_runtime_mount_dev(void) {
         }
 
         singularity_message(DEBUG, "Mounting tmpfs for staged /dev/shm\n");
-        if ( singularity_mount("/dev/shm", joinpath(devdir, "/shm"), "tmpfs", MS_NOSUID, "") < 0 ) {
-            singularity_message(ERROR, "Failed to mount %s: %s\n", joinpath(devdir, "/shm"), strerror(errno));
-            ABORT(255);
-        }
+        singularity_mount_plan_add("/dev/shm", joinpath(devdir, "/shm"), "tmpfs", MS_NOSUID, "", 0);
 
         if ( singularity_config_get_bool_char(MOUNT_DEVPTS) > 0 ) {
             struct group *ttygid;
@@ -165,6 +163,7 @@ int _singularity_runtime_mount_dev(void) {
             bzero(devpts_opts, max_sz);
             snprintf(devpts_opts, max_sz-1, "%s%d", devpts_opts_base, ttygid->gr_gid);
 
+            // Not planned, the ptmx link below depends on how this mount went
             singularity_message(DEBUG, "Mounting devpts for staged /dev/pts\n");
             if ( singularity_mount("devpts", joinpath(devdir, "/pts"), "devpts", MS_NOSUID|MS_NOEXEC, devpts_opts) < 0 ) {
                 if (errno == EINVAL) {
@@ -185,14 +184,8 @@ int _singularity_runtime_mount_dev(void) {
         }
 
         singularity_message(DEBUG, "Mounting minimal staged /dev into container\n");
-        if ( singularity_mount(devdir, joinpath(container_dir, "/dev"), NULL, MS_BIND|MS_REC, NULL) < 0 ) {
-            singularity_message(WARNING, "Could not stage dev tree: '%s' -> '%s': %s\n", devdir, joinpath(container_dir, "/dev"), strerror(errno));
-            free(sessiondir);
-            free(devdir);
-            return(-1);
-        }
+        singularity_mount_plan_add(devdir, joinpath(container_dir, "/dev"), NULL, MS_BIND|MS_REC, NULL, MOUNT_PLAN_OPTIONAL);
 
-        free(sessiondir);
         free(devdir);
 
         return(0);
@@ -200,12 +193,10 @@ int _singularity_runtime_mount_dev(void) {
 
     singularity_message(DEBUG, "Checking configuration file for 'mount dev'\n");
     if ( singularity_config_get_bool_char(MOUNT_DEV) > 0 ) {
+        singularity_mount_plan_sync(joinpath(container_dir, "/dev"));
         if ( is_dir(joinpath(container_dir, "/dev")) == 0 ) {
                 singularity_message(VERBOSE, "Bind mounting /dev\n");
-                if ( singularity_mount("/dev", joinpath(container_dir, "/dev"), NULL, MS_BIND|MS_NOSUID|MS_REC, NULL) < 0 ) {
-                    singularity_message(ERROR, "Could not bind mount container's /dev: %s\n", strerror(errno));
-                    ABORT(255);
-                }
+                singularity_mount_plan_add("/dev", joinpath(container_dir, "/dev"), NULL, MS_BIND|MS_NOSUID|MS_REC, NULL, 0);
         } else {
             singularity_message(WARNING, "Not mounting /dev, container has no bind directory\n");
         }
@@ -218,7 +209,7 @@ int _singularity_runtime_mount_dev(void) {
 }
 
 
-static int bind_dev(char *tmpdir, char *dev) {
+static int bind_dev(const char *tmpdir, char *dev) {
     char *path = joinpath(tmpdir, dev);
 
     if ( ( is_chr(dev) == 0 ) || ( is_blk(dev) == 0 ) ) {
@@ -241,11 +232,7 @@ static int bind_dev(char *tmpdir, char *dev) {
     }
 
     singularity_message(DEBUG, "Mounting device %s at %s\n", dev, path);
-    if ( singularity_mount(dev, path, NULL, MS_BIND, NULL) < 0 ) {
-        singularity_message(WARNING, "Could not mount %s: %s\n", dev, strerror(errno));
-        free(path);
-        return(-1);
-    }
+    singularity_mount_plan_add(dev, path, NULL, MS_BIND, NULL, MOUNT_PLAN_OPTIONAL);
 
     free(path);
 
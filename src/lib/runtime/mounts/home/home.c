@@ -46,7 +46,7 @@
 int _singularity_runtime_mount_home(void) {
     char *home_source = singularity_priv_homedir();
     char *home_dest = singularity_priv_home();
-    char *session_dir = singularity_registry_get("SESSIONDIR");
+    const char *session_dir = singularity_registry_get("SESSIONDIR");
     char *container_dir = CONTAINER_FINALDIR;
 
 
@@ -97,15 +97,9 @@ int _singularity_runtime_mount_home(void) {
     singularity_message(DEBUG, "Checking if SINGULARITY_CONTAIN is set\n");
     if ( ( singularity_registry_get("CONTAIN") == NULL ) || ( singularity_registry_get("HOME") != NULL ) ) {
         singularity_message(VERBOSE, "Mounting home directory source into session directory: %s -> %s\n", home_source, joinpath(session_dir, home_dest));
-        if ( singularity_mount(home_source, joinpath(session_dir, home_dest), NULL, MS_BIND | MS_NOSUID | MS_NODEV | MS_REC, NULL) < 0 ) {
-            singularity_message(ERROR, "Failed to mount home directory %s -> %s: %s\n", home_source, joinpath(session_dir, home_dest), strerror(errno));
-            ABORT(255);
-        }
+        singularity_mount_plan_add(home_source, joinpath(session_dir, home_dest), NULL, MS_BIND | MS_NOSUID | MS_NODEV | MS_REC, NULL, 0);
         if ( singularity_priv_userns_enabled() != 1 ) {
-            if ( singularity_mount(NULL, joinpath(session_dir, home_dest), NULL, MS_BIND | MS_REMOUNT | MS_NODEV | MS_NOSUID | MS_REC, NULL) < 0 ) {
-                singularity_message(ERROR, "Failed to remount home directory base %s: %s\n", joinpath(session_dir, home_dest), strerror(errno));
-                ABORT(255);
-            }
+            singularity_mount_plan_add(NULL, joinpath(session_dir, home_dest), NULL, MS_BIND | MS_REMOUNT | MS_NODEV | MS_NOSUID | MS_REC, NULL, 0);
         }
     } else {
         singularity_message(VERBOSE, "Using sessiondir for home directory\n");
@@ -123,6 +117,8 @@ int _singularity_runtime_mount_home(void) {
             ABORT(255);
         }
 
+        singularity_mount_plan_sync(joinpath(container_dir, homedir_base));
+
         singularity_message(DEBUG, "Checking home directory base exists in container: %s\n", homedir_base);
         if ( is_dir(joinpath(container_dir, homedir_base)) != 0 ) {
             singularity_message(ERROR, "Base home directory does not exist within the container: %s\n", homedir_base);
@@ -130,15 +126,14 @@ int _singularity_runtime_mount_home(void) {
         }
 
         singularity_message(VERBOSE, "Mounting staged home directory base to container's base dir: %s -> %s\n", joinpath(session_dir, homedir_base), joinpath(container_dir, homedir_base));
-        if ( singularity_mount(joinpath(session_dir, homedir_base), joinpath(container_dir, homedir_base), NULL, MS_BIND | MS_NOSUID | MS_NODEV | MS_REC, NULL) < 0 ) {
-            singularity_message(ERROR, "Failed to mount staged home base: %s -> %s: %s\n", joinpath(session_dir, homedir_base), joinpath(container_dir, homedir_base), strerror(errno));
-            ABORT(255);
-        }
+        singularity_mount_plan_add(joinpath(session_dir, homedir_base), joinpath(container_dir, homedir_base), NULL, MS_BIND | MS_NOSUID | MS_NODEV | MS_REC, NULL, 0);
 
         free(homedir_base);
     } else {
         singularity_message(DEBUG, "Staging home directory\n");
 
+        singularity_mount_plan_sync(joinpath(container_dir, home_dest));
+
         singularity_priv_escalate();
         singularity_message(DEBUG, "Creating home directory within container: %s\n", joinpath(container_dir, home_dest));
         if ( container_mkpath(joinpath(container_dir, home_dest), 0755) < 0 ) {
@@ -148,17 +143,13 @@ int _singularity_runtime_mount_home(void) {
         singularity_priv_drop();
 
         singularity_message(VERBOSE, "Mounting staged home directory to container: %s -> %s\n", joinpath(session_dir, home_dest), joinpath(container_dir, home_dest));
-        if ( singularity_mount(joinpath(session_dir, home_dest), joinpath(container_dir, home_dest), NULL, MS_BIND | MS_NOSUID | MS_NODEV | MS_REC, NULL) < 0 ) {
-            singularity_message(ERROR, "Failed to mount staged home base: %s -> %s: %s\n", joinpath(session_dir, home_dest), joinpath(container_dir, home_dest), strerror(errno));
-            ABORT(255);
-        }
+        singularity_mount_plan_add(joinpath(session_dir, home_dest), joinpath(container_dir, home_dest), NULL, MS_BIND | MS_NOSUID | MS_NODEV | MS_REC, NULL, 0);
     }
 
     envar_set("HOME", home_dest, 1);
 
     free(home_source);
     free(home_dest);
-    free(session_dir);
 
     return(0);
 }
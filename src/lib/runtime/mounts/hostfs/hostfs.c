@@ -44,12 +44,10 @@
 
 #include "../../runtime.h"
 
-#define MAX_LINE_LEN 4096
-
 
 int _singularity_runtime_mount_hostfs(void) {
-    FILE *mounts;
-    char *line = NULL;
+    int i;
+    int count;
     char *container_dir = CONTAINER_FINALDIR;
 
     if ( singularity_config_get_bool(MOUNT_HOSTFS) <= 0 ) {
@@ -57,49 +55,23 @@ int _singularity_runtime_mount_hostfs(void) {
         return(0);
     }
 
-    singularity_message(DEBUG, "Checking to see if /proc/mounts exists\n");
-    if ( is_file("/proc/mounts") < 0 ) {
-        singularity_message(WARNING, "Can not probe for currently mounted host file systems\n");
-        return(1);
-    }
-
-    singularity_message(DEBUG, "Opening /proc/mounts\n");
-    if ( ( mounts = fopen("/proc/mounts", "r") ) == NULL ) { // Flawfinder: ignore
-        singularity_message(ERROR, "Could not open /proc/mounts for reading: %s\n", strerror(errno));
-        return(1);
-    }
-
-    line = (char *)malloc(MAX_LINE_LEN);
+    // Entries added by the binds below are past count and not visited
+    count = singularity_mount_index_count();
 
-    singularity_message(DEBUG, "Getting line by line\n");
-    while ( fgets(line, MAX_LINE_LEN, mounts) ) {
+    singularity_message(DEBUG, "Iterating through %d mounted file systems\n", count);
+    for ( i = 0; i < count; i++ ) {
+        struct mount_entry *entry = singularity_mount_index_entry(i);
         char *source;
         char *mountpoint;
         char *filesystem;
 
-        if ( line == NULL ) {
-            singularity_message(DEBUG, "Skipping empty line in /proc/mounts\n");
+        if ( entry == NULL ) {
             continue;
         }
 
-        chomp(line);
-
-        if ( line[0] == '#' || strlength(line, 2) <= 1 ) { // Flawfinder: ignore
-            singularity_message(VERBOSE3, "Skipping blank or comment line in /proc/mounts\n");
-            continue;
-        }
-        if ( ( source = strtok(strdup(line), " ") ) == NULL ) {
-            singularity_message(VERBOSE3, "Could not obtain mount source from /proc/mounts: %s\n", line);
-            continue;
-        }
-        if ( ( mountpoint = strtok(NULL, " ") ) == NULL ) {
-            singularity_message(VERBOSE3, "Could not obtain mount point from /proc/mounts: %s\n", line);
-            continue;
-        }
-        if ( ( filesystem = strtok(NULL, " ") ) == NULL ) {
-            singularity_message(VERBOSE3, "Could not obtain file system from /proc/mounts: %s\n", line);
-            continue;
-        }
+        source = entry->source;
+        mountpoint = entry->mountpoint;
+        filesystem = entry->fstype;
 
         if ( strcmp(mountpoint, "/") == 0 ) {
             singularity_message(DEBUG, "Skipping root (/): %s,%s,%s\n", source, mountpoint, filesystem);
@@ -148,6 +120,8 @@ int _singularity_runtime_mount_hostfs(void) {
             continue;
         }
 
+        singularity_mount_plan_sync(joinpath(container_dir, mountpoint));
+
         if ( ( is_dir(mountpoint) == 0 ) && ( is_dir(joinpath(container_dir, mountpoint)) < 0 ) ) {
             if ( singularity_registry_get("OVERLAYFS_ENABLED") != NULL ) {
                 singularity_priv_escalate();
@@ -165,20 +139,12 @@ int _singularity_runtime_mount_hostfs(void) {
 
 
         singularity_message(VERBOSE, "Binding '%s'(%s) to '%s/%s'\n", mountpoint, filesystem, container_dir, mountpoint);
-        if ( singularity_mount(mountpoint, joinpath(container_dir, mountpoint), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL) < 0 ) {
-            singularity_message(ERROR, "There was an error binding the path %s: %s\n", mountpoint, strerror(errno));
-            ABORT(255);
-        }
+        singularity_mount_plan_add(mountpoint, joinpath(container_dir, mountpoint), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL, 0);
         if ( singularity_priv_userns_enabled() != 1 ) {
-            if ( singularity_mount(NULL, joinpath(container_dir, mountpoint), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL) < 0 ) {
-                singularity_message(ERROR, "There was an error remounting the path %s: %s\n", mountpoint, strerror(errno));
-                ABORT(255);
-            }
+            singularity_mount_plan_add(NULL, joinpath(container_dir, mountpoint), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL, 0);
         }
 
     }
 
-    free(line);
-    fclose(mounts);
     return(0);
 }
@@ -49,19 +49,14 @@ int _singularity_runtime_mount_kernelfs(void) {
     // Mount /proc if we are configured
     singularity_message(DEBUG, "Checking configuration file for 'mount proc'\n");
     if ( singularity_config_get_bool(MOUNT_PROC) > 0 ) {
+        singularity_mount_plan_sync(joinpath(container_dir, "/proc"));
         if ( is_dir(joinpath(container_dir, "/proc")) == 0 ) {
             if ( singularity_registry_get("PIDNS_ENABLED") == NULL ) {
                 singularity_message(VERBOSE, "Bind-mounting host /proc\n");
-                if ( singularity_mount("/proc", joinpath(container_dir, "/proc"), NULL, MS_BIND | MS_NOSUID | MS_REC, NULL) < 0 ) {
-                    singularity_message(ERROR, "Could not bind-mount host /proc into container: %s\n", strerror(errno));
-                    ABORT(255);
-                }
+                singularity_mount_plan_add("/proc", joinpath(container_dir, "/proc"), NULL, MS_BIND | MS_NOSUID | MS_REC, NULL, 0);
             } else {
                 singularity_message(VERBOSE, "Mounting new procfs\n");
-                if ( singularity_mount("proc", joinpath(container_dir, "/proc"), "proc", MS_NOSUID, NULL) < 0 ) {
-                    singularity_message(ERROR, "Could not mount new procfs into container: %s\n", strerror(errno));
-                    ABORT(255);
-                }
+                singularity_mount_plan_add("proc", joinpath(container_dir, "/proc"), "proc", MS_NOSUID, NULL, 0);
             }
         } else {
             singularity_message(WARNING, "Not mounting /proc, container has no bind directory\n");
@@ -74,19 +69,14 @@ int _singularity_runtime_mount_kernelfs(void) {
     // Mount /sys if we are configured
     singularity_message(DEBUG, "Checking configuration file for 'mount sys'\n");
     if ( singularity_config_get_bool(MOUNT_SYS) > 0 ) {
+        singularity_mount_plan_sync(joinpath(container_dir, "/sys"));
         if ( is_dir(joinpath(container_dir, "/sys")) == 0 ) {
             if ( singularity_priv_userns_enabled() == 1 ) {
                 singularity_message(VERBOSE, "Mounting /sys\n");
-                if ( singularity_mount("/sys", joinpath(container_dir, "/sys"), NULL, MS_BIND | MS_NOSUID | MS_REC, NULL) < 0 ) {
-                    singularity_message(ERROR, "Could not mount /sys into container: %s\n", strerror(errno));
-                    ABORT(255);
-                }
+                singularity_mount_plan_add("/sys", joinpath(container_dir, "/sys"), NULL, MS_BIND | MS_NOSUID | MS_REC, NULL, 0);
             } else {
                 singularity_message(VERBOSE, "Mounting /sys\n");
-                if ( singularity_mount("sysfs", joinpath(container_dir, "/sys"), "sysfs", MS_NOSUID, NULL) < 0 ) {
-                    singularity_message(ERROR, "Could not mount /sys into container: %s\n", strerror(errno));
-                    ABORT(255);
-                }
+                singularity_mount_plan_add("sysfs", joinpath(container_dir, "/sys"), "sysfs", MS_NOSUID, NULL, 0);
             }
         } else {
             singularity_message(WARNING, "Not mounting /sys, container has no bind directory\n");
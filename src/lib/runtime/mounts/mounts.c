@@ -33,6 +33,7 @@
 #include "util/util.h"
 #include "util/message.h"
 #include "util/privilege.h"
+#include "util/mount.h"
 
 #include "./binds/binds.h"
 #include "./home/home.h"
@@ -58,6 +59,7 @@ int _singularity_runtime_mounts(void) {
     retval += _singularity_runtime_mount_tmp();
     retval += _singularity_runtime_mount_scratch();
     retval += _singularity_runtime_mount_cwd();
+    retval += singularity_mount_plan_run();
 
     return(retval);
 }
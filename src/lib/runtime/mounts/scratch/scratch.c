@@ -48,8 +48,8 @@
 
 int _singularity_runtime_mount_scratch(void) {
     char *container_dir = CONTAINER_FINALDIR;
-    char *scratchdir_path;
-    char *tmpdir_path;
+    const char *scratchdir_path;
+    const char *tmpdir_path;
     char *sourcedir_path;
     int r;
 
@@ -75,13 +75,9 @@ int _singularity_runtime_mount_scratch(void) {
 
     sourcedir_path = joinpath(tmpdir_path, "/scratch");
 
-    free(tmpdir_path);
-
     char *outside_token = NULL;
     char *current = strtok_r(strdup(scratchdir_path), ",", &outside_token);
 
-    free(scratchdir_path);
-
     while ( current != NULL ) {
 
         char *full_sourcedir_path = joinpath(sourcedir_path, basename(strdup(current)));
@@ -93,6 +89,8 @@ int _singularity_runtime_mount_scratch(void) {
             ABORT(255);
         }
 
+        singularity_mount_plan_sync(full_destdir_path);
+
         if ( container_mkpath(full_sourcedir_path, 0750) < 0 ) {
              singularity_message(ERROR, "Could not create scratch working directory %s: %s\n", full_sourcedir_path, strerror(errno));
              ABORT(255);
@@ -117,13 +115,9 @@ int _singularity_runtime_mount_scratch(void) {
         }
 
         singularity_message(VERBOSE, "Binding '%s' to '%s/%s'\n", full_sourcedir_path, container_dir, current);
-        r = singularity_mount(full_sourcedir_path, joinpath(container_dir, current), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL);
+        singularity_mount_plan_add(full_sourcedir_path, joinpath(container_dir, current), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL, 0);
         if ( singularity_priv_userns_enabled() != 1 ) {
-            r += singularity_mount(NULL, joinpath(container_dir, current), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL);
-        }
-        if ( r < 0 ) {
-            singularity_message(WARNING, "Could not bind scratch directory into container %s: %s\n", full_sourcedir_path, strerror(errno));
-            ABORT(255);
+            singularity_mount_plan_add(NULL, joinpath(container_dir, current), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL, 0);
         }
 
         free(full_sourcedir_path);
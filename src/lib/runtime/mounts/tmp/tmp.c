@@ -58,7 +58,7 @@ int _singularity_runtime_mount_tmp(void) {
         tmp_source = strdup("/tmp");
         vartmp_source = strdup("/var/tmp");
     } else {
-        char *tmpdirpath;
+        const char *tmpdirpath;
         if ( ( tmpdirpath = singularity_registry_get("WORKDIR") ) != NULL ) {
             if ( singularity_config_get_bool(USER_BIND_CONTROL) <= 0 ) {
                 singularity_message(ERROR, "User bind control is disabled by system administrator\n");
@@ -67,11 +67,10 @@ int _singularity_runtime_mount_tmp(void) {
             tmp_source = joinpath(tmpdirpath, "/tmp");
             vartmp_source = joinpath(tmpdirpath, "/var_tmp");
         } else {
-            char *sessiondir = singularity_registry_get("SESSIONDIR");
+            const char *sessiondir = singularity_registry_get("SESSIONDIR");
             tmp_source = joinpath(sessiondir, "/tmp");
             vartmp_source = joinpath(sessiondir, "/var_tmp");
         }
-        free(tmpdirpath);
     }
 
     if ( check_mounted("/tmp") < 0 ) {
@@ -80,17 +79,12 @@ int _singularity_runtime_mount_tmp(void) {
             ABORT(255);
         }
         if ( is_dir(tmp_source) == 0 ) {
+            singularity_mount_plan_sync(joinpath(container_dir, "/tmp"));
             if ( is_dir(joinpath(container_dir, "/tmp")) == 0 ) {
                 singularity_message(VERBOSE, "Mounting directory: /tmp\n");
-                if ( singularity_mount(tmp_source, joinpath(container_dir, "/tmp"), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL) < 0 ) {
-                    singularity_message(ERROR, "Failed to mount %s -> /tmp: %s\n", tmp_source, strerror(errno));
-                    ABORT(255);
-                }
+                singularity_mount_plan_add(tmp_source, joinpath(container_dir, "/tmp"), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL, 0);
                 if ( singularity_priv_userns_enabled() != 1 ) {
-                    if ( singularity_mount(NULL, joinpath(container_dir, "/tmp"), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL) < 0 ) {
-                        singularity_message(ERROR, "Failed to remount /tmp: %s\n", strerror(errno));
-                        ABORT(255);
-                    }
+                    singularity_mount_plan_add(NULL, joinpath(container_dir, "/tmp"), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL, 0);
                 }
             } else {
                 singularity_message(VERBOSE, "Could not mount container's /tmp directory: does not exist\n");
@@ -108,17 +102,12 @@ int _singularity_runtime_mount_tmp(void) {
             ABORT(255);
         }
         if ( is_dir(vartmp_source) == 0 ) {
+            singularity_mount_plan_sync(joinpath(container_dir, "/var/tmp"));
             if ( is_dir(joinpath(container_dir, "/var/tmp")) == 0 ) {
                 singularity_message(VERBOSE, "Mounting directory: /var/tmp\n");
-                if ( singularity_mount(vartmp_source, joinpath(container_dir, "/var/tmp"), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL) < 0 ) {
-                    singularity_message(ERROR, "Failed to mount %s -> /var/tmp: %s\n", vartmp_source, strerror(errno));
-                    ABORT(255);
-                }
+                singularity_mount_plan_add(vartmp_source, joinpath(container_dir, "/var/tmp"), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL, 0);
                 if ( singularity_priv_userns_enabled() != 1 ) {
-                    if ( singularity_mount(NULL, joinpath(container_dir, "/var/tmp"), NULL, MS_BIND|MS_NOSUID|MS_REC|MS_NODEV|MS_REMOUNT, NULL) < 0 ) {
-                        singularity_message(ERROR, "Failed to remount /var/tmp: %s\n", strerror(errno));
-                        ABORT(255);
-                    }
+                    singularity_mount_plan_add(NULL, joinpath(container_dir, "/var/tmp"), NULL, MS_BIND|MS_NOSUID|MS_REC|MS_NODEV|MS_REMOUNT, NULL, 0);
                 }
             } else {
                 singularity_message(VERBOSE, "Could not mount container's /var/tmp directory: does not exist\n");
@@ -45,7 +45,7 @@
 
 int _singularity_runtime_mount_userbinds(void) {
     char *container_dir = CONTAINER_FINALDIR;
-    char *bind_path_string;
+    const char *bind_path_string;
 
     singularity_message(DEBUG, "Checking for environment variable 'SINGULARITY_BINDPATH'\n");
     if ( ( bind_path_string = singularity_registry_get("BINDPATH") ) != NULL ) {
@@ -61,8 +61,6 @@ int _singularity_runtime_mount_userbinds(void) {
         char *inside_token = NULL;
         char *current = strtok_r(strdup(bind_path_string), ",", &outside_token);
 
-        free(bind_path_string);
-
         while ( current != NULL ) {
             int read_only = 0;
             char *source = strtok_r(current, ":", &inside_token);
@@ -95,6 +93,8 @@ int _singularity_runtime_mount_userbinds(void) {
                 continue;
             }
 
+            singularity_mount_plan_sync(joinpath(container_dir, dest));
+
             if ( ( is_file(source) == 0 ) && ( is_file(joinpath(container_dir, dest)) < 0 ) ) {
                 if ( singularity_registry_get("OVERLAYFS_ENABLED") != NULL ) {
                     char *dir = dirname(strdup(dest));
@@ -142,30 +142,18 @@ int _singularity_runtime_mount_userbinds(void) {
             }
 
             singularity_message(VERBOSE, "Binding '%s' to '%s/%s'\n", source, container_dir, dest);
-            if ( singularity_mount(source, joinpath(container_dir, dest), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL) < 0 ) {
-                singularity_message(ERROR, "There was an error binding the path %s: %s\n", source, strerror(errno));
-                ABORT(255);
-            }
+            singularity_mount_plan_add(source, joinpath(container_dir, dest), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC, NULL, 0);
             if ( read_only ) {
                 if ( singularity_priv_userns_enabled() == 1 ) {
                     singularity_message(WARNING, "Can not make bind mount read only within the user namespace: %s\n", dest);
                 } else {
+                    // The plan checks that the path really is write-protected
                     singularity_message(VERBOSE, "Remounting %s read-only\n", dest);
-                    if ( singularity_mount(NULL, joinpath(container_dir, dest), NULL, MS_RDONLY|MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL) < 0 ) {
-                        singularity_message(ERROR, "There was an error write-protecting the path %s: %s\n", source, strerror(errno));
-                        ABORT(255);
-                    }
-                    if ( access(joinpath(container_dir, dest), W_OK) == 0 || (errno != EROFS && errno != EACCES) ) { // Flawfinder: ignore (precautionary confirmation, not necessary)
-                        singularity_message(ERROR, "Failed to write-protect the path %s: %s\n", source, strerror(errno));
-                        ABORT(255);
-                    }
+                    singularity_mount_plan_add(NULL, joinpath(container_dir, dest), NULL, MS_RDONLY|MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL, 0);
                 }
             } else {
                 if ( singularity_priv_userns_enabled() <= 0 ) {
-                    if ( singularity_mount(NULL, joinpath(container_dir, dest), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL) < 0 ) {
-                        singularity_message(ERROR, "There was an error remounting the path %s: %s\n", source, strerror(errno));
-                        ABORT(255);
-                    }
+                    singularity_mount_plan_add(NULL, joinpath(container_dir, dest), NULL, MS_BIND|MS_NOSUID|MS_NODEV|MS_REC|MS_REMOUNT, NULL, 0);
                 }
             }
         }
@@ -76,7 +76,7 @@ int _singularity_runtime_overlayfs(void) {
         char *overlay_work  = joinpath(overlay_mount, "/work");
         int overlay_options_len = strlength(rootfs_source, PATH_MAX) + strlength(overlay_upper, PATH_MAX) + strlength(overlay_work, PATH_MAX) + 50;
         char *overlay_options = (char *) malloc(overlay_options_len);
-        char *overlay_path = NULL;
+        const char *overlay_path = NULL;
 
         if (try_overlay)
             singularity_message(VERBOSE3, "Trying OverlayFS as requested by configuration\n");
@@ -95,7 +95,7 @@ int _singularity_runtime_overlayfs(void) {
         if ( ( overlay_path = singularity_registry_get("OVERLAYIMAGE") ) != NULL ) {
             struct image_object image;
 
-            image = singularity_image_init(singularity_registry_get("OVERLAYIMAGE"), O_RDWR);
+            image = singularity_image_init(overlay_path, O_RDWR);
 
             if ( singularity_image_type(&image) != EXT3 ) {
                 if ( singularity_image_type(&image) == DIRECTORY ) {
@@ -168,7 +168,7 @@ int _singularity_runtime_overlayfs(void) {
                 singularity_message(DEBUG, "Unmounting overlay tmpfs: %s\n", overlay_mount);
 
                 singularity_priv_escalate();
-                umount(overlay_mount);
+                singularity_umount(overlay_mount, 0);
                 singularity_priv_drop();
             } else {
                 singularity_message(ERROR, "Could not mount Singularity overlay: %s\n", strerror(errno));
@@ -37,6 +37,7 @@
 #include "util/file.h"
 #include "util/util.h"
 #include "util/registry.h"
+#include "util/fork.h"
 #include "util/message.h"
 #include "util/privilege.h"
 #include "util/config_parser.h"
@@ -83,11 +84,25 @@ int singularity_runtime_mounts(void) {
 }
 
 int singularity_runtime_files(void) {
+    int retval;
+
     if ( singularity_registry_get("DAEMON_JOIN") ) {
         singularity_message(ERROR, "Internal Error - This function should not be called when joining an instance\n");
     }
 
-    return(_singularity_runtime_files());
+    retval = _singularity_runtime_files();
+
+    /* Files is the last stage that plans mounts, every caller stops here */
+    if ( singularity_registry_get("MOUNTPLAN_DRYRUN") != NULL ) {
+        singularity_message(VERBOSE, "Mount plan dry run complete, not running container\n");
+        if ( singularity_registry_get("DAEMON_START") && singularity_registry_get("PIDNS_ENABLED") ) {
+            // The instance parent is waiting on us, let it exit cleanly
+            singularity_signal_go_ahead(0);
+        }
+        exit(0);
+    }
+
+    return(retval);
 }
 
 int singularity_runtime_enter(void) {
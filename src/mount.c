@@ -88,6 +88,7 @@ int main(int argc, char **argv) {
 
         singularity_message(VERBOSE, "Running command: %s\n", argv[1]);
         singularity_message(DEBUG, "Calling exec...\n");
+        singularity_message_flush();
         execvp(argv[1], &argv[1]); // Flawfinder: ignore (Yes flawfinder, we are exec'ing)
 
         singularity_message(ERROR, "Exec failed: %s: %s\n", argv[1], strerror(errno));
@@ -98,6 +99,7 @@ int main(int argc, char **argv) {
         singularity_message(INFO, "%s is mounted at: %s\n\n", singularity_image_name(&image), CONTAINER_FINALDIR);
         envar_set("PS1", "Singularity> ", 1);
 
+        singularity_message_flush();
         execl("/bin/sh", "/bin/sh", NULL); // Flawfinder: ignore (Yes flawfinder, this is what we want, sheesh, so demanding!)
 
         singularity_message(ERROR, "Exec of /bin/sh failed: %s\n", strerror(errno));
@@ -144,7 +144,7 @@ static int setup_container_environment(spank_t spank)
 
 static int setup_container_cwd() {
     singularity_message(DEBUG, "Trying to change directory to where we started\n");
-    char *target_pwd = singularity_registry_get("TARGET_PWD");
+    const char *target_pwd = singularity_registry_get("TARGET_PWD");
 
     if (!target_pwd || (chdir(target_pwd) < 0)) {
         singularity_message(ERROR, "Failed to change into correct directory "
@@ -152,7 +152,6 @@ static int setup_container_cwd() {
                             target_pwd ? target_pwd : "UNKNOWN");
         return -1;
     }
-    free(target_pwd);
     return 0;
 }
 
@@ -236,6 +235,7 @@ static int setup_container(spank_t spank)
     // At this point, the current process is in the runtime container environment.
     // Return control flow back to SLURM: when execv is invoked, it'll be done from
     // within the container.
+    singularity_message_flush();
 
     return 0;
 }
@@ -39,6 +39,7 @@
 #include "util/cleanupd.h"
 #include "util/daemon.h"
 #include "util/signal.h"
+#include "util/trace.h"
 
 #include "./action-lib/include.h"
 
@@ -50,32 +51,43 @@
 
 int started = 0;
 
+static int keep_fifo(int fd, struct stat *st) {
+    return(S_ISFIFO(st->st_mode));
+}
+
 int main(int argc, char **argv) {
     int i, daemon_fd, cleanupd_fd;
+    int keep_fds[2];
     struct tempfile *stdout_log, *stderr_log, *singularity_debug;
     struct image_object image;
     pid_t child;
     siginfo_t siginfo;
-    struct stat filestat;
 
     fd_cleanup();
 
+    singularity_trace_init("config");
     singularity_config_init(joinpath(SYSCONFDIR, "/singularity/singularity.conf"));
 
+    singularity_trace_stage("priv");
     singularity_priv_init();
     singularity_suid_init(argv);
 
+    singularity_trace_stage("registry");
     singularity_registry_init();
+    singularity_trace_stage("userns");
     singularity_priv_userns();
     singularity_priv_drop();
 
+    singularity_trace_stage("autofs");
     singularity_runtime_autofs();
 
     singularity_registry_set("UNSHARE_PID", "1");
     singularity_registry_set("UNSHARE_IPC", "1");
 
+    singularity_trace_stage("cleanupd");
     singularity_cleanupd();
 
+    singularity_trace_stage("image_init");
     if ( singularity_registry_get("WRITABLE") != NULL ) {
         singularity_message(VERBOSE3, "Instantiating writable container image object\n");
         image = singularity_image_init(singularity_registry_get("IMAGE"), O_RDWR);
@@ -84,28 +96,38 @@ int main(int argc, char **argv) {
         image = singularity_image_init(singularity_registry_get("IMAGE"), O_RDONLY);
     }
 
+    singularity_trace_stage("ns");
     singularity_runtime_ns(SR_NS_ALL);
 
+    singularity_trace_stage("sessiondir");
     singularity_sessiondir();
 
+    singularity_trace_stage("image_mount");
     singularity_image_mount(&image, CONTAINER_MOUNTDIR);
 
     action_ready();
 
+    singularity_trace_stage("overlayfs");
     singularity_runtime_overlayfs();
+    singularity_trace_stage("mounts");
     singularity_runtime_mounts();
+    singularity_trace_stage("files");
     singularity_runtime_files();
 
     /* After this point, we are running as PID 1 inside PID NS */
     singularity_message(DEBUG, "Preparing sinit daemon\n");
     singularity_registry_set("ROOTFS", CONTAINER_FINALDIR);
+    singularity_trace_stage("daemon");
     singularity_daemon_init();
 
     singularity_message(DEBUG, "We are ready to recieve jobs, sending signal_go_ahead to parent\n");
     
+    singularity_trace_stage("enter");
     singularity_runtime_enter();
     singularity_priv_drop_perm();
 
+    singularity_trace_finish();
+
     if ( envclean() != 0 ) {
         singularity_message(ERROR, "Failed sanitizing the environment\n");
         ABORT(255);
@@ -118,16 +140,9 @@ int main(int argc, char **argv) {
     
     /* Close all open fd's that may be present besides daemon info file fd */
     singularity_message(DEBUG, "Closing open fd's\n");
-    for( i = sysconf(_SC_OPEN_MAX); i > 2; i-- ) {        
-        if ( i != daemon_fd && i != cleanupd_fd ) {
-            if ( fstat(i, &filestat) == 0 ) {
-                if ( S_ISFIFO(filestat.st_mode) != 0 ) {
-                    continue;
-                }
-            }
-            close(i);
-        }
-    }
+    keep_fds[0] = daemon_fd;
+    keep_fds[1] = cleanupd_fd;
+    fd_sanitize(3, keep_fds, 2, keep_fifo);
 
     singularity_debug = make_logfile("singularity-debug");
     stdout_log = make_logfile("stdout");
@@ -172,6 +187,7 @@ int main(int argc, char **argv) {
         if ( is_exec("/.singularity.d/actions/start") == 0 ) {
             singularity_message(DEBUG, "Exec'ing /.singularity.d/actions/start\n");
 
+            singularity_message_flush();
             if ( execv("/.singularity.d/actions/start", argv) < 0 ) { // Flawfinder: ignore
                 singularity_message(ERROR, "Failed to execv() /.singularity.d/actions/start: %s\n", strerror(errno));
                 ABORT(CHILD_FAILED);
@@ -46,7 +46,7 @@
 char *trigger = NULL;
 
 int singularity_cleanupd(void) {
-    char *cleanup_dir = singularity_registry_get("CLEANUPDIR");
+    const char *cleanup_dir = singularity_registry_get("CLEANUPDIR");
     int trigger_fd = -1;
 
     singularity_registry_set("CLEANUPD_FD", "-1");
@@ -34,6 +34,11 @@
 #include <limits.h>
 #include <search.h>
 #include <glob.h>
+#include <libgen.h>
+#include <stdint.h>
+#include <pwd.h>
+#include <grp.h>
+#include <sys/mman.h>
 
 #include "config.h"
 #include "util/util.h"
@@ -45,9 +50,61 @@
 #define MAX_CONFIG_ENTRIES 64
 #define NULLONE ((char*)1)
 
+#define CONFIG_CACHE_FILE LOCALSTATEDIR "/singularity/cache/config"
+#define CONFIG_CACHE_MAGIC "SCONFC1"
+#define CONFIG_CACHE_MAX_SIZE (16 * 1024 * 1024)
+
 static int config_initialized = 0;
 static struct hsearch_data config_table;
 
+// Keys in config_table, and the files and include directories they came
+// from, kept for writing the compiled cache
+static char **config_keys = NULL;
+static int config_keys_count = 0;
+static char **config_sources = NULL;
+static struct stat *config_sources_stat = NULL;
+static int config_sources_count = 0;
+static int config_cacheable = 1;
+
+// The compiled cache is a single file, mapped read only. All offsets are
+// from the start of the file, which always ends with a '\0' so that any
+// string offset within it is terminated.
+struct config_cache_header {
+    char magic[8];
+    uint32_t size;
+    uint32_t path;          // configuration file the cache was compiled from
+    uint32_t sources;
+    uint32_t sources_off;
+    uint32_t entries;
+    uint32_t entries_off;
+    uint32_t buckets;       // power of 2, open addressing on fnv1a(key)
+    uint32_t buckets_off;   // entry index + 1, 0 for an empty bucket
+};
+
+struct config_cache_source {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t ctime_sec;
+    int64_t ctime_nsec;
+    uint32_t path;
+    uint32_t pad;
+};
+
+struct config_cache_entry {
+    uint32_t key;
+    uint32_t values;        // nvalues string offsets, in file order
+    uint32_t nvalues;
+    int32_t bool_value;     // last value as a boolean, -1 if it is none
+    uint32_t ids;           // nids user or group IDs named by the last value
+    int32_t nids;           // -1 if not resolved
+};
+
+static char *config_cache = NULL;
+static size_t config_cache_size = 0;
+
 // Return a new, empty hash entry appropriate for adding to the config hash.
 //
 // By default, each hash bucket can have 7 values.  We set currently-empty
@@ -101,6 +158,26 @@ static void add_entry(char *key, char *value) {
         singularity_message(ERROR, "Internal error - unable to initialize configuration entry %s=%s.\n", key, value);
         ABORT(255);
     }
+
+    config_keys = (char **)realloc(config_keys, sizeof(char *) * (config_keys_count + 1));
+    config_keys[config_keys_count++] = key;
+}
+
+// Remember a file or directory the configuration depends on. The stat is
+// taken before reading it, so changes while parsing invalidate the cache.
+static void add_source(char *path, struct stat *path_stat) {
+    char *real = realpath(path, NULL); // Flawfinder: ignore
+
+    if ( real == NULL ) {
+        config_cacheable = 0;
+        return;
+    }
+
+    config_sources = (char **)realloc(config_sources, sizeof(char *) * (config_sources_count + 1));
+    config_sources_stat = (struct stat *)realloc(config_sources_stat, sizeof(struct stat) * (config_sources_count + 1));
+    config_sources[config_sources_count] = real;
+    config_sources_stat[config_sources_count] = *path_stat;
+    config_sources_count++;
 }
 
 // Logs any errors that occur while the config glob is run.
@@ -127,6 +204,13 @@ int singularity_config_parse(char *config_path) {
         return -1;
     }
 
+    struct stat config_stat;
+    if ( fstat(fileno(config_fp), &config_stat) == 0 ) {
+        add_source(config_path, &config_stat);
+    } else {
+        config_cacheable = 0;
+    }
+
     char *line = (char *)malloc(MAX_LINE_LEN);
 
     singularity_message(DEBUG, "Starting parse of configuration file %s\n", config_path);
@@ -146,6 +230,18 @@ int singularity_config_parse(char *config_path) {
             if (isspace(*fname_glob)) {
                 chomp(fname_glob);
                 singularity_message(DEBUG, "Parsing '%%include %s' directive.\n", fname_glob);
+
+                // New files matching the glob change the directory
+                char *glob_path = strdup(fname_glob);
+                char *glob_dir = dirname(glob_path);
+                struct stat glob_dir_stat;
+                if ( fname_glob[0] == '/' && strpbrk(glob_dir, "*?[") == NULL && stat(glob_dir, &glob_dir_stat) == 0 ) {
+                    add_source(glob_dir, &glob_dir_stat);
+                } else {
+                    config_cacheable = 0;
+                }
+                free(glob_path);
+
                 glob_t glob_results;
                 int err = glob(fname_glob, 0, log_glob_error, &glob_results);
                 if (err == GLOB_NOSPACE) {
@@ -194,6 +290,417 @@ int singularity_config_parse(char *config_path) {
     return 0;
 }
 
+// Resolve the comma separated user or group names in list. Returns the number
+// of IDs stored in ids, *unresolved is set if any name does not exist.
+static int config_resolve_ids(const char *list, int group, uint32_t **ids, int *unresolved) {
+    char *names = strdup(list);
+    char *token = NULL;
+    char *current;
+    int count = 0;
+
+    *ids = NULL;
+    *unresolved = 0;
+
+    for ( current = strtok_r(names, ",", &token); current != NULL; current = strtok_r(NULL, ",", &token) ) {
+        struct passwd *pw = NULL;
+        struct group *gr = NULL;
+
+        chomp(current);
+        if ( current[0] == '\0' ) {
+            continue;
+        }
+
+        if ( group ) {
+            gr = getgrnam(current);
+        } else {
+            pw = getpwnam(current);
+        }
+        if ( pw == NULL && gr == NULL ) {
+            singularity_message(DEBUG, "Could not resolve %s '%s'\n", group ? "group" : "user", current);
+            *unresolved = 1;
+            continue;
+        }
+
+        *ids = (uint32_t *)realloc(*ids, sizeof(uint32_t) * (count + 1));
+        (*ids)[count++] = group ? gr->gr_gid : pw->pw_uid;
+    }
+
+    free(names);
+    return(count);
+}
+
+// Resolve the names in list like config_resolve_ids(), but only from the
+// files database (db), which the cache can watch for changes. Returns -1 if a
+// name is not in db, or if NSS resolves it to another ID (e.g. a directory
+// service listed first), so that it gets resolved at run time instead.
+static int config_resolve_files_ids(const char *list, const char *db, int group, uint32_t **ids) {
+    char *names = strdup(list);
+    char *token = NULL;
+    char *current;
+    FILE *db_fp;
+    int count = 0;
+
+    *ids = NULL;
+
+    if ( ( db_fp = fopen(db, "r") ) == NULL ) { // Flawfinder: ignore
+        free(names);
+        return(-1);
+    }
+
+    for ( current = strtok_r(names, ",", &token); current != NULL; current = strtok_r(NULL, ",", &token) ) {
+        int found = 0;
+        uint32_t id = 0;
+
+        chomp(current);
+        if ( current[0] == '\0' ) {
+            continue;
+        }
+
+        rewind(db_fp);
+        if ( group ) {
+            struct group *gr;
+
+            while ( ( gr = fgetgrent(db_fp) ) != NULL ) {
+                if ( strcmp(gr->gr_name, current) == 0 ) {
+                    id = gr->gr_gid;
+                    found = 1;
+                    break;
+                }
+            }
+            if ( found ) {
+                gr = getgrnam(current);
+                found = ( gr != NULL && gr->gr_gid == id );
+            }
+        } else {
+            struct passwd *pw;
+
+            while ( ( pw = fgetpwent(db_fp) ) != NULL ) {
+                if ( strcmp(pw->pw_name, current) == 0 ) {
+                    id = pw->pw_uid;
+                    found = 1;
+                    break;
+                }
+            }
+            if ( found ) {
+                pw = getpwnam(current);
+                found = ( pw != NULL && pw->pw_uid == id );
+            }
+        }
+
+        if ( ! found ) {
+            singularity_message(DEBUG, "Not caching %s '%s', not resolved from %s\n", group ? "group" : "user", current, db);
+            free(*ids);
+            *ids = NULL;
+            count = -1;
+            break;
+        }
+
+        *ids = (uint32_t *)realloc(*ids, sizeof(uint32_t) * (count + 1));
+        (*ids)[count++] = id;
+    }
+
+    fclose(db_fp);
+    free(names);
+    return(count);
+}
+
+static const char *config_cache_str(uint32_t offset) {
+    return(config_cache + offset);
+}
+
+static const struct config_cache_entry *config_cache_find(const char *key) {
+    const struct config_cache_header *header = (const struct config_cache_header *)config_cache;
+    const struct config_cache_entry *entries = (const struct config_cache_entry *)(config_cache + header->entries_off);
+    const uint32_t *buckets = (const uint32_t *)(config_cache + header->buckets_off);
+    uint32_t mask = header->buckets - 1;
+    uint32_t idx = fnv1a(FNV1A_INIT, key, strlen(key)) & mask;
+
+    while ( buckets[idx] != 0 ) {
+        const struct config_cache_entry *entry = &entries[buckets[idx] - 1];
+
+        if ( strcmp(config_cache_str(entry->key), key) == 0 ) {
+            return(entry);
+        }
+        idx = ( idx + 1 ) & mask;
+    }
+
+    return(NULL);
+}
+
+static int config_cache_in_bounds(uint32_t offset, uint32_t count, size_t size) {
+    return(offset <= config_cache_size && count <= ( config_cache_size - offset ) / size);
+}
+
+// Map the compiled cache if it was written by root for config_path and none
+// of the files it was compiled from changed since.
+static int config_cache_load(char *config_path) {
+    const struct config_cache_header *header;
+    const struct config_cache_source *sources;
+    const struct config_cache_entry *entries;
+    const uint32_t *buckets;
+    struct stat cache_stat;
+    char *cache_dir = strdup(CONFIG_CACHE_FILE);
+    int fd;
+    int i;
+
+    if ( lstat(dirname(cache_dir), &cache_stat) < 0 || cache_stat.st_uid != 0 || ( cache_stat.st_mode & ( S_IWGRP | S_IWOTH ) ) ) {
+        free(cache_dir);
+        return(-1);
+    }
+    free(cache_dir);
+
+    if ( ( fd = open(CONFIG_CACHE_FILE, O_RDONLY | O_NOFOLLOW | O_CLOEXEC) ) < 0 ) { // Flawfinder: ignore
+        singularity_message(DEBUG, "No compiled configuration cache at %s\n", CONFIG_CACHE_FILE);
+        return(-1);
+    }
+
+    if ( fstat(fd, &cache_stat) < 0 || ! S_ISREG(cache_stat.st_mode) || cache_stat.st_uid != 0 ||
+         ( cache_stat.st_mode & ( S_IWGRP | S_IWOTH ) ) ||
+         cache_stat.st_size < (off_t)sizeof(struct config_cache_header) || cache_stat.st_size > CONFIG_CACHE_MAX_SIZE ) {
+        singularity_message(VERBOSE, "Ignoring configuration cache %s, it must be a file owned by root and only writable by root\n", CONFIG_CACHE_FILE);
+        close(fd);
+        return(-1);
+    }
+
+    config_cache_size = cache_stat.st_size;
+    config_cache = mmap(NULL, config_cache_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if ( config_cache == MAP_FAILED ) {
+        config_cache = NULL;
+        return(-1);
+    }
+
+    header = (const struct config_cache_header *)config_cache;
+    if ( memcmp(header->magic, CONFIG_CACHE_MAGIC, sizeof(header->magic)) != 0 || header->size != config_cache_size ||
+         config_cache[config_cache_size - 1] != '\0' || header->path >= config_cache_size ||
+         ! config_cache_in_bounds(header->sources_off, header->sources, sizeof(struct config_cache_source)) ||
+         ! config_cache_in_bounds(header->entries_off, header->entries, sizeof(struct config_cache_entry)) ||
+         ! config_cache_in_bounds(header->buckets_off, header->buckets, sizeof(uint32_t)) ||
+         header->buckets <= header->entries || ( header->buckets & ( header->buckets - 1 ) ) != 0 ) {
+        singularity_message(VERBOSE, "Ignoring invalid configuration cache %s\n", CONFIG_CACHE_FILE);
+        goto stale;
+    }
+
+    if ( strcmp(config_cache_str(header->path), config_path) != 0 ) {
+        singularity_message(DEBUG, "Configuration cache was compiled from another file\n");
+        goto stale;
+    }
+
+    sources = (const struct config_cache_source *)(config_cache + header->sources_off);
+    for ( i = 0; i < header->sources; i++ ) {
+        struct stat source_stat;
+
+        if ( sources[i].path >= config_cache_size || stat(config_cache_str(sources[i].path), &source_stat) < 0 ||
+             source_stat.st_dev != sources[i].dev || source_stat.st_ino != sources[i].ino ||
+             source_stat.st_size != sources[i].size ||
+             source_stat.st_mtim.tv_sec != sources[i].mtime_sec || source_stat.st_mtim.tv_nsec != sources[i].mtime_nsec ||
+             source_stat.st_ctim.tv_sec != sources[i].ctime_sec || source_stat.st_ctim.tv_nsec != sources[i].ctime_nsec ) {
+            singularity_message(DEBUG, "Configuration cache is stale, %s changed\n", sources[i].path < config_cache_size ? config_cache_str(sources[i].path) : "?");
+            goto stale;
+        }
+    }
+
+    entries = (const struct config_cache_entry *)(config_cache + header->entries_off);
+    for ( i = 0; i < header->entries; i++ ) {
+        if ( entries[i].key >= config_cache_size || entries[i].nvalues == 0 ||
+             ! config_cache_in_bounds(entries[i].values, entries[i].nvalues, sizeof(uint32_t)) ||
+             ( entries[i].nids > 0 && ! config_cache_in_bounds(entries[i].ids, entries[i].nids, sizeof(uint32_t)) ) ) {
+            singularity_message(VERBOSE, "Ignoring invalid configuration cache %s\n", CONFIG_CACHE_FILE);
+            goto stale;
+        }
+    }
+
+    buckets = (const uint32_t *)(config_cache + header->buckets_off);
+    for ( i = 0; i < header->buckets; i++ ) {
+        if ( buckets[i] > header->entries ) {
+            singularity_message(VERBOSE, "Ignoring invalid configuration cache %s\n", CONFIG_CACHE_FILE);
+            goto stale;
+        }
+    }
+
+    singularity_message(VERBOSE, "Using compiled configuration cache: %s\n", CONFIG_CACHE_FILE);
+    return(0);
+
+stale:
+    munmap(config_cache, config_cache_size);
+    config_cache = NULL;
+    return(-1);
+}
+
+struct config_cache_buf {
+    char *data;
+    size_t len;
+};
+
+// Append len bytes (8 byte aligned) and return their offset
+static uint32_t config_cache_append(struct config_cache_buf *buf, const void *data, size_t len) {
+    size_t offset = ( buf->len + 7 ) & ~(size_t)7;
+
+    buf->data = (char *)realloc(buf->data, offset + len);
+    memset(buf->data + buf->len, '\0', offset - buf->len);
+    if ( data != NULL ) {
+        memcpy(buf->data + offset, data, len); // Flawfinder: ignore
+    } else {
+        memset(buf->data + offset, '\0', len);
+    }
+    buf->len = offset + len;
+
+    return(offset);
+}
+
+static uint32_t config_cache_append_str(struct config_cache_buf *buf, const char *str) {
+    return(config_cache_append(buf, str, strlen(str) + 1));
+}
+
+// Compile the parsed configuration into the cache. Only root does this, for
+// the system configuration file.
+static void config_cache_write(char *config_path) {
+    struct config_cache_buf buf = { NULL, 0 };
+    struct config_cache_header header;
+    struct config_cache_source *sources;
+    struct config_cache_entry *entries;
+    uint32_t *buckets;
+    uint32_t nbuckets = 8;
+    char *cache_dir;
+    char *tmp_file;
+    int fd;
+    int i;
+
+    if ( geteuid() != 0 || ! config_cacheable || strcmp(config_path, joinpath(SYSCONFDIR, "/singularity/singularity.conf")) != 0 ) {
+        return;
+    }
+
+    entries = (struct config_cache_entry *)malloc(sizeof(struct config_cache_entry) * config_keys_count);
+    while ( nbuckets < config_keys_count * 2 ) {
+        nbuckets *= 2;
+    }
+    buckets = (uint32_t *)calloc(nbuckets, sizeof(uint32_t));
+
+    memset(&header, '\0', sizeof(header));
+    memcpy(header.magic, CONFIG_CACHE_MAGIC, sizeof(header.magic)); // Flawfinder: ignore
+    config_cache_append(&buf, NULL, sizeof(header));
+    header.path = config_cache_append_str(&buf, config_path);
+
+    for ( i = 0; i < config_keys_count; i++ ) {
+        ENTRY search_item;
+        ENTRY *found = NULL;
+        char **values;
+        const char *last;
+        uint32_t *value_offsets;
+        uint32_t idx;
+        int nvalues = 0;
+
+        search_item.key = config_keys[i];
+        search_item.data = NULL;
+        hsearch_r(search_item, FIND, &found, &config_table);
+        values = found->data;
+        while ( values[nvalues] != NULL && values[nvalues] != NULLONE ) {
+            nvalues++;
+        }
+
+        value_offsets = (uint32_t *)malloc(sizeof(uint32_t) * nvalues);
+        for ( idx = 0; idx < nvalues; idx++ ) {
+            value_offsets[idx] = config_cache_append_str(&buf, values[idx]);
+        }
+
+        memset(&entries[i], '\0', sizeof(struct config_cache_entry));
+        entries[i].key = config_cache_append_str(&buf, config_keys[i]);
+        entries[i].values = config_cache_append(&buf, value_offsets, sizeof(uint32_t) * nvalues);
+        entries[i].nvalues = nvalues;
+        free(value_offsets);
+
+        last = values[nvalues - 1];
+        if ( strcmp(last, "yes") == 0 || strcmp(last, "y") == 0 || strcmp(last, "1") == 0 ) {
+            entries[i].bool_value = 1;
+        } else if ( strcmp(last, "no") == 0 || strcmp(last, "n") == 0 || strcmp(last, "0") == 0 ) {
+            entries[i].bool_value = 0;
+        } else {
+            entries[i].bool_value = -1;
+        }
+
+        // Owner and group limits are resolved up front only when every name
+        // comes from the files database, whose changes (like those of
+        // nsswitch.conf) invalidate the cache. Names from LDAP, SSSD and the
+        // like can be renumbered at any time, so they are resolved at run
+        // time.
+        entries[i].nids = -1;
+        if ( ( strcmp(config_keys[i], LIMIT_CONTAINER_OWNERS) == 0 || strcmp(config_keys[i], LIMIT_CONTAINER_GROUPS) == 0 ) &&
+             strcmp(last, "NULL") != 0 ) {
+            int group = strcmp(config_keys[i], LIMIT_CONTAINER_GROUPS) == 0;
+            char *db = group ? "/etc/group" : "/etc/passwd";
+            struct stat db_stat;
+            struct stat nss_stat;
+            uint32_t *ids;
+            int nids;
+
+            if ( stat(db, &db_stat) == 0 && stat("/etc/nsswitch.conf", &nss_stat) == 0 ) {
+                nids = config_resolve_files_ids(last, db, group, &ids);
+                if ( nids >= 0 ) {
+                    add_source(db, &db_stat);
+                    add_source("/etc/nsswitch.conf", &nss_stat);
+                    entries[i].ids = config_cache_append(&buf, ids, sizeof(uint32_t) * nids);
+                    entries[i].nids = nids;
+                }
+                free(ids);
+            }
+        }
+
+        idx = fnv1a(FNV1A_INIT, config_keys[i], strlen(config_keys[i])) & ( nbuckets - 1 );
+        while ( buckets[idx] != 0 ) {
+            idx = ( idx + 1 ) & ( nbuckets - 1 );
+        }
+        buckets[idx] = i + 1;
+    }
+
+    sources = (struct config_cache_source *)malloc(sizeof(struct config_cache_source) * config_sources_count);
+    for ( i = 0; i < config_sources_count; i++ ) {
+        memset(&sources[i], '\0', sizeof(struct config_cache_source));
+        sources[i].path = config_cache_append_str(&buf, config_sources[i]);
+        sources[i].dev = config_sources_stat[i].st_dev;
+        sources[i].ino = config_sources_stat[i].st_ino;
+        sources[i].size = config_sources_stat[i].st_size;
+        sources[i].mtime_sec = config_sources_stat[i].st_mtim.tv_sec;
+        sources[i].mtime_nsec = config_sources_stat[i].st_mtim.tv_nsec;
+        sources[i].ctime_sec = config_sources_stat[i].st_ctim.tv_sec;
+        sources[i].ctime_nsec = config_sources_stat[i].st_ctim.tv_nsec;
+    }
+
+    header.sources = config_sources_count;
+    header.sources_off = config_cache_append(&buf, sources, sizeof(struct config_cache_source) * config_sources_count);
+    header.entries = config_keys_count;
+    header.entries_off = config_cache_append(&buf, entries, sizeof(struct config_cache_entry) * config_keys_count);
+    header.buckets = nbuckets;
+    header.buckets_off = config_cache_append(&buf, buckets, sizeof(uint32_t) * nbuckets);
+    config_cache_append_str(&buf, "");
+    header.size = buf.len;
+    memcpy(buf.data, &header, sizeof(header)); // Flawfinder: ignore
+
+    free(sources);
+    free(entries);
+    free(buckets);
+
+    cache_dir = strdup(CONFIG_CACHE_FILE);
+    tmp_file = strjoin(CONFIG_CACHE_FILE, strjoin(".tmp.", int2str(getpid())));
+    if ( s_mkpath(dirname(cache_dir), 0755) < 0 ) {
+        singularity_message(VERBOSE, "Could not create configuration cache directory: %s\n", strerror(errno));
+    } else if ( ( fd = open(tmp_file, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644) ) < 0 ) { // Flawfinder: ignore
+        singularity_message(VERBOSE, "Could not create configuration cache %s: %s\n", tmp_file, strerror(errno));
+    } else {
+        int failed = write(fd, buf.data, buf.len) != (ssize_t)buf.len || fchmod(fd, 0644) < 0;
+
+        if ( close(fd) < 0 || failed || rename(tmp_file, CONFIG_CACHE_FILE) < 0 ) {
+            singularity_message(VERBOSE, "Could not write configuration cache %s: %s\n", CONFIG_CACHE_FILE, strerror(errno));
+            unlink(tmp_file);
+        } else {
+            singularity_message(DEBUG, "Wrote configuration cache %s\n", CONFIG_CACHE_FILE);
+        }
+    }
+
+    free(cache_dir);
+    free(tmp_file);
+    free(buf.data);
+}
+
 /*
  * Initialize the configuration, starting at a particular file.
  *
@@ -208,11 +715,17 @@ int singularity_config_init(char *config_path) {
     }
     config_initialized = 1;
 
+    if ( config_cache_load(config_path) == 0 ) {
+        return 0;
+    }
+
     hcreate_r(60, &config_table);
     int retval = singularity_config_parse(config_path);
     if (retval) {  // Error case.
         hdestroy_r(&config_table);
         config_initialized = 0;
+    } else {
+        config_cache_write(config_path);
     }
     return retval;
 }
@@ -230,6 +743,18 @@ const char *_singularity_config_get_value_impl(const char *key, const char *defa
         ABORT(255);
     }
 
+    if (config_cache) {
+        const struct config_cache_entry *entry = config_cache_find(key);
+        const char *retval = default_value;
+
+        if (entry) {
+            const uint32_t *values = (const uint32_t *)(config_cache + entry->values);
+            retval = config_cache_str(values[entry->nvalues - 1]);
+        }
+        singularity_message(DEBUG, "Returning configuration value %s='%s'\n", key, retval);
+        return retval;
+    }
+
     ENTRY search_item;
     search_item.key = (char*)key;
     search_item.data = NULL;
@@ -263,6 +788,25 @@ const char **_singularity_config_get_value_multi_impl(const char *key, const cha
     _default_entry[1] = '\0';
     _default_entry[0] = default_value;
 
+    if (config_cache) {
+        const struct config_cache_entry *entry = config_cache_find(key);
+        const uint32_t *values;
+        const char **retval;
+        int idx;
+
+        if (!entry) {
+            singularity_message(DEBUG, "No configuration entry found for '%s'; returning default value '%s'\n", key, default_value);
+            return _default_entry;
+        }
+        values = (const uint32_t *)(config_cache + entry->values);
+        retval = (const char **)malloc(sizeof(char *) * (entry->nvalues + 1));
+        for (idx = 0; idx < entry->nvalues; idx++) {
+            retval[idx] = config_cache_str(values[idx]);
+        }
+        retval[entry->nvalues] = NULL;
+        return retval;
+    }
+
     ENTRY search_item;
     search_item.key = (char*)key;
     search_item.data = NULL;
@@ -305,6 +849,15 @@ int _singularity_config_get_bool_char_impl(const char *key, const char *def) {
 
     singularity_message(DEBUG, "Called singularity_config_get_bool(%s, %s)\n", key, def);
 
+    if (config_cache) {
+        const struct config_cache_entry *entry = config_cache_find(key);
+
+        if (entry && entry->bool_value >= 0) {
+            singularity_message(DEBUG, "Return singularity_config_get_bool(%s, %s) = %d\n", key, def, entry->bool_value);
+            return(entry->bool_value);
+        }
+    }
+
     if ( ( config_value = _singularity_config_get_value_impl(key, def) ) != NULL ) {
         if ( strcmp(config_value, "yes") == 0 ||
                 strcmp(config_value, "y") == 0 ||
@@ -328,3 +881,29 @@ int _singularity_config_get_bool_char_impl(const char *key, const char *def) {
 
     return(-1);
 }
+
+/*
+ * Resolves the comma separated user (or group) names of a configuration
+ * value to IDs, preresolved in the compiled cache when possible.
+ *
+ * @param const uint32_t **ids set to the array of IDs
+ * @returns the number of IDs, names that do not exist are left out
+ */
+int _singularity_config_get_ids_impl(const char *key, const char *default_value, int group, const uint32_t **ids) {
+    uint32_t *resolved;
+    int unresolved;
+    int count;
+
+    if (config_cache) {
+        const struct config_cache_entry *entry = config_cache_find(key);
+
+        if (entry && entry->nids >= 0) {
+            *ids = (const uint32_t *)(config_cache + entry->ids);
+            return(entry->nids);
+        }
+    }
+
+    count = config_resolve_ids(_singularity_config_get_value_impl(key, default_value), group, &resolved, &unresolved);
+    *ids = resolved;
+    return(count);
+}
@@ -25,6 +25,8 @@
 #ifndef __SINGULARITY_CONFIG_H_
 #define __SINGULARITY_CONFIG_H_
 
+#include <stdint.h>
+
 #include "config_defaults.h"
 
 // Retrieve a single value from the configuration; in the presence of
@@ -58,6 +60,15 @@ int _singularity_config_get_bool_char_impl(const char *key, const char *value);
 #define singularity_config_get_bool_char(NAME) \
        _singularity_config_get_bool_char_impl(NAME, NAME ## _DEFAULT)
 
+// Resolve the comma separated user (or group) names of a configuration value
+// to their IDs, returning how many were found. The IDs come from the compiled
+// configuration cache when it is in use.
+int _singularity_config_get_ids_impl(const char *key, const char *default_value, int group, const uint32_t **ids);
+#define singularity_config_get_uids(NAME, IDS) \
+       _singularity_config_get_ids_impl(NAME, NAME ## _DEFAULT, 0, IDS)
+#define singularity_config_get_gids(NAME, IDS) \
+       _singularity_config_get_ids_impl(NAME, NAME ## _DEFAULT, 1, IDS)
+
 // Initialize the configuration table
 //
 int singularity_config_init(char *config_path);
@@ -44,7 +44,7 @@ void daemon_file_parse(void) {
     free(line);
 }
 
-void daemon_file_write(int fd, char *key, char *val) {
+void daemon_file_write(int fd, char *key, const char *val) {
     int retval = 0;
     errno = 0;
     
@@ -96,8 +96,8 @@ void daemon_init_join(void) {
     char *pid_path;
     int lock_result, ns_fd;
     int *lock_fd = malloc(sizeof(int));
-    char *daemon_file = singularity_registry_get("DAEMON_FILE");
-    char *daemon_name = singularity_registry_get("DAEMON_NAME");
+    const char *daemon_file = singularity_registry_get("DAEMON_FILE");
+    const char *daemon_name = singularity_registry_get("DAEMON_NAME");
     
     /* Check if there is a lock on daemon file */
     singularity_message(DEBUG, "Checking for lock on %s\n", daemon_file);
@@ -160,8 +160,8 @@ void daemon_init_join(void) {
 }
 
 void daemon_init_start(void) {
-    char *daemon_file = singularity_registry_get("DAEMON_FILE");
-    char *daemon_name = singularity_registry_get("DAEMON_NAME");
+    const char *daemon_file = singularity_registry_get("DAEMON_FILE");
+    const char *daemon_name = singularity_registry_get("DAEMON_NAME");
     char *daemon_file_dir = strdup(daemon_file);
     char *daemon_pid = (char *)malloc(256);
     char *daemon_image;
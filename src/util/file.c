@@ -38,11 +38,15 @@
 #include <ftw.h>
 #include <time.h>
 #include <limits.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
 
 #include "config.h"
 #include "util/util.h"
 #include "util/message.h"
+#include "util/trace.h"
 #include "util/privilege.h"
+#include "util/file.h"
 
 
 static struct stat st_overlaydir;
@@ -79,6 +83,7 @@ char *file_id(char *path) {
 
     singularity_message(DEBUG, "Called file_id(%s)\n", path);
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (lstat(path, &filestat) < 0) {
         return(NULL);
@@ -99,6 +104,7 @@ char *file_devino(char *path) {
 
     singularity_message(DEBUG, "Called file_devino(%s)\n", path);
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (lstat(path, &filestat) < 0) {
         return(NULL);
@@ -116,6 +122,7 @@ int chk_perms(char *path, mode_t mode) {
 
     singularity_message(DEBUG, "Checking permissions on: %s\n", path);
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -134,6 +141,7 @@ int chk_mode(char *path, mode_t mode, mode_t mask) {
 
     singularity_message(DEBUG, "Checking exact mode (%o) on: %s\n", mode, path);
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -149,9 +157,10 @@ int chk_mode(char *path, mode_t mode, mode_t mask) {
     return(-1);
 }
 
-int is_file(char *path) {
+int is_file(const char *path) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -168,6 +177,7 @@ int is_file(char *path) {
 int is_fifo(char *path) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -184,6 +194,7 @@ int is_fifo(char *path) {
 int is_link(char *path) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (lstat(path, &filestat) < 0) {
         return(-1);
@@ -197,9 +208,10 @@ int is_link(char *path) {
     return(-1);
 }
 
-int is_dir(char *path) {
+int is_dir(const char *path) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -216,6 +228,7 @@ int is_dir(char *path) {
 int is_suid(char *path) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -232,6 +245,7 @@ int is_suid(char *path) {
 int is_exec(char *path) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -248,6 +262,7 @@ int is_exec(char *path) {
 int is_write(char *path) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -264,6 +279,7 @@ int is_write(char *path) {
 int is_owner(char *path, uid_t uid) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -279,6 +295,7 @@ int is_owner(char *path, uid_t uid) {
 int is_blk(char *path) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -296,6 +313,7 @@ int is_blk(char *path) {
 int is_chr(char *path) {
     struct stat filestat;
 
+    singularity_trace_count(TRACE_STAT);
     // Stat path
     if (stat(path, &filestat) < 0) {
         return(-1);
@@ -488,11 +506,112 @@ int s_rmdir(char *dir) {
     return(nftw(dir, _unlink, 32, FTW_DEPTH|FTW_MOUNT|FTW_PHYS));
 }
 
+#define COPY_BUFFER_SIZE (128 * 1024)
+
+static ssize_t copy_fd_range(int source_fd, int dest_fd, size_t count) {
+#ifdef SYS_copy_file_range
+    return(syscall(SYS_copy_file_range, source_fd, NULL, dest_fd, NULL, count, 0));
+#else
+    errno = ENOSYS;
+    return(-1);
+#endif
+}
+
+static ssize_t copy_fd_readwrite(int source_fd, int dest_fd, char *buf) {
+    ssize_t len;
+    ssize_t done = 0;
+
+    while ( ( len = read(source_fd, buf, COPY_BUFFER_SIZE) ) != 0 ) { // Flawfinder: ignore (bounded by buffer size)
+        char *p = buf;
+
+        if ( len < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            return(-1);
+        }
+
+        while ( len > 0 ) {
+            ssize_t written = write(dest_fd, p, len);
+
+            if ( written < 0 ) {
+                if ( errno == EINTR ) {
+                    continue;
+                }
+                return(-1);
+            }
+            p += written;
+            len -= written;
+            done += written;
+        }
+    }
+
+    return(done);
+}
+
+/*
+ * Copy everything from the current offset of source_fd to dest_fd. The
+ * strategies are tried in order, copy_file_range() first, then sendfile()
+ * and finally a read()/write() loop. Each one picks up where the previous
+ * one left off, the file offsets of both descriptors are advanced.
+ * Returns the number of bytes copied, or -1 on error.
+ */
+ssize_t copy_fd(int source_fd, int dest_fd, int strategy) {
+    struct stat filestat;
+    ssize_t done = 0;
+    ssize_t len;
+    char *buf;
+
+    if ( fstat(source_fd, &filestat) < 0 ) {
+        return(-1);
+    }
+
+    // Files in /proc and /sys report a size of 0, just read those
+    if ( S_ISREG(filestat.st_mode) && filestat.st_size > 0 ) {
+        if ( strategy == COPY_FD_AUTO || strategy == COPY_FD_RANGE ) {
+            while ( ( len = copy_fd_range(source_fd, dest_fd, SSIZE_MAX) ) > 0 ) {
+                done += len;
+            }
+            if ( len < 0 ) {
+                if ( strategy != COPY_FD_AUTO || ( errno != ENOSYS && errno != EXDEV && errno != EINVAL &&
+                        errno != EOPNOTSUPP && errno != EBADF && errno != EPERM ) ) {
+                    return(-1);
+                }
+                singularity_message(DEBUG, "copy_file_range() not usable (%s), trying sendfile()\n", strerror(errno));
+                strategy = COPY_FD_SENDFILE;
+            }
+        }
+        if ( strategy == COPY_FD_SENDFILE ) {
+            while ( ( len = sendfile(dest_fd, source_fd, NULL, COPY_BUFFER_SIZE * 64) ) > 0 ) {
+                done += len;
+            }
+            if ( len < 0 ) {
+                if ( errno != EINVAL && errno != ENOSYS ) {
+                    return(-1);
+                }
+                singularity_message(DEBUG, "sendfile() not usable (%s), using read()/write()\n", strerror(errno));
+            }
+        }
+    }
+
+    // Also picks up anything written to the source after it was stat()ed
+    if ( ( buf = (char *)malloc(COPY_BUFFER_SIZE) ) == NULL ) {
+        return(-1);
+    }
+    len = copy_fd_readwrite(source_fd, dest_fd, buf);
+    free(buf);
+
+    if ( len < 0 ) {
+        return(-1);
+    }
+
+    return(done + len);
+}
+
 int copy_file(char * source, char * dest) {
     struct stat filestat;
-    int c;
-    FILE * fp_s;
-    FILE * fp_d;
+    int fd_s;
+    int fd_d;
 
     singularity_message(DEBUG, "Called copy_file(%s, %s)\n", source, dest);
 
@@ -502,42 +621,48 @@ int copy_file(char * source, char * dest) {
     }
 
     singularity_message(DEBUG, "Opening source file: %s\n", source);
-    if ( ( fp_s = fopen(source, "r") ) == NULL ) { // Flawfinder: ignore
+    if ( ( fd_s = open(source, O_RDONLY | O_CLOEXEC) ) < 0 ) { // Flawfinder: ignore
         singularity_message(ERROR, "Could not read %s: %s\n", source, strerror(errno));
         return(-1);
     }
 
     singularity_message(DEBUG, "Opening destination file: %s\n", dest);
-    if ( ( fp_d = fopen(dest, "w") ) == NULL ) { // Flawfinder: ignore
-        fclose(fp_s);
+    if ( ( fd_d = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666) ) < 0 ) { // Flawfinder: ignore
+        close(fd_s);
         singularity_message(ERROR, "Could not write %s: %s\n", dest, strerror(errno));
         return(-1);
     }
 
-    singularity_message(DEBUG, "Calling fstat() on source file descriptor: %d\n", fileno(fp_s));
-    if ( fstat(fileno(fp_s), &filestat) < 0 ) {
+    singularity_message(DEBUG, "Calling fstat() on source file descriptor: %d\n", fd_s);
+    if ( fstat(fd_s, &filestat) < 0 ) {
         singularity_message(ERROR, "Could not fstat() on %s: %s\n", source, strerror(errno));
-        fclose(fp_s);
-        fclose(fp_d);
+        close(fd_s);
+        close(fd_d);
         return(-1);
     }
 
     singularity_message(DEBUG, "Cloning permission string of source to dest\n");
-    if ( fchmod(fileno(fp_d), filestat.st_mode) < 0 ) {
+    if ( fchmod(fd_d, filestat.st_mode) < 0 ) {
         singularity_message(ERROR, "Could not set permission mode on %s: %s\n", dest, strerror(errno));
-        fclose(fp_s);
-        fclose(fp_d);
+        close(fd_s);
+        close(fd_d);
         return(-1);
     }
 
     singularity_message(DEBUG, "Copying file data...\n");
-    while ( ( c = fgetc(fp_s) ) != EOF ) { // Flawfinder: ignore (checked boundries)
-        fputc(c, fp_d);
+    if ( copy_fd(fd_s, fd_d, COPY_FD_AUTO) < 0 ) {
+        singularity_message(ERROR, "Could not copy %s to %s: %s\n", source, dest, strerror(errno));
+        close(fd_s);
+        close(fd_d);
+        return(-1);
     }
 
-    singularity_message(DEBUG, "Done copying data, closing file pointers\n");
-    fclose(fp_s);
-    fclose(fp_d);
+    singularity_message(DEBUG, "Done copying data, closing file descriptors\n");
+    close(fd_s);
+    if ( close(fd_d) < 0 ) {
+        singularity_message(ERROR, "Could not write %s: %s\n", dest, strerror(errno));
+        return(-1);
+    }
 
     singularity_message(DEBUG, "Returning copy_file(%s, %s) = 0\n", source, dest);
 
@@ -619,10 +744,11 @@ int fileput(char *path, char *string) {
 
 char *filecat(char *path) {
     char *ret;
-    FILE *fd;
-    int c;
-    long length;
-    long pos = 0;
+    int fd;
+    struct stat filestat;
+    size_t size;
+    size_t pos = 0;
+    ssize_t len;
 
     singularity_message(DEBUG, "Called filecat(%s)\n", path);
     
@@ -631,31 +757,57 @@ char *filecat(char *path) {
         return(NULL);
     }
 
-    if ( ( fd = fopen(path, "r") ) == NULL ) { // Flawfinder: ignore
+    if ( ( fd = open(path, O_RDONLY | O_CLOEXEC) ) < 0 ) { // Flawfinder: ignore
         singularity_message(ERROR, "Could not read from %s: %s\n", path, strerror(errno));
         return(NULL);
     }
 
-
-    if ( fseek(fd, 0L, SEEK_END) < 0 ) {
-        singularity_message(ERROR, "Could not seek to end of file %s: %s\n", path, strerror(errno));
-        fclose(fd);
+    if ( fstat(fd, &filestat) < 0 ) {
+        singularity_message(ERROR, "Could not fstat() on %s: %s\n", path, strerror(errno));
+        close(fd);
         return(NULL);
     }
 
-    length = ftell(fd);
+    // The size is only a hint, files in /proc report 0 and files may grow
+    size = filestat.st_size > 0 ? filestat.st_size + 1 : 4096;
+    if ( ( ret = (char *) malloc(size) ) == NULL ) {
+        singularity_message(ERROR, "Could not allocate memory to read %s\n", path);
+        close(fd);
+        return(NULL);
+    }
 
-    rewind(fd);
+    while ( 1 ) {
+        if ( pos + 1 >= size ) {
+            char *grown;
 
-    ret = (char *) malloc(length+1);
+            size *= 2;
+            if ( ( grown = (char *) realloc(ret, size) ) == NULL ) {
+                singularity_message(ERROR, "Could not allocate memory to read %s\n", path);
+                free(ret);
+                close(fd);
+                return(NULL);
+            }
+            ret = grown;
+        }
 
-    while ( ( c = fgetc(fd) ) != EOF ) { // Flawfinder: ignore (checked boundries)
-        ret[pos] = c;
-        pos++;
+        len = read(fd, ret + pos, size - pos - 1); // Flawfinder: ignore (bounded by buffer size)
+        if ( len == 0 ) {
+            break;
+        }
+        if ( len < 0 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            singularity_message(ERROR, "Could not read from %s: %s\n", path, strerror(errno));
+            free(ret);
+            close(fd);
+            return(NULL);
+        }
+        pos += len;
     }
     ret[pos] = '\0';
 
-    fclose(fd);
+    close(fd);
 
     return(ret);
 }
@@ -27,13 +27,14 @@
 void container_statdir_update(unsigned char);
 char *file_id(char *path);
 char *file_devino(char *path);
+#include <sys/types.h>
 #include <sys/stat.h>
 int chk_perms(char *path, mode_t mode);
 int chk_mode(char *path, mode_t mode, mode_t mask);
-int is_file(char *path);
+int is_file(const char *path);
 int is_fifo(char *path);
 int is_link(char *path);
-int is_dir(char *path);
+int is_dir(const char *path);
 int is_exec(char *path);
 int is_write(char *path);
 int is_suid(char *path);
@@ -43,6 +44,11 @@ int is_chr(char *path);
 int s_mkpath(char *dir, mode_t mode);
 int container_mkpath(char *dir, mode_t mode);
 int s_rmdir(char *dir);
+#define COPY_FD_AUTO 0
+#define COPY_FD_RANGE 1
+#define COPY_FD_SENDFILE 2
+#define COPY_FD_READWRITE 3
+ssize_t copy_fd(int source_fd, int dest_fd, int strategy);
 int copy_file(char * source, char * dest);
 char *filecat(char *path);
 int fileput(char *path, char *string);
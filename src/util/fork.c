@@ -33,7 +33,10 @@
 #include <sys/types.h>
 #include <sys/resource.h>
 #include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/signalfd.h>
 #include <stdio.h>
+#include <stdint.h>
 
 
 #include "util/privilege.h"
@@ -50,6 +53,45 @@ pid_t child_pid;
 
 struct pollfd fds[2];
 
+#ifndef SYS_clone3
+#define SYS_clone3 435
+#endif
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+#ifndef CLONE_PIDFD
+#define CLONE_PIDFD 0x00001000
+#endif
+
+/* First version of struct clone_args from linux/sched.h */
+struct fork_clone_args {
+    uint64_t flags;
+    uint64_t pidfd;
+    uint64_t child_tid;
+    uint64_t parent_tid;
+    uint64_t exit_signal;
+    uint64_t stack;
+    uint64_t stack_size;
+    uint64_t tls;
+};
+
+int singularity_fork_pidfd = 1;
+static int child_pidfd = -1;
+static int signal_fd = -1;
+static sigset_t signal_fd_old_mask;
+
+static const int forwarded_signals[] = {
+    SIGINT,
+    SIGQUIT,
+    SIGTERM,
+    SIGHUP,
+    SIGUSR1,
+    SIGUSR2,
+    0
+};
+
 typedef struct fork_state_s
 {
     sigjmp_buf env;
@@ -195,16 +237,27 @@ static int wait_child() {
             ABORT(255);
         }
             
-        /* When SIGCHILD is received, set child_ok = 0 to break out of loop */
+        /* When SIGCHILD is received (or the pidfd is readable), set child_ok = 0 to break out of loop */
         if (fds[0].revents) {
-            singularity_message(DEBUG, "SIGCHLD raised, parent is exiting\n");
+            singularity_message(DEBUG, "Child exited, parent is exiting\n");
             child_ok = 0;
         }
 
         /* If we catch any other signal, */
         if (fds[1].revents) {
-            char signum = SIGKILL;
-            while (-1 == (retval = read(generic_signal_rpipe, &signum, 1)) && errno == EINTR) {} // Flawfinder: ignore
+            int signum = SIGKILL;
+
+            if ( signal_fd >= 0 ) {
+                struct signalfd_siginfo siginfo;
+
+                while (-1 == (retval = read(signal_fd, &siginfo, sizeof(siginfo))) && errno == EINTR) {} // Flawfinder: ignore
+                signum = siginfo.ssi_signo;
+            } else {
+                char sig = SIGKILL;
+
+                while (-1 == (retval = read(generic_signal_rpipe, &sig, 1)) && errno == EINTR) {} // Flawfinder: ignore
+                signum = sig;
+            }
             if (-1 == retval) {
                 singularity_message(ERROR, "Failed to read from signal handler pipe: %s\n", strerror(errno));
                 ABORT(255);
@@ -215,7 +268,18 @@ static int wait_child() {
     } while( child_ok );
 
     /* Catch the exit status or kill signal of the child process */
-    waitpid(child_pid, &tmpstatus, 0);
+    while ( -1 == waitpid(child_pid, &tmpstatus, 0) && errno == EINTR ) {}
+
+    /* Unblock the forwarded signals so a signal the child died of also
+     * reaches us below */
+    if ( child_pidfd >= 0 ) {
+        close(child_pidfd);
+        close(signal_fd);
+        child_pidfd = -1;
+        signal_fd = -1;
+        sigprocmask(SIG_SETMASK, &signal_fd_old_mask, NULL);
+    }
+
     if (WIFEXITED(tmpstatus)) {
         return(WEXITSTATUS(tmpstatus));
     } else if (WIFSIGNALED(tmpstatus)) {
@@ -251,9 +315,77 @@ static int fork_ns(unsigned int flags) {
           (SIGCHLD|flags),
           &state
          );
+
+    /* Only the child (which has its own copy) runs on this stack */
+    free(child_stack_ptr - stack_size);
+    return retval;
+}
+
+/* Fork and open a pidfd for the child (Linux 5.3+). Without namespace flags
+ * this is fork() and pidfd_open(), so glibc runs its fork handlers. New
+ * namespaces need clone3() with CLONE_PIDFD, the child then continues on a
+ * copy of our stack like fork() but, as with the clone() of fork_ns(), no
+ * pthread_atfork() handlers run. glibc before 2.25 caches the PID and a raw
+ * clone3() leaves the parent's in the child, so fork_ns() is used there. */
+static int fork_pidfd(unsigned int flags) {
+    struct fork_clone_args args;
+    int pidfd = -1;
+    long retval;
+
+    if ( flags == 0 ) {
+        retval = fork();
+        if ( retval > 0 ) {
+            if ( ( pidfd = syscall(SYS_pidfd_open, retval, 0) ) >= 0 ) {
+                child_pidfd = pidfd;
+            } else {
+                singularity_message(DEBUG, "pidfd_open() failed, using signal handlers: %s\n", strerror(errno));
+                singularity_fork_pidfd = 0;
+            }
+        }
+        return retval;
+    }
+
+#if defined(__GLIBC__) && defined(__GLIBC_PREREQ)
+#if !__GLIBC_PREREQ(2, 25)
+    errno = ENOSYS;
+    return(-1);
+#endif
+#endif
+
+    memset(&args, 0, sizeof(args));
+    args.flags = (uint64_t)flags | CLONE_PIDFD;
+    args.pidfd = (uint64_t)(uintptr_t)&pidfd;
+    args.exit_signal = SIGCHLD;
+
+    retval = syscall(SYS_clone3, &args, sizeof(args));
+    if ( retval > 0 ) {
+        child_pidfd = pidfd;
+    }
     return retval;
 }
 
+/* Block the signals we forward to the child and read them from a signalfd
+ * instead of installing handlers */
+static void install_signalfd() {
+    sigset_t mask;
+    int i;
+
+    sigemptyset(&mask);
+    for ( i = 0; forwarded_signals[i] != 0; i++ ) {
+        sigaddset(&mask, forwarded_signals[i]);
+    }
+
+    singularity_message(DEBUG, "Creating signalfd for forwarded signals\n");
+    if ( -1 == sigprocmask(SIG_BLOCK, &mask, &signal_fd_old_mask) ) {
+        singularity_message(ERROR, "Unable to block signals: %s\n", strerror(errno));
+        ABORT(255);
+    }
+    if ( -1 == (signal_fd = signalfd(-1, &mask, SFD_CLOEXEC)) ) {
+        singularity_message(ERROR, "Failed to create signalfd: %s\n", strerror(errno));
+        ABORT(255);
+    }
+}
+
 void install_generic_signal_handle() {
     int pipes[2];
     struct sigaction action;
@@ -293,6 +425,9 @@ void install_generic_signal_handle() {
     }
 
     /* Open pipes for handle_signal() to write to */
+    if ( generic_signal_rpipe >= 0 ) {
+        return;
+    }
     singularity_message(DEBUG, "Creating generic signal pipes\n");
     if ( -1 == pipe2(pipes, O_CLOEXEC) ) {
         singularity_message(ERROR, "Failed to create communication pipes: %s\n", strerror(errno));
@@ -321,6 +456,9 @@ void install_sigchld_signal_handle() {
     }
     
     /* Open pipes for handle_sigchld() to write to */
+    if ( sigchld_signal_rpipe >= 0 ) {
+        return;
+    }
     singularity_message(DEBUG, "Creating sigchld signal pipes\n");
     if ( -1 == pipe2(pipes, O_CLOEXEC) ) {
         singularity_message(ERROR, "Failed to create communication pipes: %s\n", strerror(errno));
@@ -344,7 +482,16 @@ pid_t singularity_fork(unsigned int flags) {
         singularity_priv_escalate();
     }
     
-    child_pid = fork_ns(flags);
+    child_pid = -1;
+    if ( singularity_fork_pidfd == 1 ) {
+        if ( ( child_pid = fork_pidfd(flags) ) < 0 ) {
+            singularity_message(DEBUG, "Forking with a pidfd failed, using clone(): %s\n", strerror(errno));
+            singularity_fork_pidfd = 0;
+        }
+    }
+    if ( child_pid < 0 ) {
+        child_pid = fork_ns(flags);
+    }
 
     if ( priv_fork == 1 ) {
         singularity_priv_drop();
@@ -361,23 +508,31 @@ pid_t singularity_fork(unsigned int flags) {
         singularity_message(VERBOSE2, "Hello from parent process\n");
         prepare_pipes_parent();
         
-        /* Set signal mask to block all signals while we set up sig actions */
-        sigset_t blocked_mask, old_mask;
-        sigfillset(&blocked_mask);
-        sigprocmask(SIG_SETMASK, &blocked_mask, &old_mask);
+        if ( child_pidfd >= 0 ) {
+            /* The pidfd becomes readable when the child exits, no SIGCHLD handler needed */
+            install_signalfd();
 
-        /* Now that we can't receive any signals, install signal handlers for all signals we want to catch */
-        install_generic_signal_handle();
-        install_sigchld_signal_handle();
+            fds[0].fd = child_pidfd;
+            fds[1].fd = signal_fd;
+        } else {
+            /* Set signal mask to block all signals while we set up sig actions */
+            sigset_t blocked_mask, old_mask;
+            sigfillset(&blocked_mask);
+            sigprocmask(SIG_SETMASK, &blocked_mask, &old_mask);
+
+            /* Now that we can't receive any signals, install signal handlers for all signals we want to catch */
+            install_generic_signal_handle();
+            install_sigchld_signal_handle();
 
-        /* Set signal mask back to the original mask, unblocking the blocked signals */
-        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+            /* Set signal mask back to the original mask, unblocking the blocked signals */
+            sigprocmask(SIG_SETMASK, &old_mask, NULL);
 
-        /* Set fds[n].fd to the read pipes created earlier */
-        fds[0].fd = sigchld_signal_rpipe;
+            /* Set fds[n].fd to the read pipes created earlier */
+            fds[0].fd = sigchld_signal_rpipe;
+            fds[1].fd = generic_signal_rpipe;
+        }
         fds[0].events = POLLIN;
         fds[0].revents = 0;
-        fds[1].fd = generic_signal_rpipe;
         fds[1].events = POLLIN;
         fds[1].revents = 0;
 
@@ -431,6 +586,7 @@ int singularity_fork_exec(unsigned int flags, char **argv) {
         }
 
         singularity_message(VERBOSE, "Running child program: %s\n", argv[0]);
+        singularity_message_flush();
         if ( execvp(argv[0], argv) < 0 ) { //Flawfinder: ignore
             singularity_message(ERROR, "Failed to exec program %s: %s\n", argv[0], strerror(errno));
             ABORT(255);
@@ -438,6 +594,11 @@ int singularity_fork_exec(unsigned int flags, char **argv) {
 
     } else if ( child > 0 ) {
         retval = wait_child();
+
+        /* The child is gone, don't leak its coordination pipes */
+        close(coordination_pipe[0]);
+        close(coordination_pipe[1]);
+        coordination_pipe[0] = coordination_pipe[1] = -1;
     }
 
     singularity_message(DEBUG, "Returning from singularity_fork_exec with: %d\n", retval);
@@ -23,6 +23,15 @@
 #ifndef __SINGULARITY_FORK_H_
 #define __SINGULARITY_FORK_H_
 
+    // SINGULARITY_FORK_PIDFD
+    // Children are created with fork() and pidfd_open(), or clone3(CLONE_PIDFD)
+    // for new namespaces, and supervised through the pidfd and a signalfd when
+    // this is 1 (the default). It is reset to 0 if the kernel (or for
+    // namespaces a glibc before 2.25) doesn't support it, in which case
+    // clone() and the signal handler pipes are used.
+    extern int singularity_fork_pidfd;
+
+
     // SINGULARITY_FORK()
     // Wrap the fork() system call and create the necessary communication
     // pipes and signal handlers so that signals are correctly passed around
@@ -30,19 +30,222 @@
 #include <stdarg.h>
 #include <syslog.h>
 #include <libgen.h>
+#include <errno.h>
+#include <paths.h>
+#include <time.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
 
 #include "config.h"
 #include "util/util.h"
 #include "util/message.h"
 
+#define SYSLOG_QUEUE_LEN 32
+#define SYSLOG_MAX_LEN 640
+#define SYSLOG_FLUSH_TRIES 10
+#define SYSLOG_FLUSH_WAIT 10 // msec
+
 int messagelevel = -99;
 
 extern const char *__progname;
 
+// LOG and higher messages go to syslog through our own non blocking
+// socket: syslog() blocks once the syslog daemon stops keeping up. Messages
+// that can not be sent right away are queued and sent with the next one or
+// at exit, those that do not fit in the queue are dropped and counted. (A
+// writer thread is not an option, unshare(CLONE_NEWUSER) requires a single
+// threaded process.)
+static int syslog_fd = -1;
+static int syslog_blocking = 0;
+static int syslog_unavailable = 0;
+static pid_t syslog_pid = 0;
+static dev_t syslog_dev;
+static ino_t syslog_ino;
+static char syslog_queue[SYSLOG_QUEUE_LEN][SYSLOG_MAX_LEN];
+static int syslog_queue_head = 0;
+static int syslog_queue_count = 0;
+static unsigned long syslog_dropped = 0;
+static unsigned long syslog_dropped_reported = 0;
+
+static void syslog_open(void) {
+    struct sockaddr_un addr;
+    struct stat st;
+
+    if ( ( syslog_fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0) ) < 0 ) {
+        return;
+    }
+
+    memset(&addr, '\0', sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, _PATH_LOG, sizeof(addr.sun_path) - 1); // Flawfinder: ignore
+
+    if ( connect(syslog_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || fstat(syslog_fd, &st) < 0 ) {
+        if ( errno == EPROTOTYPE ) {
+            // A stream socket, leave it to syslog()
+            openlog("Singularity", LOG_CONS | LOG_NDELAY, LOG_LOCAL0);
+            syslog_blocking = 1;
+        } else if ( errno == ENOENT ) {
+            // No syslog here, do not try again for every message
+            syslog_unavailable = 1;
+        }
+        close(syslog_fd);
+        syslog_fd = -1;
+        return;
+    }
+
+    syslog_dev = st.st_dev;
+    syslog_ino = st.st_ino;
+}
+
+// Returns 0 once msg is sent. fd_cleanup() closes all sockets, so the
+// descriptor is checked to still be ours (and not a reused number) first.
+static int syslog_send(const char *msg) {
+    struct stat st;
+
+    if ( syslog_fd >= 0 && ( fstat(syslog_fd, &st) < 0 || st.st_dev != syslog_dev || st.st_ino != syslog_ino ) ) {
+        syslog_fd = -1;
+    }
+    if ( syslog_fd < 0 ) {
+        if ( syslog_unavailable ) {
+            return(-1);
+        }
+        syslog_open();
+        if ( syslog_fd < 0 ) {
+            return(-1);
+        }
+    }
+
+    if ( send(syslog_fd, msg, strlen(msg), MSG_DONTWAIT | MSG_NOSIGNAL) < 0 ) {
+        if ( errno != EAGAIN && errno != EWOULDBLOCK && errno != ENOBUFS ) {
+            close(syslog_fd);
+            syslog_fd = -1;
+        }
+        return(-1);
+    }
+
+    return(0);
+}
+
+static void syslog_format(char *msg, int priority, const char *string) {
+    char timestamp[32];
+    time_t now = time(NULL);
+    struct tm tm;
+
+    if ( localtime_r(&now, &tm) == NULL || strftime(timestamp, sizeof(timestamp), "%b %e %H:%M:%S", &tm) == 0 ) {
+        timestamp[0] = '\0';
+    }
+    snprintf(msg, SYSLOG_MAX_LEN, "<%d>%s Singularity: %s", LOG_LOCAL0 | priority, timestamp, string); // Flawfinder: ignore
+}
+
+static void syslog_flush(void) {
+    while ( syslog_queue_count > 0 ) {
+        if ( syslog_send(syslog_queue[syslog_queue_head]) < 0 ) {
+            return;
+        }
+        syslog_queue_head = ( syslog_queue_head + 1 ) % SYSLOG_QUEUE_LEN;
+        syslog_queue_count--;
+    }
+
+    if ( syslog_dropped > syslog_dropped_reported ) {
+        char string[128];
+        char msg[SYSLOG_MAX_LEN];
+
+        snprintf(string, sizeof(string), "%s (U=%d,P=%d)> %lu messages dropped, syslog is not keeping up\n", // Flawfinder: ignore
+                __progname, geteuid(), getpid(), syslog_dropped - syslog_dropped_reported);
+        syslog_format(msg, LOG_WARNING, string);
+        if ( syslog_send(msg) == 0 ) {
+            syslog_dropped_reported = syslog_dropped;
+        }
+    }
+}
+
+// A forked child inherits the queue of its parent, which sends it itself.
+// Start over with an empty queue rather than sending messages twice.
+static void syslog_fork_check(void) {
+    pid_t pid = getpid();
+
+    if ( pid != syslog_pid ) {
+        syslog_pid = pid;
+        syslog_queue_head = 0;
+        syslog_queue_count = 0;
+        syslog_dropped = 0;
+        syslog_dropped_reported = 0;
+    }
+}
+
+static void syslog_write(int priority, const char *string) {
+    int tail;
+
+    if ( syslog_blocking ) {
+        syslog(priority, "%s", string);
+        return;
+    }
+    if ( syslog_unavailable ) {
+        return;
+    }
+
+    syslog_fork_check();
+    syslog_flush();
+    if ( syslog_queue_count == 0 ) {
+        char msg[SYSLOG_MAX_LEN];
+
+        syslog_format(msg, priority, string);
+        if ( syslog_send(msg) == 0 ) {
+            return;
+        }
+    }
+
+    if ( syslog_queue_count == SYSLOG_QUEUE_LEN ) {
+        syslog_dropped++;
+        return;
+    }
+
+    tail = ( syslog_queue_head + syslog_queue_count ) % SYSLOG_QUEUE_LEN;
+    syslog_format(syslog_queue[tail], priority, string);
+    syslog_queue_count++;
+}
+
+/*
+ * Sends the queued syslog messages, waiting up to SYSLOG_FLUSH_TRIES times
+ * SYSLOG_FLUSH_WAIT msec for syslog to catch up. What is still queued after
+ * that is counted as dropped. Called at exit, and has to be called before
+ * exec() as the queue is lost then.
+ */
+void singularity_message_flush(void) {
+    struct pollfd pfd;
+    int tries;
+
+    syslog_fork_check();
+    for ( tries = 0; tries < SYSLOG_FLUSH_TRIES; tries++ ) {
+        syslog_flush();
+        if ( ( syslog_queue_count == 0 && syslog_dropped == syslog_dropped_reported ) || syslog_fd < 0 ) {
+            break;
+        }
+        pfd.fd = syslog_fd;
+        pfd.events = POLLOUT;
+        poll(&pfd, 1, SYSLOG_FLUSH_WAIT);
+    }
+
+    if ( syslog_queue_count > 0 ) {
+        syslog_dropped += syslog_queue_count;
+        syslog_queue_head = 0;
+        syslog_queue_count = 0;
+    }
+    if ( syslog_dropped > syslog_dropped_reported ) {
+        singularity_message(DEBUG, "%lu syslog messages were dropped\n", syslog_dropped - syslog_dropped_reported);
+        syslog_dropped_reported = syslog_dropped;
+    }
+}
+
 static void message_init(void) {
     char *messagelevel_string = getenv("SINGULARITY_MESSAGELEVEL"); // Flawfinder: ignore (need to get string, validation in atol())
 
-    openlog("Singularity", LOG_CONS | LOG_NDELAY, LOG_LOCAL0);
+    // Opened now, as later messages may be sent from within the container
+    syslog_pid = getpid();
+    syslog_open();
+    atexit(singularity_message_flush);
 
     if ( messagelevel_string == NULL ) {
         messagelevel = 5;
@@ -73,6 +276,16 @@ void _singularity_message(int level, const char *function, const char *file_in,
     char *prefix = NULL;
     char *color = NULL;
     va_list args;
+
+    if ( messagelevel == -99 ) {
+        message_init();
+    }
+
+    // Only format what is going to be logged or printed
+    if ( level > LOG && level > messagelevel ) {
+        return;
+    }
+
     va_start (args, format);
 
     if (vsnprintf(message, 512, format, args) >= 512) { // Flawfinder: ignore (args are not user modifyable)
@@ -82,10 +295,6 @@ void _singularity_message(int level, const char *function, const char *file_in,
 
     va_end (args);
 
-    if ( messagelevel == -99 ) {
-        message_init();
-    }
-
     while( ( ! isalpha(file[0]) ) && ( file[0] != '\0') ) {
         file++;
     }
@@ -133,7 +342,7 @@ void _singularity_message(int level, const char *function, const char *file_in,
             syslog_string[559] = '\0';
         }
 
-        syslog(syslog_level, "%s", syslog_string);
+        syslog_write(syslog_level, syslog_string);
     }
 
     if ( level <= messagelevel ) {
@@ -163,17 +372,16 @@ void _singularity_message(int level, const char *function, const char *file_in,
 
         if ( level == INFO && messagelevel == INFO ) {
             printf("%s" ANSI_COLOR_RESET, message); // Flawfinder: ignore (false alarm, format is constant)
+            fflush(stdout);
         } else if ( level == INFO ) {
             printf("%s%s" ANSI_COLOR_RESET, header_string, message); // Flawfinder: ignore (false alarm, format is constant)
+            fflush(stdout);
         } else if ( level == LOG && messagelevel <= INFO ) {
             // Don't print anything...
         } else {
             fprintf(stderr, "%s%s" ANSI_COLOR_RESET, header_string, message); // Flawfinder: ignore (false alarm, format is constant)
         }
 
-        fflush(stdout);
-        fflush(stderr);
-
     }
 
 }
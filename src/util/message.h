@@ -52,10 +52,22 @@
     #define ANSI_COLOR_LIGHTCYAN    "\x1b[96m"
     #define ANSI_COLOR_RESET        "\x1b[0m"
 
+    extern int messagelevel;
+
     int singularity_message_level(void);
+    void singularity_message_flush(void);
     void _singularity_message(int level, const char *function, const char *file, int line, char *format, ...) __attribute__ ((__format__(printf, 5, 6))); // Flawfinder: ignore
 
-    #define singularity_message(a,b...) _singularity_message(a, __func__, __FILE__, __LINE__, b)
+    // Messages above the current level are skipped without evaluating their
+    // arguments (-99 means the level is not known yet). Configuring with
+    // --disable-debug-messages compiles DEBUG messages out entirely.
+    #ifdef SINGULARITY_NO_DEBUG_MESSAGES
+    #define singularity_message_enabled(a) ( (a) < DEBUG && ( (a) <= LOG || (a) <= messagelevel || messagelevel == -99 ) )
+    #else
+    #define singularity_message_enabled(a) ( (a) <= LOG || (a) <= messagelevel || messagelevel == -99 )
+    #endif
+
+    #define singularity_message(a,b...) do { if ( singularity_message_enabled(a) ) _singularity_message(a, __func__, __FILE__, __LINE__, b); } while (0)
 
     #define singularity_abort(a,b...) do {_singularity_message(ABRT,  __func__, __FILE__, __LINE__, b); _singularity_message(ABRT,  __func__, __FILE__, __LINE__, "Retval = %d\n", a); exit(a);} while(0)
 
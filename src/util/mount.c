@@ -13,6 +13,7 @@
  * 
 */
 
+#define _GNU_SOURCE
 #include <errno.h>
 #include <fcntl.h>
 #include <stdio.h>
@@ -24,14 +25,57 @@
 #include <stdlib.h>
 #include <limits.h>
 #include <libgen.h>
+#include <search.h>
 
 #include "config.h"
 #include "util/file.h"
 #include "util/util.h"
 #include "util/message.h"
 #include "util/privilege.h"
+#include "util/trace.h"
+#include "util/registry.h"
+#include "util/mount.h"
 
-#define MAX_LINE_LEN 2048
+#define MOUNTINFO "/proc/self/mountinfo"
+#define MOUNT_INDEX_MIN 256
+
+struct mount_plan_entry {
+    char *source;
+    char *target;
+    char *key;
+    char *fstype;
+    char *data;
+    unsigned long flags;
+    unsigned long remount_flags;
+    int options;
+};
+
+static struct mount_flag_name {
+    unsigned long flag;
+    const char *name;
+} mount_flag_names[] = {
+    { MS_BIND, "bind" },
+    { MS_REC, "rec" },
+    { MS_REMOUNT, "remount" },
+    { MS_RDONLY, "ro" },
+    { MS_NOSUID, "nosuid" },
+    { MS_NODEV, "nodev" },
+    { MS_NOEXEC, "noexec" },
+    { MS_PRIVATE, "private" },
+    { MS_SLAVE, "slave" },
+    { 0, NULL }
+};
+
+static struct mount_plan_entry *mount_plan = NULL;
+static int mount_plan_count = 0;
+static int mount_plan_size = 0;
+static int mount_plan_escalated = 0;
+
+static struct hsearch_data mount_table;
+static struct mount_entry **mount_entries = NULL;
+static int mount_entries_count = 0;
+static int mount_entries_size = 0;
+static int mount_table_size = 0;
 
 struct resolved_container_path {
     char *mountdir;
@@ -40,6 +84,8 @@ struct resolved_container_path {
     char *session;
 };
 
+static struct resolved_container_path container_path;
+
 static void resolve_container_path(struct resolved_container_path *container_path) {
     if ( container_path->mountdir == NULL ) {
         container_path->mountdir = realpath(CONTAINER_MOUNTDIR, NULL); // Flawfinder: ignore
@@ -71,6 +117,281 @@ static void resolve_container_path(struct resolved_container_path *container_pat
     }
 }
 
+/* Mount points in mountinfo have space, tab, newline and backslash escaped
+ * as \ooo octal sequences, decode them in place */
+static char *mount_unescape(char *str) {
+    char *in = str;
+    char *out = str;
+
+    while ( *in != '\0' ) {
+        if ( in[0] == '\\' &&
+             in[1] >= '0' && in[1] <= '7' &&
+             in[2] >= '0' && in[2] <= '7' &&
+             in[3] >= '0' && in[3] <= '7' ) {
+            *out++ = ( ( in[1] - '0' ) << 6 ) | ( ( in[2] - '0' ) << 3 ) | ( in[3] - '0' );
+            in += 4;
+        } else {
+            *out++ = *in++;
+        }
+    }
+    *out = '\0';
+
+    return(str);
+}
+
+static void mount_index_hash(void) {
+    int i;
+
+    if ( mount_table_size > 0 ) {
+        hdestroy_r(&mount_table);
+    }
+
+    mount_table_size = mount_entries_count * 2 + MOUNT_INDEX_MIN;
+    memset(&mount_table, 0, sizeof(mount_table));
+
+    if ( hcreate_r(mount_table_size, &mount_table) == 0 ) {
+        singularity_message(ERROR, "Internal error - Unable to create mount index: %s\n", strerror(errno));
+        ABORT(255);
+    }
+
+    for ( i = 0; i < mount_entries_count; i++ ) {
+        ENTRY item;
+        ENTRY *found;
+
+        item.key = mount_entries[i]->mountpoint;
+        item.data = mount_entries[i];
+
+        /* Stacked mounts share a key, the first entry is enough */
+        if ( hsearch_r(item, ENTER, &found, &mount_table) == 0 ) {
+            singularity_message(ERROR, "Internal error - Unable to add to mount index: %s\n", strerror(errno));
+            ABORT(255);
+        }
+    }
+}
+
+static void mount_index_add(const char *source, const char *mountpoint, const char *fstype) {
+    ENTRY item;
+    ENTRY *found;
+    struct mount_entry *entry;
+
+    item.key = (char *)mountpoint;
+    item.data = NULL;
+
+    /* Already a mount point, the index only answers whether it is one */
+    if ( mount_table_size > 0 && hsearch_r(item, FIND, &found, &mount_table) != 0 ) {
+        return;
+    }
+
+    entry = (struct mount_entry *)malloc(sizeof(struct mount_entry));
+    if ( entry == NULL ) {
+        singularity_message(ERROR, "Failed to allocate memory for mount index\n");
+        ABORT(255);
+    }
+    entry->source = strdup(source ? source : "none");
+    entry->mountpoint = strdup(mountpoint);
+    entry->fstype = strdup(fstype ? fstype : "none");
+
+    if ( mount_entries_count == mount_entries_size ) {
+        mount_entries_size = mount_entries_size ? mount_entries_size * 2 : MOUNT_INDEX_MIN;
+        mount_entries = (struct mount_entry **)realloc(mount_entries, mount_entries_size * sizeof(struct mount_entry *));
+        if ( mount_entries == NULL ) {
+            singularity_message(ERROR, "Failed to allocate memory for mount index\n");
+            ABORT(255);
+        }
+    }
+    mount_entries[mount_entries_count++] = entry;
+
+    if ( mount_table_size == 0 ) {
+        // Still loading, mount_index_load() hashes everything at once
+        return;
+    }
+
+    /* Rebuild the hash before glibc would refuse new entries */
+    if ( mount_entries_count * 2 < mount_table_size ) {
+        item.key = entry->mountpoint;
+        item.data = entry;
+        if ( hsearch_r(item, ENTER, &found, &mount_table) != 0 ) {
+            return;
+        }
+    }
+    mount_index_hash();
+}
+
+static void mount_index_reset(void) {
+    int i;
+
+    for ( i = 0; i < mount_entries_count; i++ ) {
+        free(mount_entries[i]->source);
+        free(mount_entries[i]->mountpoint);
+        free(mount_entries[i]->fstype);
+        free(mount_entries[i]);
+    }
+    free(mount_entries);
+    mount_entries = NULL;
+    mount_entries_count = 0;
+    mount_entries_size = 0;
+
+    if ( mount_table_size > 0 ) {
+        hdestroy_r(&mount_table);
+        mount_table_size = 0;
+    }
+}
+
+static void mount_index_load(void) {
+    FILE *mountinfo;
+    char *line = NULL;
+    size_t len = 0;
+
+    if ( mount_table_size > 0 ) {
+        return;
+    }
+
+    singularity_message(DEBUG, "Building mount index from %s\n", MOUNTINFO);
+    if ( ( mountinfo = fopen(MOUNTINFO, "r") ) == NULL ) { // Flawfinder: ignore
+        singularity_message(ERROR, "Could not open %s: %s\n", MOUNTINFO, strerror(errno));
+        ABORT(255);
+    }
+
+    /* id parent major:minor root mountpoint options [optional...] - fstype source superoptions */
+    while ( getline(&line, &len, mountinfo) > 0 ) {
+        char *saveptr = NULL;
+        char *mountpoint = NULL;
+        char *fstype = NULL;
+        char *source = NULL;
+        char *tok;
+        int field = 0;
+
+        for ( tok = strtok_r(line, " \n", &saveptr); tok != NULL; tok = strtok_r(NULL, " \n", &saveptr) ) {
+            if ( field == 4 ) {
+                mountpoint = tok;
+            } else if ( field > 5 && strcmp(tok, "-") == 0 ) {
+                fstype = strtok_r(NULL, " \n", &saveptr);
+                source = strtok_r(NULL, " \n", &saveptr);
+                break;
+            }
+            field++;
+        }
+
+        if ( mountpoint == NULL || fstype == NULL ) {
+            singularity_message(VERBOSE3, "Skipping malformed line in %s\n", MOUNTINFO);
+            continue;
+        }
+
+        mount_index_add(source ? mount_unescape(source) : NULL, mount_unescape(mountpoint), fstype);
+    }
+
+    free(line);
+    fclose(mountinfo);
+
+    mount_index_hash();
+
+    singularity_message(DEBUG, "Mount index holds %d entries\n", mount_entries_count);
+}
+
+/* Record a mount that just succeeded. A recursive bind also carries every
+ * mount below the source over to the target. */
+static void mount_index_update(const char *source, const char *target, const char *filesystemtype, unsigned long mountflags) {
+    if ( mount_table_size == 0 ) {
+        // Index was never built, it will read the current state when needed
+        return;
+    }
+
+    if ( mountflags & MS_MOVE ) {
+        mount_index_reset();
+        return;
+    }
+
+    if ( mountflags & ( MS_REMOUNT | MS_PRIVATE | MS_SLAVE | MS_SHARED | MS_UNBINDABLE ) ) {
+        return;
+    }
+
+    if ( ( mountflags & MS_BIND ) && source != NULL ) {
+        char *realsource = realpath(source, NULL); // Flawfinder: ignore
+        const char *fstype = NULL;
+        size_t fstype_len = 0;
+        int count = mount_entries_count;
+        int i;
+
+        if ( realsource == NULL ) {
+            mount_index_add(source, target, filesystemtype);
+            return;
+        }
+
+        for ( i = 0; i < count; i++ ) {
+            struct mount_entry *entry = mount_entries[i];
+            size_t len = strlen(entry->mountpoint);
+
+            if ( strcmp(entry->mountpoint, "/") != 0 &&
+                 ( strncmp(realsource, entry->mountpoint, len) != 0 ||
+                   ( realsource[len] != '\0' && realsource[len] != '/' ) ) ) {
+                continue;
+            }
+            if ( fstype == NULL || len > fstype_len ) {
+                fstype = entry->fstype;
+                fstype_len = len;
+            }
+        }
+        mount_index_add(source, target, fstype);
+
+        if ( mountflags & MS_REC ) {
+            size_t source_len = strcmp(realsource, "/") == 0 ? 0 : strlen(realsource);
+
+            for ( i = 0; i < count; i++ ) {
+                struct mount_entry *entry = mount_entries[i];
+                char *submount;
+
+                if ( strncmp(entry->mountpoint, realsource, source_len) != 0 ||
+                     entry->mountpoint[source_len] != '/' ||
+                     entry->mountpoint[source_len + 1] == '\0' ) {
+                    continue;
+                }
+
+                submount = joinpath(target, &entry->mountpoint[source_len]);
+                mount_index_add(entry->source, submount, entry->fstype);
+                free(submount);
+            }
+        }
+
+        free(realsource);
+        return;
+    }
+
+    mount_index_add(source, target, filesystemtype);
+}
+
+/* Return 1 if path (an absolute real path) is a mount point, 0 if not */
+int singularity_mount_index_find(const char *path) {
+    ENTRY item;
+    ENTRY *found;
+
+    mount_index_load();
+
+    item.key = (char *)path;
+    item.data = NULL;
+
+    if ( hsearch_r(item, FIND, &found, &mount_table) == 0 ) {
+        return(0);
+    }
+
+    return(1);
+}
+
+int singularity_mount_index_count(void) {
+    mount_index_load();
+
+    return(mount_entries_count);
+}
+
+struct mount_entry *singularity_mount_index_entry(int index) {
+    mount_index_load();
+
+    if ( index < 0 || index >= mount_entries_count ) {
+        return(NULL);
+    }
+
+    return(mount_entries[index]);
+}
+
 int singularity_mount(const char *source, const char *target,
                       const char *filesystemtype, unsigned long mountflags,
                       const void *data) {
@@ -80,11 +401,14 @@ int singularity_mount(const char *source, const char *target,
     char dest[PATH_MAX];
     char *realdest, *realtarget;
     int target_fd = -1;
-    static struct resolved_container_path container_path;
 
     resolve_container_path(&container_path);
 
     if ( ( mountflags & MS_REMOUNT ) == 0 ) {
+        if ( mount_plan_escalated ) {
+            // Look the target up with the calling user's permissions
+            setfsuid(singularity_priv_getuid());
+        }
         target_fd = open(target, O_RDONLY);
 
         if ( target_fd < 0 ) {
@@ -127,7 +451,7 @@ int singularity_mount(const char *source, const char *target,
 
     /* don't modify user groups */
     if ( singularity_priv_userns_enabled() == 0 ) {
-        if ( seteuid(0) < 0 ) {
+        if ( mount_plan_escalated == 0 && seteuid(0) < 0 ) {
             singularity_message(ERROR, "Failed to escalate privileges: %s\n", strerror(errno));
             ABORT(255);
         }
@@ -135,15 +459,20 @@ int singularity_mount(const char *source, const char *target,
         setfsuid(fsuid);
     }
 
+    singularity_trace_count(TRACE_MOUNT);
     ret = mount(source, realtarget, filesystemtype, mountflags, data);
     mount_errno = errno;
 
     if ( target_fd >= 0 ) {
         close(target_fd);
     }
+
+    if ( ret == 0 ) {
+        mount_index_update(source, realdest, filesystemtype, mountflags);
+    }
     free(realdest);
 
-    if ( singularity_priv_userns_enabled() == 0 && seteuid(singularity_priv_getuid()) < 0 ) {
+    if ( singularity_priv_userns_enabled() == 0 && mount_plan_escalated == 0 && seteuid(singularity_priv_getuid()) < 0 ) {
         singularity_message(ERROR, "Failed to drop privileges: %s\n", strerror(errno));
         ABORT(255);
     }
@@ -152,10 +481,302 @@ int singularity_mount(const char *source, const char *target,
     return ret;
 }
 
+static int mount_path_under(const char *path, const char *parent) {
+    size_t len = strlen(parent);
+
+    if ( strcmp(parent, "/") == 0 ) {
+        return(1);
+    }
+
+    return( strncmp(path, parent, len) == 0 && ( path[len] == '/' || path[len] == '\0' ) );
+}
+
+/* Key used to compare planned targets. Paths that do not exist yet are
+ * normalized and the container directory prefix is resolved. */
+static char *mount_plan_key(const char *path) {
+    char *key;
+    char *in;
+    char *out;
+    size_t len = strlen(CONTAINER_FINALDIR);
+
+    if ( ( key = realpath(path, NULL) ) != NULL ) { // Flawfinder: ignore
+        return(key);
+    }
+
+    key = strdup(path);
+    for ( in = out = key; *in != '\0'; in++ ) {
+        if ( in[0] == '/' && ( in[1] == '/' || ( in[1] == '\0' && out != key ) ) ) {
+            continue;
+        }
+        *out++ = *in;
+    }
+    *out = '\0';
+
+    if ( strncmp(key, CONTAINER_FINALDIR, len) == 0 && ( key[len] == '/' || key[len] == '\0' ) ) {
+        char *resolved;
+
+        resolve_container_path(&container_path);
+        resolved = strjoin(container_path.finaldir, &key[len]);
+        free(key);
+        key = resolved;
+    }
+
+    return(key);
+}
+
+static int mount_plan_find(const char *path) {
+    int i;
+
+    for ( i = 0; i < mount_plan_count; i++ ) {
+        if ( ( mount_plan[i].flags & MS_REMOUNT ) == 0 && strcmp(mount_plan[i].key, path) == 0 ) {
+            return(1);
+        }
+    }
+
+    return(0);
+}
+
+static void mount_plan_flags(char *buf, size_t size, unsigned long flags) {
+    struct mount_flag_name *f;
+
+    buf[0] = '\0';
+    for ( f = mount_flag_names; f->name != NULL; f++ ) {
+        if ( flags & f->flag ) {
+            if ( buf[0] != '\0' ) {
+                strncat(buf, ",", size - strlen(buf) - 1); // Flawfinder: ignore
+            }
+            strncat(buf, f->name, size - strlen(buf) - 1); // Flawfinder: ignore
+        }
+    }
+    if ( buf[0] == '\0' ) {
+        strncpy(buf, "none", size - 1); // Flawfinder: ignore
+    }
+}
+
+static void mount_plan_dump(struct mount_plan_entry *entry, FILE *out) {
+    char flags[256];
+    char remount[256];
+
+    mount_plan_flags(flags, sizeof(flags), entry->flags);
+    mount_plan_flags(remount, sizeof(remount), entry->remount_flags);
+
+    if ( out != NULL ) {
+        fprintf(out, "%s %s %s %s %s %s\n", entry->key, entry->source ? entry->source : "-", // Flawfinder: ignore
+                entry->fstype ? entry->fstype : "-", flags, entry->remount_flags ? remount : "-",
+                ( entry->data && entry->data[0] != '\0' ) ? entry->data : "-");
+    } else {
+        singularity_message(DEBUG, "Planned mount: %s -> %s (%s) [%s] [%s]\n", entry->source ? entry->source : "none",
+                entry->key, entry->fstype ? entry->fstype : "none", flags, entry->remount_flags ? remount : "none");
+    }
+}
+
+void singularity_mount_plan_add(const char *source, const char *target, const char *filesystemtype,
+                                unsigned long mountflags, const void *data, int options) {
+    struct mount_plan_entry entry;
+    int i;
+
+    if ( target == NULL || target[0] != '/' ) {
+        singularity_message(ERROR, "Internal error - Mount target must be an absolute path: %s\n", target ? target : "(null)");
+        ABORT(255);
+    }
+    if ( ( mountflags & MS_BIND ) && ( mountflags & MS_REMOUNT ) == 0 && source == NULL ) {
+        singularity_message(ERROR, "Internal error - Bind mount to %s has no source\n", target);
+        ABORT(255);
+    }
+
+    entry.key = mount_plan_key(target);
+
+    // A bind remount is folded into the bind it belongs to
+    if ( mountflags & MS_REMOUNT ) {
+        for ( i = mount_plan_count - 1; i >= 0; i-- ) {
+            if ( strcmp(mount_plan[i].key, entry.key) == 0 ) {
+                break;
+            }
+        }
+        if ( i >= 0 && ( mount_plan[i].flags & MS_BIND ) && ( mount_plan[i].flags & MS_REMOUNT ) == 0 && mount_plan[i].remount_flags == 0 ) {
+            mount_plan[i].remount_flags = mountflags;
+            free(entry.key);
+            return;
+        }
+    } else {
+        for ( i = 0; i < mount_plan_count; i++ ) {
+            if ( strcmp(mount_plan[i].key, entry.key) == 0 && mount_plan[i].flags == mountflags &&
+                 strcmp(mount_plan[i].source ? mount_plan[i].source : "", source ? source : "") == 0 &&
+                 strcmp(mount_plan[i].fstype ? mount_plan[i].fstype : "", filesystemtype ? filesystemtype : "") == 0 ) {
+                singularity_message(VERBOSE, "Skipping duplicate planned mount: %s -> %s\n", source ? source : "none", target);
+                free(entry.key);
+                return;
+            }
+        }
+    }
+
+    entry.source = source ? strdup(source) : NULL;
+    entry.target = strdup(target);
+    entry.fstype = filesystemtype ? strdup(filesystemtype) : NULL;
+    entry.data = data ? strdup((const char *)data) : NULL;
+    entry.flags = mountflags;
+    entry.remount_flags = 0;
+    entry.options = options;
+
+    if ( mount_plan_count == mount_plan_size ) {
+        mount_plan_size = mount_plan_size ? mount_plan_size * 2 : 32;
+        mount_plan = (struct mount_plan_entry *)realloc(mount_plan, mount_plan_size * sizeof(struct mount_plan_entry));
+        if ( mount_plan == NULL ) {
+            singularity_message(ERROR, "Failed to allocate memory for mount plan\n");
+            ABORT(255);
+        }
+    }
+
+    /* Mount parents before their children so a later bind can not shadow
+     * an earlier one, unless the new mount reads from beneath that child */
+    i = mount_plan_count;
+    if ( ( mountflags & MS_REMOUNT ) == 0 ) {
+        char *realsource = NULL;
+
+        if ( entry.source != NULL && ( mountflags & MS_BIND ) ) {
+            realsource = mount_plan_key(entry.source);
+        }
+
+        while ( i > 0 ) {
+            struct mount_plan_entry *prev = &mount_plan[i - 1];
+
+            if ( ( prev->flags & MS_REMOUNT ) ||
+                 strcmp(prev->key, entry.key) == 0 ||
+                 mount_path_under(prev->key, entry.key) == 0 ||
+                 ( realsource != NULL && mount_path_under(realsource, prev->key) ) ) {
+                break;
+            }
+            i--;
+        }
+        free(realsource);
+    }
+
+    if ( i < mount_plan_count ) {
+        singularity_message(DEBUG, "Ordering mount of %s before %s\n", entry.key, mount_plan[i].key);
+        memmove(&mount_plan[i + 1], &mount_plan[i], ( mount_plan_count - i ) * sizeof(struct mount_plan_entry));
+    }
+    mount_plan[i] = entry;
+    mount_plan_count++;
+}
+
+/* Run the pending plan now if path is, or lies below, one of its targets */
+void singularity_mount_plan_sync(const char *path) {
+    char *key;
+    int i;
+
+    if ( mount_plan_count == 0 ) {
+        return;
+    }
+
+    key = mount_plan_key(path);
+    for ( i = 0; i < mount_plan_count; i++ ) {
+        if ( mount_path_under(key, mount_plan[i].key) ) {
+            singularity_message(DEBUG, "Running mount plan early, %s depends on %s\n", key, mount_plan[i].key);
+            singularity_mount_plan_run();
+            break;
+        }
+    }
+    free(key);
+}
+
+int singularity_mount_plan_run(void) {
+    int i;
+    int retval = 0;
+    const char *dryrun = singularity_registry_get("MOUNTPLAN_DRYRUN");
+
+    if ( mount_plan_count == 0 ) {
+        return(0);
+    }
+
+    singularity_message(VERBOSE, "Running mount plan (%d mounts)\n", mount_plan_count);
+
+    if ( dryrun != NULL ) {
+        // Later checks see the planned mounts as if they had been done
+        mount_index_load();
+        for ( i = 0; i < mount_plan_count; i++ ) {
+            mount_plan_dump(&mount_plan[i], stdout);
+            mount_index_update(mount_plan[i].source, mount_plan[i].key, mount_plan[i].fstype, mount_plan[i].flags);
+        }
+        fflush(stdout);
+    } else {
+        if ( singularity_priv_userns_enabled() == 0 ) {
+            if ( seteuid(0) < 0 ) {
+                singularity_message(ERROR, "Failed to escalate privileges: %s\n", strerror(errno));
+                ABORT(255);
+            }
+            mount_plan_escalated = 1;
+        }
+
+        for ( i = 0; i < mount_plan_count; i++ ) {
+            struct mount_plan_entry *entry = &mount_plan[i];
+
+            mount_plan_dump(entry, NULL);
+
+            if ( singularity_mount(entry->source, entry->target, entry->fstype, entry->flags, entry->data) < 0 ||
+                 ( entry->remount_flags && singularity_mount(NULL, entry->target, NULL, entry->remount_flags, NULL) < 0 ) ) {
+                if ( entry->options & MOUNT_PLAN_OPTIONAL ) {
+                    singularity_message(WARNING, "Could not mount %s -> %s: %s\n", entry->source ? entry->source : "none", entry->target, strerror(errno));
+                    retval = -1;
+                    continue;
+                }
+                singularity_message(ERROR, "Failed to mount %s -> %s: %s\n", entry->source ? entry->source : "none", entry->target, strerror(errno));
+                ABORT(255);
+            }
+
+            if ( entry->remount_flags & MS_RDONLY ) {
+                if ( access(entry->target, W_OK) == 0 || (errno != EROFS && errno != EACCES) ) { // Flawfinder: ignore (precautionary confirmation, not necessary)
+                    singularity_message(ERROR, "Failed to write-protect the path %s: %s\n", entry->target, strerror(errno));
+                    ABORT(255);
+                }
+            }
+        }
+
+        if ( mount_plan_escalated ) {
+            mount_plan_escalated = 0;
+            if ( seteuid(singularity_priv_getuid()) < 0 ) {
+                singularity_message(ERROR, "Failed to drop privileges: %s\n", strerror(errno));
+                ABORT(255);
+            }
+        }
+    }
+
+    for ( i = 0; i < mount_plan_count; i++ ) {
+        free(mount_plan[i].source);
+        free(mount_plan[i].target);
+        free(mount_plan[i].key);
+        free(mount_plan[i].fstype);
+        free(mount_plan[i].data);
+    }
+    mount_plan_count = 0;
+
+    return(retval);
+}
+
+int singularity_umount(const char *target, int flags) {
+    int ret;
+    char *realtarget = realpath(target, NULL); // Flawfinder: ignore
+
+    ret = umount2(target, flags);
+
+    if ( ret == 0 && realtarget != NULL && mount_table_size > 0 ) {
+        ENTRY item;
+        ENTRY *found;
+
+        item.key = realtarget;
+        item.data = NULL;
+
+        // The file system below may itself be a mount point, read it again
+        if ( hsearch_r(item, FIND, &found, &mount_table) != 0 ) {
+            mount_index_reset();
+        }
+    }
+    free(realtarget);
+
+    return(ret);
+}
+
 int check_mounted(char *mountpoint) {
     int retval = -1;
-    FILE *mounts;
-    char *line = (char *)malloc(MAX_LINE_LEN);
     char *real_mountpoint = joinpath(CONTAINER_FINALDIR, mountpoint);
     char *resolved_mountpoint = realpath(real_mountpoint, NULL); // Flawfinder: ignore
 
@@ -166,28 +787,13 @@ int check_mounted(char *mountpoint) {
 
     singularity_message(DEBUG, "Checking if currently mounted: %s\n", mountpoint);
 
-    singularity_message(DEBUG, "Opening /proc/mounts\n");
-    if ( ( mounts = fopen("/proc/mounts", "r") ) == NULL ) { // Flawfinder: ignore
-        singularity_message(ERROR, "Could not open /proc/mounts: %s\n", strerror(errno));
-        ABORT(255);
+    if ( singularity_mount_index_find(resolved_mountpoint) == 1 || mount_plan_find(resolved_mountpoint) == 1 ) {
+        singularity_message(DEBUG, "Mountpoint is already mounted: %s\n", resolved_mountpoint);
+        retval = 1;
     }
 
-    singularity_message(DEBUG, "Iterating through /proc/mounts\n");
-    while ( ( retval < 0 ) && ( fgets(line, MAX_LINE_LEN, mounts) != NULL ) ) {
-        (void) strtok(line, " ");
-        char *mount = strtok(NULL, " ");
-
-        if ( strcmp(mount, resolved_mountpoint) == 0 ) {
-            singularity_message(DEBUG, "Mountpoint is already mounted: %s\n", resolved_mountpoint);
-            retval = 1;
-        }
-    }
-
-    fclose(mounts);
-    free(line);
     free(real_mountpoint);
     free(resolved_mountpoint);
 
     return(retval);
 }
-
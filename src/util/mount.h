@@ -17,9 +17,25 @@
 #ifndef __MOUNT_H_
 #define __MOUNT_H_
 
+#define MOUNT_PLAN_OPTIONAL 0x01
+
+struct mount_entry {
+    char *source;
+    char *mountpoint;
+    char *fstype;
+};
+
 int singularity_mount(const char *source, const char *target,
                       const char *filesystemtype, unsigned long mountflags,
                       const void *data);
+int singularity_umount(const char *target, int flags);
 int check_mounted(char *mountpoint);
+int singularity_mount_index_find(const char *path);
+int singularity_mount_index_count(void);
+struct mount_entry *singularity_mount_index_entry(int index);
+void singularity_mount_plan_add(const char *source, const char *target, const char *filesystemtype,
+                                unsigned long mountflags, const void *data, int options);
+void singularity_mount_plan_sync(const char *path);
+int singularity_mount_plan_run(void);
 
 #endif /* __MOUNT_H_ */
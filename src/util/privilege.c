@@ -44,6 +44,7 @@
 #include "util/registry.h"
 #include "util/privilege.h"
 #include "util/message.h"
+#include "util/trace.h"
 #include "util/config_parser.h"
 
 
@@ -80,9 +81,9 @@ void singularity_priv_init(void) {
     long int target_gid = -1;
     memset(&uinfo, '\0', sizeof(uinfo));
     memset(&sinfo, '\0', sizeof(sinfo));
-    char *home_tmp = singularity_registry_get("HOME");
-    char *target_uid_str = singularity_registry_get("TARGET_UID");
-    char *target_gid_str = singularity_registry_get("TARGET_GID");
+    const char *home_tmp = singularity_registry_get("HOME");
+    const char *target_uid_str = singularity_registry_get("TARGET_UID");
+    const char *target_gid_str = singularity_registry_get("TARGET_GID");
     struct passwd *pwent;
 
     singularity_message(DEBUG, "Initializing user info\n");
@@ -279,6 +280,7 @@ void singularity_priv_userns(void) {
 }
 
 void singularity_priv_escalate(void) {
+    singularity_trace_count(TRACE_PRIV);
 
     if ( uinfo.ready != 1 ) {
         singularity_message(ERROR, "User info is not available\n");
@@ -314,6 +316,7 @@ void singularity_priv_escalate(void) {
 
 
 void singularity_priv_drop(void) {
+    singularity_trace_count(TRACE_PRIV);
 
     if ( uinfo.ready != 1 ) {
         singularity_message(ERROR, "User info is not available\n");
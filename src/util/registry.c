@@ -26,14 +26,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <errno.h> 
 #include <string.h>
+#include <strings.h>
 #include <fcntl.h>  
 #include <limits.h>
-#include <search.h>
-#include <glob.h>
 
 #include "config.h"
 #include "util/util.h"
@@ -41,120 +41,191 @@
 #include "util/file.h"
 #include "registry.h"
 
+#define REGISTRY_ARENA_CHUNK 4096
+
+
+// Keys and values live in an arena that is never freed, so the pointers
+// returned by singularity_registry_get() stay valid for the life of the
+// process, even after the key is set again.
+struct registry_chunk {
+    struct registry_chunk *next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+struct registry_entry {
+    char *key;
+    char *value;
+    uint64_t hash;
+};
 
 static int registry_initialized = 0;
-static struct hsearch_data htab;
+static struct registry_chunk *arena = NULL;
+static struct registry_entry *table = NULL;
+static size_t table_size = 0;
+static size_t table_count = 0;
 extern char **environ;
 
 
-static ENTRY keypair(char *key, char *value) {
-    ENTRY hash_entry;
+static char *arena_strndup(const char *str, size_t len) {
+    char *copy;
+
+    if ( arena == NULL || arena->size - arena->used < len + 1 ) {
+        size_t size = len + 1 > REGISTRY_ARENA_CHUNK ? len + 1 : REGISTRY_ARENA_CHUNK;
+        struct registry_chunk *chunk = (struct registry_chunk *)malloc(sizeof(struct registry_chunk) + size);
 
-    if ( key == NULL ) {
-        singularity_message(ERROR, "Internal - Called keypair() with NULL key\n");
+        if ( chunk == NULL ) {
+            singularity_message(ERROR, "Internal error - Unable to allocate registry memory\n");
+            ABORT(255);
+        }
+        chunk->next = arena;
+        chunk->used = 0;
+        chunk->size = size;
+        arena = chunk;
+    }
+
+    copy = arena->data + arena->used;
+    memcpy(copy, str, len); // Flawfinder: ignore
+    copy[len] = '\0';
+    arena->used += len + 1;
+
+    return(copy);
+}
+
+// Keys are case insensitive, stored upper case
+static uint64_t registry_hash(const char *key, size_t len) {
+    uint64_t hash = FNV1A_INIT;
+    size_t i;
+
+    for ( i = 0; i < len; i++ ) {
+        unsigned char c = toupper((unsigned char)key[i]);
+        hash = fnv1a(hash, &c, 1);
+    }
+
+    return(hash);
+}
+
+// Returns the entry for key, or the empty slot it would go in
+static struct registry_entry *registry_slot(const char *key, size_t len, uint64_t hash) {
+    size_t idx = hash & ( table_size - 1 );
+
+    while ( table[idx].key != NULL ) {
+        if ( table[idx].hash == hash && strncasecmp(table[idx].key, key, len) == 0 && table[idx].key[len] == '\0' ) {
+            break;
+        }
+        idx = ( idx + 1 ) & ( table_size - 1 );
+    }
+
+    return(&table[idx]);
+}
+
+static void registry_grow(size_t size) {
+    struct registry_entry *old_table = table;
+    size_t old_size = table_size;
+    size_t i;
+
+    if ( ( table = (struct registry_entry *)calloc(size, sizeof(struct registry_entry)) ) == NULL ) {
+        singularity_message(ERROR, "Internal error - Unable to initalize registry core: %s\n", strerror(errno));
         ABORT(255);
     }
+    table_size = size;
+
+    for ( i = 0; i < old_size; i++ ) {
+        if ( old_table[i].key != NULL ) {
+            *registry_slot(old_table[i].key, strlen(old_table[i].key), old_table[i].hash) = old_table[i];
+        }
+    }
+    free(old_table);
+}
 
-    hash_entry.key = strdup(key);
+static void registry_store(const char *key, size_t len, char *value) {
+    uint64_t hash = registry_hash(key, len);
+    struct registry_entry *entry;
+
+    if ( ( table_count + 1 ) * 2 > table_size ) {
+        registry_grow(table_size * 2);
+    }
 
-    if ( value == NULL ) {
-        hash_entry.data = NULL;
+    entry = registry_slot(key, len, hash);
+    if ( entry->key == NULL ) {
+        size_t i;
+
+        entry->key = arena_strndup(key, len);
+        for ( i = 0; i < len; i++ ) {
+            entry->key[i] = toupper((unsigned char)entry->key[i]);
+        }
+        entry->hash = hash;
+        table_count++;
+    } else if ( entry->value != NULL && value != NULL && strcmp(entry->value, value) == 0 ) {
+        return;
     } else {
-        hash_entry.data = strdup(value);
+        singularity_message(VERBOSE2, "Found prior value for '%s', overriding with '%s'\n", entry->key, value);
     }
 
-    return hash_entry;
+    entry->value = value ? arena_strndup(value, strlen(value)) : NULL;
 }
 
 
 void singularity_registry_init(void) {
     if ( registry_initialized != 1 ) {
-        char **env = environ;
-        singularity_message(VERBOSE, "Initializing Singularity Registry\n");
-        if ( hcreate_r(REGISTRY_SIZE, &htab) == 0 ) {
-            singularity_message(ERROR, "Internal error - Unable to initalize registry core: %s\n", strerror(errno));
-            ABORT(255);
-        }
+        char **env;
 
+        singularity_message(VERBOSE, "Initializing Singularity Registry\n");
         registry_initialized = 1;
+        registry_grow(REGISTRY_SIZE);
 
-        while (*env) {
-            char *tok;
-            char *string = strdup(*env++);
+        for ( env = environ; *env != NULL; env++ ) {
+            char *name;
+            char *value;
+            size_t len;
 
-            if ( string == NULL ) {
-                continue;
-            } 
-
-            if ( strncmp(string, "SINGULARITY_", 12) != 0 ) {
+            if ( strncmp(*env, "SINGULARITY_", 12) != 0 || ( value = strchr(*env, '=') ) == NULL ) {
                 continue;
             }
 
-            tok = strchr(string, '=');
-            *tok = '\0';
-
-            string += 12; // Move string over so that SINGULARITY_ is skipped over
+            name = *env + 12; // SINGULARITY_ is skipped over
+            len = value - name;
+            if ( len > MAX_KEY_LEN ) {
+                len = MAX_KEY_LEN;
+            }
+            value++;
 
-            singularity_registry_set(string, tok+1);
+            singularity_message(VERBOSE2, "Adding value to registry: '%.*s' = '%s'\n", (int)len, name, value);
+            registry_store(name, len, value);
         }
     }
 }
 
 
-char *singularity_registry_get(char *key) {
-    ENTRY *found;
-    char *upperkey;
-    int i = 0;
-    int len = strlength(key, MAX_KEY_LEN);
-
-    upperkey = (char *) malloc(len + 1);
+const char *singularity_registry_get(char *key) {
+    struct registry_entry *entry;
+    size_t len = strlength(key, MAX_KEY_LEN);
 
     singularity_registry_init();
 
-    for ( i = 0; i < len; ++i )
-        upperkey[i] = toupper(key[i]);
-    upperkey[len] = '\0';
-
-    if ( hsearch_r(keypair(upperkey, NULL), FIND, &found, &htab) == 0 ) {
-        singularity_message(DEBUG, "Returning NULL on '%s'\n", upperkey);
+    entry = registry_slot(key, len, registry_hash(key, len));
+    if ( entry->key == NULL ) {
+        singularity_message(DEBUG, "Returning NULL on '%s'\n", key);
         return(NULL);
     }
-    
-    singularity_message(DEBUG, "Returning value from registry: '%s' = '%s'\n", upperkey, (char *)found->data);
 
-    return(found->data ? (strdup(found->data)) : NULL);
+    singularity_message(DEBUG, "Returning value from registry: '%s' = '%s'\n", entry->key, entry->value);
+
+    return(entry->value);
 }
 
 
 int singularity_registry_set(char *key, char *value) {
-    ENTRY *prev;
-    char *upperkey;
-    int i = 0;
-    int len = strlength(key, MAX_KEY_LEN);
-
-    upperkey = (char *) malloc(len + 1);
+    size_t len = strlength(key, MAX_KEY_LEN);
 
     singularity_registry_init();
 
-    for ( i = 0; i < len; ++i )
-        upperkey[i] = toupper(key[i]);
-    upperkey[len] = '\0';
+    singularity_message(VERBOSE2, "Adding value to registry: '%s' = '%s'\n", key, value);
 
-    singularity_message(VERBOSE2, "Adding value to registry: '%s' = '%s'\n", upperkey, value);
+    registry_store(key, len, value);
 
-    if ( hsearch_r(keypair(upperkey, value), FIND, &prev, &htab) != 0 ) {
-        singularity_message(VERBOSE2, "Found prior value for '%s', overriding with '%s'\n", key, value);
-        prev->data = value ? strdup(value) : NULL;
-    } else {
-        if ( hsearch_r(keypair(upperkey, value), ENTER, &prev, &htab) == 0 ) {
-            singularity_message(ERROR, "Internal error - Unable to set registry entry ('%s' = '%s'): %s\n", key, value, strerror(errno));
-            ABORT(255);
-        }
-    }
     singularity_message(DEBUG, "Returning singularity_registry_set(%s, %s) = 0\n", key, value);
 
     return(0);
 }
-
-
-
@@ -41,7 +41,9 @@ extern void singularity_registry_init(void);
 extern int singularity_registry_set(char *key, char *value);
 
 // Get any value that is currently being stored in the registry. If the key
-// is not currently set, it will return with NULL.
-extern char *singularity_registry_get(char *key);
+// is not currently set, it will return with NULL. The string belongs to the
+// registry and must not be modified or freed; it stays valid for the life of
+// the process.
+extern const char *singularity_registry_get(char *key);
 
 #endif /* __SINGULARITY_REGISTRY_H_ */
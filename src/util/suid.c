@@ -102,6 +102,7 @@ int singularity_suid_init(char **argv) {
 
             singularity_priv_drop_perm();
 
+            singularity_message_flush();
             execv(argv[0], argv); // Flawfinder: ignore (all covered with sand)
 
             singularity_message(ERROR, "Failed exec'ing non-SUID program flow: %s\n", strerror(errno));
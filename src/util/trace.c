@@ -0,0 +1,145 @@
+/*
+ * Copyright (c) 2017-2018, SyLabs, Inc. All rights reserved.
+ * Copyright (c) 2017, SingularityWare, LLC. All rights reserved.
+ * 
+ * See the COPYRIGHT.md file at the top-level directory of this distribution and at
+ * https://github.com/singularityware/singularity/blob/master/COPYRIGHT.md.
+ * 
+ * This file is part of the Singularity Linux container project. It is subject to the license
+ * terms in the LICENSE.md file found in the top-level directory of this distribution and
+ * at https://github.com/singularityware/singularity/blob/master/LICENSE.md. No part
+ * of Singularity, including this file, may be copied, modified, propagated, or distributed
+ * except according to the terms contained in the LICENSE.md file.
+ * 
+*/
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "config.h"
+#include "util/message.h"
+#include "util/trace.h"
+
+#define TRACE_MAX_STAGES 64
+
+struct trace_record {
+    const char *stage;
+    long long start;
+    long long end;
+    unsigned long counters[TRACE_COUNTERS];
+};
+
+static struct trace_record records[TRACE_MAX_STAGES];
+static int record_count = 0;
+static int trace_enabled = 0;
+static int trace_fd = -1;
+static char *trace_file = NULL;
+
+
+static long long trace_now(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return((long long)ts.tv_sec * 1000000LL + ts.tv_nsec / 1000);
+}
+
+static void trace_open(void) {
+    if ( trace_fd >= 0 || geteuid() != getuid() ) {
+        return;
+    }
+
+    if ( ( trace_fd = open(trace_file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644) ) < 0 ) { // Flawfinder: ignore
+        singularity_message(WARNING, "Could not open trace file %s, disabling tracing: %s\n", trace_file, strerror(errno));
+        trace_enabled = 0;
+    }
+}
+
+static void trace_begin(const char *stage) {
+    if ( record_count >= TRACE_MAX_STAGES ) {
+        return;
+    }
+
+    records[record_count].stage = stage;
+    records[record_count].start = trace_now();
+    records[record_count].end = 0;
+    memset(records[record_count].counters, 0, sizeof(records[record_count].counters));
+    record_count++;
+}
+
+static void trace_end(void) {
+    if ( record_count > 0 && records[record_count-1].end == 0 ) {
+        records[record_count-1].end = trace_now();
+    }
+}
+
+
+void singularity_trace_init(const char *stage) {
+    char *file = getenv("SINGULARITY_TRACE_FILE"); // Flawfinder: ignore
+
+    if ( file == NULL || file[0] == '\0' ) {
+        return;
+    }
+
+    trace_file = strdup(file);
+    trace_enabled = 1;
+    trace_begin(stage);
+}
+
+void singularity_trace_stage(const char *stage) {
+    if ( trace_enabled == 0 ) {
+        return;
+    }
+
+    trace_end();
+    trace_open();
+    trace_begin(stage);
+}
+
+void singularity_trace_count(int counter) {
+    if ( trace_enabled == 0 || record_count == 0 ) {
+        return;
+    }
+
+    records[record_count-1].counters[counter]++;
+}
+
+void singularity_trace_finish(void) {
+    FILE *fp;
+    int fd;
+    int i;
+
+    if ( trace_enabled == 0 ) {
+        return;
+    }
+
+    trace_end();
+    trace_open();
+    trace_enabled = 0;
+
+    if ( trace_fd < 0 ) {
+        return;
+    }
+
+    if ( ( fd = dup(trace_fd) ) < 0 || ( fp = fdopen(fd, "a") ) == NULL ) {
+        singularity_message(WARNING, "Could not write trace file %s: %s\n", trace_file, strerror(errno));
+        close(trace_fd);
+        trace_fd = -1;
+        return;
+    }
+
+    for ( i = 0; i < record_count; i++ ) {
+        fprintf(fp, "{\"pid\": %d, \"stage\": \"%s\", \"start_us\": %lld, \"duration_us\": %lld, \"mounts\": %lu, \"stats\": %lu, \"priv\": %lu}\n",
+                getpid(), records[i].stage, records[i].start, records[i].end - records[i].start,
+                records[i].counters[TRACE_MOUNT], records[i].counters[TRACE_STAT], records[i].counters[TRACE_PRIV]);
+    }
+
+    fclose(fp);
+    close(trace_fd);
+    trace_fd = -1;
+}
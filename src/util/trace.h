@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2017-2018, SyLabs, Inc. All rights reserved.
+ * Copyright (c) 2017, SingularityWare, LLC. All rights reserved.
+ * 
+ * See the COPYRIGHT.md file at the top-level directory of this distribution and at
+ * https://github.com/singularityware/singularity/blob/master/COPYRIGHT.md.
+ * 
+ * This file is part of the Singularity Linux container project. It is subject to the license
+ * terms in the LICENSE.md file found in the top-level directory of this distribution and
+ * at https://github.com/singularityware/singularity/blob/master/LICENSE.md. No part
+ * of Singularity, including this file, may be copied, modified, propagated, or distributed
+ * except according to the terms contained in the LICENSE.md file.
+ * 
+*/
+
+
+#ifndef __SINGULARITY_TRACE_H_
+#define __SINGULARITY_TRACE_H_
+
+    // Counters kept per stage
+    #define TRACE_MOUNT 0
+    #define TRACE_STAT 1
+    #define TRACE_PRIV 2
+    #define TRACE_COUNTERS 3
+
+    // SINGULARITY_TRACE_INIT()
+    // Enable startup tracing if SINGULARITY_TRACE_FILE is set, and begin the
+    // first stage. Stage records are kept in memory and written to the trace
+    // file as JSON lines, one per stage. When tracing is not enabled, all of
+    // the trace calls return immediately.
+    void singularity_trace_init(const char *stage);
+
+
+    // SINGULARITY_TRACE_STAGE()
+    // End the current stage and begin the next one. The trace file is opened
+    // at the first stage boundary reached without escalated privileges, so
+    // it is always created as the calling user.
+    void singularity_trace_stage(const char *stage);
+
+
+    // SINGULARITY_TRACE_COUNT()
+    // Account one mount, stat or privilege transition to the current stage.
+    void singularity_trace_count(int counter);
+
+
+    // SINGULARITY_TRACE_FINISH()
+    // End the current stage and write out all of the records.
+    void singularity_trace_finish(void);
+
+#endif /* __SINGULARITY_TRACE_H_ */
@@ -41,6 +41,8 @@
 #include <ctype.h>
 #include <pwd.h>
 #include <dirent.h>
+#include <limits.h>
+#include <sys/syscall.h>
 
 #include "config.h"
 #include "util/util.h"
@@ -113,7 +115,7 @@ char *envar_path(char *name) {
     return(envar_get(name, "/._+-=,:@", PATH_MAX));
 }
 
-int envar_set(char *key, char *value, int overwrite) {
+int envar_set(char *key, const char *value, int overwrite) {
     if ( key == NULL ) {
         singularity_message(VERBOSE2, "Not setting envar, null key\n");
         return(-1);
@@ -380,7 +382,7 @@ void free_tempfile(struct tempfile *tf) {
 struct tempfile *make_tempfile(void) {
    int fd;
    struct tempfile *tf;
-   char *tmpdir = singularity_registry_get("TMPDIR");
+   const char *tmpdir = singularity_registry_get("TMPDIR");
 
    if (tmpdir == NULL) {
        tmpdir = "/tmp";
@@ -409,9 +411,9 @@ struct tempfile *make_tempfile(void) {
 struct tempfile *make_logfile(char *label) {
     struct tempfile *tf;
 
-    char *daemon = singularity_registry_get("DAEMON_NAME");
-    char *image = basename(singularity_registry_get("IMAGE"));
-    char *tmpdir = singularity_registry_get("TMPDIR");
+    const char *daemon = singularity_registry_get("DAEMON_NAME");
+    char *image = basename(strdup(singularity_registry_get("IMAGE")));
+    const char *tmpdir = singularity_registry_get("TMPDIR");
 
     if (tmpdir == NULL) {
         tmpdir = "/tmp";
@@ -443,44 +445,177 @@ struct tempfile *make_logfile(char *label) {
     return(tf);
 }
 
-// close all file descriptors pointing to a directory or a socket
-void fd_cleanup(void) {
-    int fd_proc;
-    DIR *dir;
-    struct dirent *dirent;
+static int fd_compare(const void *a, const void *b) {
+    int x = *(const int *)a;
+    int y = *(const int *)b;
 
-    singularity_message(DEBUG, "Cleanup file descriptor table\n");
+    return( ( x > y ) - ( x < y ) );
+}
 
-    if ( ( fd_proc = open("/proc/self/fd", O_RDONLY) ) < 0 ) {
-        singularity_message(ERROR, "Failed to open directory /proc/self/fd: %s\n", strerror(errno));
-        ABORT(255);
-    }
+// Returns a sorted array of the open file descriptors >= first, or NULL if
+// /proc/self/fd can not be read (e.g. no /proc inside of the container).
+static int *fd_list_open(int first, int *count) {
+    DIR *dir;
+    struct dirent *dirent;
+    int *fds = NULL;
+    int size = 0;
+    int len = 0;
 
-    if ( ( dir = fdopendir(fd_proc) ) == NULL ) {
-        singularity_message(ERROR, "Failed to list directory /proc/self/fd: %s\n", strerror(errno));
-        ABORT(255);
+    if ( ( dir = opendir("/proc/self/fd") ) == NULL ) {
+        singularity_message(DEBUG, "Could not open /proc/self/fd: %s\n", strerror(errno));
+        return(NULL);
     }
 
     while ( ( dirent = readdir(dir) ) ) {
-        struct stat st;
         long int fd;
 
-        if ( strcmp(dirent->d_name, ".") == 0 || strcmp(dirent->d_name, "..") == 0 ) {
-            continue;
-        }
         if ( str2int(dirent->d_name, &fd) < 0 ) {
             continue;
         }
-        if ( fd == fd_proc || fstat(fd, &st) < 0 ) {
+        if ( fd < first || fd == dirfd(dir) ) {
             continue;
         }
-        if ( S_ISDIR(st.st_mode) || S_ISSOCK(st.st_mode) ) {
-            close(fd);
+        if ( len == size ) {
+            size = size ? size * 2 : 64;
+            if ( ( fds = realloc(fds, size * sizeof(int)) ) == NULL ) {
+                singularity_message(ERROR, "Failed to allocate memory for file descriptor list\n");
+                ABORT(255);
+            }
         }
+        fds[len++] = fd;
     }
 
-    if ( closedir(dir) < 0 ) {
-        singularity_message(ERROR, "Failed to close directory /proc/self/fd: %s\n", strerror(errno));
+    closedir(dir);
+
+    qsort(fds, len, sizeof(int), fd_compare);
+    *count = len;
+
+    // Never return NULL for an empty list
+    if ( fds == NULL && ( fds = malloc(sizeof(int)) ) == NULL ) {
+        singularity_message(ERROR, "Failed to allocate memory for file descriptor list\n");
         ABORT(255);
     }
+
+    return(fds);
+}
+
+// Close lo..hi, by close_range() if the kernel has it (5.9+), otherwise
+// only the descriptors known to be open or, without that list, each one
+// up to the descriptor limit.
+static void fd_close_range(int lo, int hi, int *open_fds, int open_count) {
+    static int no_close_range = 0;
+    int i;
+
+    if ( lo > hi ) {
+        return;
+    }
+
+#ifdef SYS_close_range
+    if ( no_close_range == 0 ) {
+        if ( syscall(SYS_close_range, (unsigned int)lo, (unsigned int)hi, 0) == 0 ) {
+            return;
+        }
+        singularity_message(DEBUG, "close_range() not usable, falling back: %s\n", strerror(errno));
+        no_close_range = 1;
+    }
+#endif
+
+    if ( open_fds != NULL ) {
+        for ( i = 0; i < open_count; i++ ) {
+            if ( open_fds[i] >= lo && open_fds[i] <= hi ) {
+                close(open_fds[i]);
+            }
+        }
+    } else {
+        long int max = sysconf(_SC_OPEN_MAX);
+
+        for ( i = lo; i <= hi && i < max; i++ ) {
+            close(i);
+        }
+    }
+}
+
+void fd_sanitize(int first, int *keep, int keep_count, int (*keep_fn)(int fd, struct stat *st)) {
+    int *open_fds;
+    int *kept;
+    int open_count = 0;
+    int kept_count = 0;
+    int lo = first;
+    int i;
+
+    open_fds = fd_list_open(first, &open_count);
+
+    if ( open_fds == NULL && keep_fn != NULL ) {
+        // Without /proc the only way to find what keep_fn wants is to
+        // look at every possible descriptor.
+        singularity_message(DEBUG, "Checking every file descriptor up to the limit\n");
+        open_count = 0;
+        if ( ( open_fds = malloc(sizeof(int) * ( sysconf(_SC_OPEN_MAX) - first + 1 )) ) == NULL ) {
+            singularity_message(ERROR, "Failed to allocate memory for file descriptor list\n");
+            ABORT(255);
+        }
+        for ( i = first; i < sysconf(_SC_OPEN_MAX); i++ ) {
+            if ( fcntl(i, F_GETFD) >= 0 ) {
+                open_fds[open_count++] = i;
+            }
+        }
+    }
+
+    if ( ( kept = malloc(sizeof(int) * ( keep_count + open_count + 1 )) ) == NULL ) {
+        singularity_message(ERROR, "Failed to allocate memory for file descriptor list\n");
+        ABORT(255);
+    }
+
+    for ( i = 0; i < keep_count; i++ ) {
+        if ( keep[i] >= first ) {
+            kept[kept_count++] = keep[i];
+        }
+    }
+    if ( keep_fn != NULL ) {
+        for ( i = 0; i < open_count; i++ ) {
+            struct stat st;
+
+            if ( fstat(open_fds[i], &st) == 0 && keep_fn(open_fds[i], &st) ) {
+                kept[kept_count++] = open_fds[i];
+            }
+        }
+    }
+
+    qsort(kept, kept_count, sizeof(int), fd_compare);
+
+    // Close the gaps between the descriptors we keep
+    for ( i = 0; i < kept_count; i++ ) {
+        fd_close_range(lo, kept[i] - 1, open_fds, open_count);
+        if ( kept[i] >= lo ) {
+            lo = kept[i] + 1;
+        }
+    }
+    fd_close_range(lo, INT_MAX, open_fds, open_count);
+
+    free(kept);
+    free(open_fds);
+}
+
+static int fd_keep_not_dir_socket(int fd, struct stat *st) {
+    return( !S_ISDIR(st->st_mode) && !S_ISSOCK(st->st_mode) );
+}
+
+// close all file descriptors pointing to a directory or a socket
+void fd_cleanup(void) {
+    singularity_message(DEBUG, "Cleanup file descriptor table\n");
+
+    fd_sanitize(0, NULL, 0, fd_keep_not_dir_socket);
+}
+
+
+uint64_t fnv1a(uint64_t hash, const void *buf, size_t len) {
+    const unsigned char *p = (const unsigned char *)buf;
+    size_t i;
+
+    for ( i = 0; i < len; i++ ) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+
+    return(hash);
 }
@@ -25,7 +25,9 @@
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <linux/limits.h>
+#include <sys/stat.h>
 
 #include "util/message.h"
 
@@ -44,7 +46,7 @@ struct tempfile {
 char *envar_get(char *name, char *allowed, int len);
 char *envar_path(char *name);
 int envar_defined(char *name);
-int envar_set(char *key, char *value, int overwrite);
+int envar_set(char *key, const char *value, int overwrite);
 int intlen(int input);
 char *int2str(int num);
 char *joinpath(const char * path1, const char * path2);
@@ -61,6 +63,12 @@ struct tempfile *make_tempfile(void);
 struct tempfile *make_logfile(char *label);
 void fd_cleanup(void);
 
+// Close every file descriptor >= first except those listed in keep and those
+// for which keep_fn (may be NULL) returns non zero. Uses close_range() on the
+// gaps so the cost does not depend on RLIMIT_NOFILE, and falls back to the
+// descriptors listed in /proc/self/fd on older kernels.
+void fd_sanitize(int first, int *keep, int keep_count, int (*keep_fn)(int fd, struct stat *st));
+
 // Given a const char * string containing a base-10 integer,
 // try to convert to an C integer.
 // This is a bit less error prone (and stricter!) than strtoll:
@@ -72,6 +80,11 @@ void fd_cleanup(void);
 //   errno is set to EINVAL
 int str2int(const char *input_str, long int *output_num);
 
+// 64 bit FNV-1a hash of buf, start with hash = FNV1A_INIT and pass the
+// result back in to hash data in several chunks.
+#define FNV1A_INIT 0xcbf29ce484222325ULL
+uint64_t fnv1a(uint64_t hash, const void *buf, size_t len);
+
 struct passwd;
 
 #define ABORT(a) do {singularity_message(ABRT, "Retval = %d\n", a); exit(a);} while (0)
@@ -0,0 +1,92 @@
+#!/bin/bash
+#
+# Copyright (c) 2017, Gregory M. Kurtzer. All rights reserved.
+#
+# "Singularity" Copyright (c) 2016, The Regents of the University of California,
+# through Lawrence Berkeley National Laboratory (subject to receipt of any
+# required approvals from the U.S. Dept. of Energy).  All rights reserved.
+#
+# This software is licensed under a customized 3-clause BSD license.  Please
+# consult LICENSE file distributed with the sources of this project regarding
+# your rights to use or distribute this software.
+#
+# NOTICE.  This Software was developed under funding from the U.S. Department of
+# Energy and the U.S. Government consequently retains certain rights. As such,
+# the U.S. Government has been granted for itself and others acting on its
+# behalf a paid-up, nonexclusive, irrevocable, worldwide license in the Software
+# to reproduce, distribute copies to the public, prepare derivative works, and
+# perform publicly and display publicly, and to permit other to do so.
+#
+#
+
+
+
+. ./functions
+
+test_init "Docker layer flatten tests"
+
+DOCKER_EXTRACT="$SINGULARITY_libexecdir/singularity/bin/docker-extract"
+PYTHON=`which python3 2>/dev/null || which python`
+
+cd "$SINGULARITY_TESTDIR"
+mkdir rootfs
+
+# lower.tar: a directory with more files than open file descriptors, and a
+# file with two hard links. upper.tar removes the directory and replaces the
+# target of the links.
+cat > layers.py <<'PYEOF'
+import io
+import tarfile
+
+def add(tar, name, data):
+    info = tarfile.TarInfo(name)
+    info.size = len(data)
+    tar.addfile(info, io.BytesIO(data))
+
+def link(tar, name, target):
+    info = tarfile.TarInfo(name)
+    info.type = tarfile.LNKTYPE
+    info.linkname = target
+    tar.addfile(info)
+
+with tarfile.open("lower.tar", "w") as tar:
+    info = tarfile.TarInfo("d")
+    info.type = tarfile.DIRTYPE
+    info.mode = 0o755
+    tar.addfile(info)
+    for i in range(1500):
+        add(tar, "d/f%d" % i, b"data")
+    add(tar, "a", b"old")
+    link(tar, "b", "a")
+    link(tar, "c", "a")
+
+with tarfile.open("upper.tar", "w") as tar:
+    add(tar, ".wh.d", b"")
+    add(tar, "a", b"new")
+PYEOF
+
+cat > check.py <<'PYEOF'
+import sys
+import tarfile
+
+tar = tarfile.open(sys.argv[1])
+files = {}
+for member in tar:
+    if member.name.startswith("d"):
+        sys.exit("whited out %s is in the stream" % member.name)
+    if member.islnk():
+        files[member.name] = "->" + member.linkname
+    elif member.isfile():
+        files[member.name] = tar.extractfile(member).read().decode()
+expected = {"a": "new", "b": "old", "c": "->b"}
+for name in expected:
+    if files.get(name) != expected[name]:
+        sys.exit("%s is %s, expected %s" % (name, files.get(name), expected[name]))
+PYEOF
+
+stest 0 "$PYTHON" layers.py
+stest 0 sh -c "ulimit -n 256; SINGULARITY_ROOTFS='$SINGULARITY_TESTDIR/rootfs' '$DOCKER_EXTRACT' --flatten lower.tar upper.tar > flat.tar"
+stest 0 "$PYTHON" check.py flat.tar
+stest 0 test -z "`ls -A rootfs`"
+
+test_cleanup
@@ -52,6 +52,15 @@ stest 0 singularity instance.list t\*
 stest 0 singularity instance.stop --all
 stest 1 singularity instance.list t\*
 
+# Closing inherited file descriptors must not scale with the open files limit
+NOFILE=`ulimit -Hn`
+if [ "$NOFILE" = "unlimited" ] || [ "$NOFILE" -gt 1048576 ]; then
+    NOFILE=1048576
+fi
+stest 0 sh -c "ulimit -n $NOFILE && exec 9</ && timeout 10 singularity instance.start '$CONTAINER' nofile"
+stest 0 sh -c "ulimit -n $NOFILE && timeout 10 singularity exec instance://nofile true"
+stest 0 singularity instance.stop nofile
+
 
 stest 0 sudo rm -rf "$CONTAINER"
 test_cleanup